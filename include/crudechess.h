@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C interface of libcrudechess
+// Squares are numbered 0 (a1) to 63 (h8), rank by rank. Functions returning int
+// report 0 on success and a negative CRUDECHESS_E* code on failure; no C++
+// exception ever crosses this interface. A board must not be used by two threads
+// at once, but separate boards are independent.
+
+#define CRUDECHESS_API_VERSION 1
+
+// the shared library is built with hidden visibility and exports only these
+#if defined(__GNUC__)
+#define CRUDECHESS_API __attribute__((visibility("default")))
+#else
+#define CRUDECHESS_API
+#endif
+
+#define CRUDECHESS_OK        0
+#define CRUDECHESS_EINVAL   -1  // null board, invalid FEN, illegal position or depth
+#define CRUDECHESS_EILLEGAL -2  // move not legal in the current position
+#define CRUDECHESS_EEMPTY   -3  // no move to unmake
+#define CRUDECHESS_ENOMEM   -4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct crudechess_board crudechess_board_t;
+
+typedef struct {
+    uint8_t from;
+    uint8_t to;
+    char promote_to;    // 'q', 'r', 'b' or 'n' for promotions, 0 otherwise
+} crudechess_move_t;
+
+CRUDECHESS_API int crudechess_api_version(void);
+
+// new board in the starting position, NULL when out of memory
+CRUDECHESS_API crudechess_board_t* crudechess_board_create(void);
+CRUDECHESS_API void crudechess_board_destroy(crudechess_board_t* board);
+
+// a position failing the FEN syntax or legality checks (one king per side, side
+// not to move not in check, no pawns on the back ranks, castling rights and en
+// passant square consistent with the pieces) resets the board to the starting
+// position and returns CRUDECHESS_EINVAL
+CRUDECHESS_API int crudechess_set_fen(crudechess_board_t* board, const char* fen);
+
+// 'w' or 'b'
+CRUDECHESS_API char crudechess_to_move(const crudechess_board_t* board);
+
+// writes at most `capacity' moves to `moves' (promotions expanded to four moves)
+// and returns the total number of legal moves, which may exceed `capacity'
+// (218 always suffices); negative on error
+CRUDECHESS_API int crudechess_legal_moves(crudechess_board_t* board, crudechess_move_t* moves, size_t capacity);
+
+CRUDECHESS_API int crudechess_make_move(crudechess_board_t* board, crudechess_move_t move);
+CRUDECHESS_API int crudechess_unmake_move(crudechess_board_t* board);
+
+// leaf node count, negative on error
+CRUDECHESS_API int64_t crudechess_perft(crudechess_board_t* board, int depth);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench.hh"
+#include "board.hh"
+
+
+namespace {
+    // the first positions of perft/data/perft_mini.csv, the usual perft positions
+    // and a few middlegames and endgames
+    constexpr const char* kPositions[] {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        "1rbq1bn1/2pkp3/n2p3p/3P1pp1/ppP3P1/PPBQP2P/3N1P2/R3KBNR b KQ - 0 1",
+        "rB2kbnr/pb6/1p3q2/5p1P/PpPp4/1Q5N/3PPP1P/RN2KB1R w KQkq - 0 1",
+        "r3kbnr/2qn2p1/8/pppBpp1P/3P1Pb1/P1P1P3/1P2Q2P/RNB1K1NR w KQkq - 0 1",
+        "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+        "r2q1rk1/ppp2ppp/2np1n2/2b1p1B1/2B1P1b1/2NP1N2/PPP2PPP/R2Q1RK1 w - - 0 8",
+        "r1bq1rk1/pp2ppbp/2np1np1/8/3NP3/2N1BP2/PPPQ2PP/R3KB1R w KQ - 3 9",
+        "2r2rk1/pp1bqppp/2n1pn2/3p4/2PP4/P1N1PN2/1P2BPPP/R2Q1RK1 w - - 1 13",
+        "r1b2rk1/2q1bppp/p2ppn2/1p6/3BPP2/2N2B2/PPP3PP/R2Q1R1K w - - 2 14",
+        "8/5pk1/6p1/3R4/7P/6P1/r4PK1/8 b - - 3 41",
+        "8/8/4k3/3p4/3P1K2/8/8/8 w - - 0 1",
+    };
+    constexpr int kPositionCount { sizeof(kPositions) / sizeof(kPositions[0]) };
+}
+
+
+Bench::result_t Bench::run(const int depth, const int threads, const search_options_t& options) {
+    std::atomic<int> next { 0 };
+    std::atomic<uint64_t> perft_nodes { 0 };
+    std::atomic<uint64_t> search_nodes { 0 };
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    const auto work = [&] {
+        Board board;
+        int i;
+        while ((i = next.fetch_add(1)) < kPositionCount) {
+            board.set_fen(kPositions[i]);
+            perft_nodes += board.perft(depth);
+            board.set_fen(kPositions[i]);
+            search_limits_t limits;
+            limits.depth = depth;
+            limits.options = options;
+            board.search(limits, false);
+            search_nodes += board.search_stats().nodes + board.search_stats().qnodes;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& th : workers) {
+        th.join();
+    }
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+
+    result_t result { perft_nodes.load(), search_nodes.load(), t_tm.count() };
+    const uint64_t nodes = result.perft_nodes + result.search_nodes;
+    const double seconds = result.time_ms / 1000.0;
+    printf("Positions: %d \tDepth: %d \tThreads: %d \tOptions: %s\n", kPositionCount, depth, threads, options.str().c_str());
+    printf("Perft nodes: %lu \tSearch nodes: %lu\n", result.perft_nodes, result.search_nodes);
+    printf("Time: %.2lf ms \tNPS: %.0lf\n", result.time_ms, seconds > 0 ? nodes / seconds : 0.0);
+    printf("Signature: %lu\n", nodes);
+    return result;
+}
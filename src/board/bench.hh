@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+struct search_options_t;
+
+// Fixed benchmark: perft and search over a built-in set of positions. The total
+// node count is a deterministic signature of the move generator and search (the
+// same for any thread count and given search options); nodes per second track
+// performance.
+namespace Bench {
+    static constexpr int kDefaultDepth { 4 };
+
+    struct result_t {
+        uint64_t perft_nodes = 0;
+        uint64_t search_nodes = 0;
+        double time_ms = 0.0;
+    };
+
+    result_t run(const int depth, const int threads, const search_options_t& options);
+}
@@ -7,6 +7,7 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <tuple>
 
 #include <string>
 #include <sstream>
@@ -15,6 +16,9 @@
 
 #include "board.hh"
 #include "fen.hh"
+#include "job.hh"
+#include "polyglot.hh"
+#include "stats.hh"
 
 
 void Board::setup() {
@@ -28,7 +32,7 @@ int Board::alg_to_num(const std::string& coords_str) const {
     }
     const char rank_ch = coords_str[1];
     const char file_ch = coords_str[0] < 97 ? coords_str[0]+32 : coords_str[0];
-    const int rank = std::atoi(&rank_ch);
+    const int rank = rank_ch - 48;
     const int file = file_ch - 97;
     return (rank - 1) * 8 + file;
 }
@@ -62,19 +66,71 @@ void Board::clear_board() {
     _w_king_sq = -1;
     _b_king_sq = -1;
 
+    _move_history.clear();
+    _hash = 0;
+    _pawn_hash = 0;
+    std::fill(_nnue_computed.begin(), _nnue_computed.end(), 0);
+
     _pseudolegal_move_targets.clear();
-    _legal_moves.clear();
+    std::fill(_legal_moves_valid.begin(), _legal_moves_valid.end(), 0);
+    std::fill(_check_info_valid.begin(), _check_info_valid.end(), 0);
 }
 
+/**
+ * @brief Checks what fen_valid cannot: one king per side, the side not to move
+ * not in check, no pawns on the first or last rank, castling rights backed by
+ * king and rook on their squares, and an en passant square behind a pawn that
+ * has just made a double step.
+ */
 bool Board::position_legal() const {
+    int kings[2] = { 0, 0 };
+    for (int sq_num = 0; sq_num < 64; ++sq_num) {
+        const auto& sq = _chessboard[sq_num];
+        if (sq.piece() == 'k') {
+            ++kings[sq.colour() == 'b'];
+        } else if (sq.piece() == 'p' && (sq_num / 8 == 0 || sq_num / 8 == 7)) {
+            return false;
+        }
+    }
+    if (kings[0] != 1 || kings[1] != 1) {
+        return false;
+    }
+    if (king_attacked(_to_move == 'w' ? 'b' : 'w')) {
+        return false;
+    }
+
+    // castling_rights bits: K - 8, Q - 4, k - 2, q - 1
+    const auto has = [this](const int sq_num, const char colour, const char piece) {
+        return _chessboard[sq_num].colour() == colour && _chessboard[sq_num].piece() == piece;
+    };
+    if (((_castling_rights & 12) && !has(4, 'w', 'k')) || ((_castling_rights & 3) && !has(60, 'b', 'k'))
+        || ((_castling_rights & 8) && !has(7, 'w', 'r')) || ((_castling_rights & 4) && !has(0, 'w', 'r'))
+        || ((_castling_rights & 2) && !has(63, 'b', 'r')) || ((_castling_rights & 1) && !has(56, 'b', 'r'))) {
+        return false;
+    }
+
+    if (_ep_square != -1) {
+        const int ep_rank = (_to_move == 'w') ? 5 : 2;
+        const int pawn_sq = (_to_move == 'w') ? _ep_square - 8 : _ep_square + 8;
+        if (_ep_square / 8 != ep_rank || _chessboard[_ep_square].colour() != 'e'
+            || !has(pawn_sq, _to_move == 'w' ? 'b' : 'w', 'p')) {
+            return false;
+        }
+    }
     return true;
 }
 
-void Board::set_fen(const std::string& fen) {
+/**
+ * @brief Sets up the position of a FEN.
+ *
+ * @return false for an invalid FEN (the board is left alone) and for an illegal
+ * position (the board is left empty), see position_legal
+ */
+bool Board::set_fen(const std::string& fen) {
     const std::string fen_stripped = Strfuns::strip_copy(fen);
     if (!Fen::fen_valid(fen_stripped)) {
         LOG_WARNING("Invalid FEN: %s", fen_stripped.c_str());
-        return;
+        return false;
     }
 
     clear_board();
@@ -133,29 +189,102 @@ void Board::set_fen(const std::string& fen) {
         }
     }
 
-    // this->print();
+    if (!position_legal()) {
+        clear_board();
+        return false;
+    }
 
-    // if (!position_legal()) {
-    //     std::cerr << "Illegal position" << std::endl;
-    //     clear_board();
-    //     return;
-    // }
+    _hash = compute_hash(false);
+    _pawn_hash = compute_hash(true);
+    return true;
+}
+
+
+/**
+ * @brief Sets up a position from a list of pieces, without castling rights or en
+ * passant square. Much cheaper than set_fen for generated positions.
+ */
+void Board::set_pieces(const std::vector<piece_placement_t>& pieces, const char to_move) {
+    clear_board();
+    for (const auto& pc : pieces) {
+        add_piece_internal(pc.colour, pc.piece, pc.sq_num);
+        update_piece_sets_internal(pc.colour, -1, pc.sq_num);
+    }
+    _to_move = to_move;
+    _hash = compute_hash(false);
+    _pawn_hash = compute_hash(true);
+}
+
+std::vector<piece_placement_t> Board::get_pieces() const {
+    std::vector<piece_placement_t> pieces;
+    for (const auto& p_set : { &_white_pieces, &_black_pieces }) {
+        for (const auto sq_num : *p_set) {
+            pieces.push_back({ _chessboard[sq_num].colour(), _chessboard[sq_num].piece(), sq_num });
+        }
+    }
+    return pieces;
+}
 
-    get_legal_moves();
+/**
+ * @brief Computes the Zobrist hash of the current position from scratch.
+ *
+ * @param pawns_only compute the pawn key (pawn placement only) instead
+ */
+Zobrist::key_t Board::compute_hash(const bool pawns_only) const {
+    Zobrist::key_t h = 0;
+    for (int sq_num = 0; sq_num < 64; ++sq_num) {
+        const auto& sq = _chessboard[sq_num];
+        if (sq.colour() != 'e' && (!pawns_only || sq.piece() == 'p')) {
+            h ^= Zobrist::piece_key(sq.colour(), sq.piece(), sq_num);
+        }
+    }
+    if (!pawns_only) {
+        h ^= Zobrist::castling_key(_castling_rights);
+        h ^= ep_hash();
+        if (_to_move == 'b') {
+            h ^= Zobrist::kKeys.side;
+        }
+    }
+    return h;
+}
 
-    detect_game_end();
+/**
+ * @brief En passant contribution to the hash. The ep square only distinguishes
+ * positions if the player to move has a pawn ready to capture on it, otherwise
+ * repeated positions would not hash equal.
+ */
+Zobrist::key_t Board::ep_hash() const {
+    if (_ep_square == -1) {
+        return 0;
+    }
+    const int ep_file = _ep_square % 8;
+    const int atk_sq_num = (_to_move == 'w') ? _ep_square - 8 : _ep_square + 8;
+    for (const int file_diff : { -1, 1 }) {
+        if (ep_file + file_diff < 0 || ep_file + file_diff > 7) {
+            continue;
+        }
+        const auto& atk_sq = _chessboard[atk_sq_num + file_diff];
+        if (atk_sq.colour() == _to_move && atk_sq.piece() == 'p') {
+            return Zobrist::ep_key(_ep_square);
+        }
+    }
+    return 0;
 }
 
 
 bool Board::is_in_check() const {
-    const char k_colour = _to_move;
+    STATS_INC(kInCheck);
+    return king_attacked(_to_move);
+}
+
+bool Board::king_attacked(const char k_colour) const {
     const int k_row = (k_colour == 'w') ? _w_king_sq / 8 : _b_king_sq / 8;
     const int k_col = (k_colour == 'w') ? _w_king_sq % 8 : _b_king_sq % 8;
 
     // pawn checks
     int pawn_move = (k_colour == 'w') ? 1 : -1;
     std::vector<std::pair<int, int>> pawn_moves { {pawn_move, -1}, {pawn_move, 1} };
-    for (const auto [mv_row, mv_col] : pawn_moves) {
+    for (const auto& [mv_row, mv_col] : pawn_moves) {
         int atk_row = k_row + mv_row;
         int atk_col = k_col + mv_col;
         if (0 <= atk_row && atk_row <= 7 && 0 <= atk_col && atk_col <= 7) {
@@ -168,7 +297,7 @@ bool Board::is_in_check() const {
 
     // king checks
     std::vector<std::pair<int, int>> king_moves { {1, 1}, {1, 0}, {1, -1}, {0, 1}, {0, -1}, {-1, 1}, {-1, 0}, {-1, -1} };
-    for (const auto [mv_row, mv_col] : king_moves) {
+    for (const auto& [mv_row, mv_col] : king_moves) {
         int atk_row = k_row + mv_row;
         int atk_col = k_col + mv_col;
         if (0 <= atk_row && atk_row <= 7 && 0 <= atk_col && atk_col <= 7) {
@@ -181,7 +310,7 @@ bool Board::is_in_check() const {
 
     // knight checks
     std::vector<std::pair<int, int>> knight_moves { {1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1} };
-    for (const auto [mv_row, mv_col] : knight_moves) {
+    for (const auto& [mv_row, mv_col] : knight_moves) {
         int atk_row = k_row + mv_row;
         int atk_col = k_col + mv_col;
         if (0 <= atk_row && atk_row <= 7 && 0 <= atk_col && atk_col <= 7) {
@@ -195,7 +324,7 @@ bool Board::is_in_check() const {
     // ray piece checks
     const std::string brq = "brq";
     std::vector<std::tuple<int, int, char>> brq_moves { {-1, -1, 'r'}, {-1, 1, 'r'}, {1, -1, 'r'}, {1, 1, 'r'}, {-1, 0, 'b'}, {0, -1, 'b'}, {1, 0, 'b'}, {0, 1, 'b'} };
-    for (const auto [mv_row, mv_col, notp_ch] : brq_moves) {
+    for (const auto& [mv_row, mv_col, notp_ch] : brq_moves) {
         int atk_row = k_row + mv_row;
         int atk_col = k_col + mv_col;
         while (0 <= atk_row && atk_row <= 7 && 0 <= atk_col && atk_col <= 7) {
@@ -215,9 +344,10 @@ bool Board::is_in_check() const {
 
 
 void Board::make_move(const int from_num, const int to_num, const char promote_to, const bool perft_mode) {
+    STATS_INC(kMakeMove);
     if (!perft_mode) {
         bool legal = false;
-        for (const auto& [from_mv, to_mv] : _legal_moves) {
+        for (const auto& [from_mv, to_mv] : legal_moves()) {
             if (from_mv == from_num && to_mv == to_num) {
                 legal = true;
                 break;
@@ -234,6 +364,9 @@ void Board::make_move(const int from_num, const int to_num, const char promote_t
     const int ep_sq = _ep_square;
     const int hm_cl = _halfmove_clock;
     const int fm_ct = _fullmove_counter;
+    const Zobrist::key_t hash = _hash;
+    const Zobrist::key_t pawn_hash = _pawn_hash;
+    const Zobrist::key_t ep_hash_before = ep_hash();
 
     auto& from_sq = _chessboard[from_num];
     auto& to_sq = _chessboard[to_num];
@@ -283,7 +416,7 @@ void Board::make_move(const int from_num, const int to_num, const char promote_t
     _to_move = (_to_move == 'w') ? 'b' : 'w';
 
     // update list of previous moves
-    move_record_t move_data {from_num, to_num, from_piece, to_piece, rval.second, cs_rt, ep_sq, hm_cl, fm_ct, _legal_moves};
+    move_record_t move_data {from_num, to_num, from_piece, to_piece, rval.second, cs_rt, ep_sq, hm_cl, fm_ct, hash, pawn_hash};
     _move_history.push_back(move_data);
 
     // detect ep in next ply
@@ -299,12 +432,60 @@ void Board::make_move(const int from_num, const int to_num, const char promote_t
         _ep_square = -1;
     }
 
-    // update legal moves
-    get_legal_moves();
+    // update hashes
+    const char their_colour = (from_colour == 'w') ? 'b' : 'w';
+    const char placed_piece = _chessboard[to_num].piece(); // differs from from_piece after promotion
+    Zobrist::key_t piece_delta = Zobrist::piece_key(from_colour, from_piece, from_num);
+    Zobrist::key_t pawn_delta = (from_piece == 'p') ? piece_delta : 0;
+    const Zobrist::key_t placed_key = Zobrist::piece_key(from_colour, placed_piece, to_num);
+    piece_delta ^= placed_key;
+    if (placed_piece == 'p') {
+        pawn_delta ^= placed_key;
+    }
+    if (to_piece != 'e') {
+        const Zobrist::key_t captured_key = Zobrist::piece_key(their_colour, to_piece, to_num);
+        piece_delta ^= captured_key;
+        if (to_piece == 'p') {
+            pawn_delta ^= captured_key;
+        }
+    }
+    if (rval.second == 'e') {
+        const int ep_pawn_sq = to_num > from_num ? to_num - 8 : to_num + 8;
+        const Zobrist::key_t captured_key = Zobrist::piece_key(their_colour, 'p', ep_pawn_sq);
+        piece_delta ^= captured_key;
+        pawn_delta ^= captured_key;
+    } else if (rval.second == 'c') {
+        const int rook_from = (to_num > from_num) ? from_num + 3 : from_num - 4;
+        const int rook_to = (to_num > from_num) ? from_num + 1 : from_num - 1;
+        piece_delta ^= Zobrist::piece_key(from_colour, 'r', rook_from) ^ Zobrist::piece_key(from_colour, 'r', rook_to);
+    }
+    _hash = hash ^ piece_delta ^ Zobrist::kKeys.side
+          ^ Zobrist::castling_key(cs_rt) ^ Zobrist::castling_key(_castling_rights)
+          ^ ep_hash_before ^ ep_hash();
+    _pawn_hash = pawn_hash ^ pawn_delta;
+    // the buckets are loaded while the move is finished and the moves generated
+    if (_perft_table) {
+        _perft_table->prefetch(_hash);
+    }
+    if (pawn_delta) {
+        _pawn_table.prefetch(_pawn_hash);
+    }
+
+    if (NNUE::loaded()) {
+        nnue_update_internal(from_colour, from_piece, from_num, to_num, placed_piece, to_piece, rval.second);
+    }
+
+    // legal moves and check info of the new position are generated when needed
+    if (_legal_moves_valid.size() > _move_history.size()) {
+        _legal_moves_valid[_move_history.size()] = 0;
+    }
+    if (_check_info_valid.size() > _move_history.size()) {
+        _check_info_valid[_move_history.size()] = 0;
+    }
 
     // detect, handle end
     if (!perft_mode) {
-        detect_game_end();
+        detect_game_end(true);
     }
 }
 
@@ -312,7 +493,30 @@ void Board::make_move(const int from_num, const int to_num, const char promote_t
     make_move(from_num, to_num, promote_to, false);
 }
 
+/**
+ * @brief Quiet variant of make_move for library callers: checks legality and
+ * reports the result instead of printing it.
+ */
+bool Board::play_move(const int from_num, const int to_num, const char promote_to) {
+    for (const auto& [from_mv, to_mv] : legal_moves()) {
+        if (from_mv == from_num && to_mv == to_num) {
+            make_move(from_num, to_num, promote_to, true);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Board::undo_move() {
+    if (_move_history.empty()) {
+        return false;
+    }
+    unmake_move();
+    return true;
+}
+
 void Board::unmake_move() {
+    STATS_INC(kUnmakeMove);
     if (_move_history.size() == 0) {
         std::cout << "Nothing to unmake\n";
         return;
@@ -326,36 +530,167 @@ void Board::unmake_move() {
     _ep_square = move_data.ep_square;
     _halfmove_clock = move_data.halfmove_clock;
     _fullmove_counter = move_data.fullmove_counter;
+    _hash = move_data.hash;
+    _pawn_hash = move_data.pawn_hash;
 
     const char has_moved = _to_move == 'b' ? 'w' : 'b';
     // unmake the move
     unmove_piece_internal(move_data.from_num, move_data.to_num, has_moved, move_data.from_piece, move_data.to_piece, true);
 
     _to_move = has_moved;
-    _legal_moves = move_data.moves_cache;
 }
 
-int Board::detect_game_end(const bool verbose) const {
-    if (_legal_moves.size() == 0) {
+/**
+ * @brief Passes the move (null-move pruning in search). The record has move type
+ * 'n' and the halfmove clock restarts, so repetitions are not looked for across
+ * it. Only unmake_null_move() may take it back.
+ */
+void Board::make_null_move() {
+    const Zobrist::key_t ep_hash_before = ep_hash();
+    _move_history.push_back({ -1, -1, 'e', 'e', 'n', _castling_rights, _ep_square, _halfmove_clock, _fullmove_counter, _hash, _pawn_hash });
+    _ep_square = -1;
+    _halfmove_clock = 0;
+    if (_to_move == 'b') {
+        _fullmove_counter += 1;
+    }
+    _to_move = (_to_move == 'w') ? 'b' : 'w';
+    _hash ^= Zobrist::kKeys.side ^ ep_hash_before;
+
+    if (NNUE::loaded()) {
+        nnue_null_move_internal();
+    }
+    if (_legal_moves_valid.size() > _move_history.size()) {
+        _legal_moves_valid[_move_history.size()] = 0;
+    }
+    if (_check_info_valid.size() > _move_history.size()) {
+        _check_info_valid[_move_history.size()] = 0;
+    }
+}
+
+void Board::unmake_null_move() {
+    const auto move_data = _move_history.back();
+    _move_history.pop_back();
+    _ep_square = move_data.ep_square;
+    _halfmove_clock = move_data.halfmove_clock;
+    _fullmove_counter = move_data.fullmove_counter;
+    _hash = move_data.hash;
+    _to_move = (_to_move == 'w') ? 'b' : 'w';
+}
+
+int Board::detect_game_end(const bool verbose) {
+    if (legal_moves().empty()) {
         if (is_in_check()) {
             if (verbose) {
-                printf("Checkmate. %s wins", _to_move == 'b' ? "White" : "Black");
+                printf("Checkmate. %s wins\n", _to_move == 'b' ? "White" : "Black");
             }
-            return 1;
+            return kGameCheckmate;
         } else {
             if (verbose) {
-                printf("Stalemate");
+                printf("Stalemate\n");
             }
-            return 2;
+            return kGameStalemate;
         }
     }
-    return 0;
+    if (is_repetition(2)) {
+        if (verbose) {
+            printf("Draw by threefold repetition\n");
+        }
+        return kGameThreefold;
+    }
+    if (_halfmove_clock >= 100) {
+        if (verbose) {
+            printf("Draw by fifty-move rule\n");
+        }
+        return kGameFiftyMove;
+    }
+    if (insufficient_material()) {
+        if (verbose) {
+            printf("Draw by insufficient material\n");
+        }
+        return kGameInsufficientMaterial;
+    }
+    return kGameOngoing;
 }
 
-int Board::detect_game_end() const {
+int Board::detect_game_end() {
     return detect_game_end(false);
 }
 
+/**
+ * @brief Checks whether the current position occurred before. Only the reversible
+ * part of the history (since the last capture or pawn move) is scanned, and only
+ * positions with the same player to move, so it is a few hash compares per call.
+ *
+ * @param required number of earlier occurrences needed (2 for threefold repetition)
+ */
+bool Board::is_repetition(const int required) const {
+    const int history_size = _move_history.size();
+    const int oldest = std::max(history_size - _halfmove_clock, 0);
+    int found = 0;
+    for (int i = history_size - 2; i >= oldest; i -= 2) {
+        if (_move_history[i].hash == _hash && ++found >= required) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Detects dead positions: K v K, K+minor v K, and K+B v K+B with bishops on
+ * squares of the same colour.
+ */
+bool Board::insufficient_material() const {
+    const size_t total = _white_pieces.size() + _black_pieces.size();
+    if (total > 4) {
+        return false;
+    }
+    int bishop_sq_colours = 0;
+    int bishops = 0;
+    int minors = 0;
+    for (const auto& p_set : { &_white_pieces, &_black_pieces }) {
+        for (const auto sq_num : *p_set) {
+            const char piece = _chessboard[sq_num].piece();
+            if (piece == 'p' || piece == 'r' || piece == 'q') {
+                return false;
+            } else if (piece == 'b') {
+                ++bishops;
+                bishop_sq_colours += ((sq_num / 8 + sq_num % 8) & 1);
+                ++minors;
+            } else if (piece == 'n') {
+                ++minors;
+            }
+        }
+    }
+    if (minors <= 1) {
+        return true;
+    }
+    // two minors left: only opposing bishops on the same square colour are a dead draw
+    return bishops == 2 && _white_pieces.size() == 2 && (bishop_sq_colours == 0 || bishop_sq_colours == 2);
+}
+
+/**
+ * @brief Draw by rule, as seen by search: twofold repetition, fifty-move rule or
+ * insufficient material. Mate and stalemate must be checked by the caller first.
+ */
+bool Board::is_draw() const {
+    return _halfmove_clock >= 100 || is_repetition(1) || insufficient_material();
+}
+
+void Board::add_perft_progress(const int64_t nodes) {
+    _perft_progress_pending += nodes;
+    if (++_perft_progress_batches == kPerftProgressBatches) {
+        flush_perft_progress();
+    }
+}
+
+void Board::flush_perft_progress() {
+    if (_perft_progress_pending) {
+        _perft_progress->fetch_add(_perft_progress_pending, std::memory_order_relaxed);
+    }
+    _perft_progress_pending = 0;
+    _perft_progress_batches = 0;
+}
+
 int64_t Board::perft(const int depth) {
     const char promotion_targets[4] {'q', 'r', 'b', 'n'};
 
@@ -363,25 +698,37 @@ int64_t Board::perft(const int depth) {
         return -1;
     }
     if (depth == 0) {
+        STATS_INC(kNodes);
+        if (_perft_progress) {
+            add_perft_progress(1);
+        }
         return 1;
     }
     if (depth == 1) {
-        int64_t counter = 0;
-        for (const auto [move_from, move_to] : _legal_moves) {
-            const auto& from_sq = _chessboard[move_from];
-            const char from_colour = from_sq.colour();
-            const int move_rank = move_from / 8;
-            if (from_sq.piece() == 'p' && ((move_rank == 6 && from_colour == 'w') || (move_rank == 1 && from_colour == 'b'))) {
-                counter += 3;
-            }
-            counter += 1;
+        const int64_t counter = count_legal_moves();
+        STATS_ADD(kNodes, counter);
+        if (_perft_progress) {
+            add_perft_progress(counter);
         }
         return counter;
     }
 
     int64_t leaf_nodes = 0;
-    std::vector<std::pair<int, int>> legals { _legal_moves };
-    for (const auto [move_from, move_to] : legals) {
+    if (_perft_table) {
+        STATS_INC(kPerftHashProbes);
+        if (_perft_table->probe(_hash, depth, leaf_nodes)) {
+            STATS_INC(kPerftHashHits);
+            if (_perft_progress) {
+                add_perft_progress(leaf_nodes);
+            }
+            return leaf_nodes;
+        }
+    }
+    const auto& legals = legal_moves();
+    for (const auto& [move_from, move_to] : legals) {
+        if (_stop && _stop->load(std::memory_order_relaxed)) {
+            break;
+        }
         if (_chessboard[move_from].piece() == 'p' && (move_to / 8 == 0 || move_to / 8 == 7)) {
             for (const auto promote_to : promotion_targets) {
                 make_move(move_from, move_to, promote_to, true);
@@ -394,10 +741,28 @@ int64_t Board::perft(const int depth) {
             unmake_move();
         }
     }
+    // a stopped count is partial
+    if (_perft_table && !(_stop && _stop->load(std::memory_order_relaxed))) {
+        _perft_table->store(_hash, depth, leaf_nodes);
+    }
 
     return leaf_nodes;
 }
 
+/**
+ * @brief Sets the size of the perft hash table, 0 disables it.
+ */
+void Board::set_perft_hash(const size_t megabytes) {
+    _perft_table.reset();
+    if (megabytes > 0) {
+        _perft_table = std::make_shared<PerftTable>(megabytes);
+        if (_perft_table->size() == 0) {
+            LOG_ERROR("Cannot allocate a %lu MB perft hash", megabytes);
+            _perft_table.reset();
+        }
+    }
+}
+
 std::string Board::get_move_str(const int move_from, const int move_to) const {
     std::string s = num_to_alg(move_from) + num_to_alg(move_to);
     return s;
@@ -409,38 +774,74 @@ std::string Board::get_move_str(const int move_from, const int move_to, const ch
     return s;
 }
 
-std::map<std::string, int64_t> Board::divide(const int depth) {
+/**
+ * @brief Perft (or divide) split at the root for a background job: perft feeds
+ * the job's live node count as it goes, completed root moves are published after
+ * each subtree and a stop request ends the run with the root moves completed so far.
+ */
+void Board::perft_roots(const int depth, const bool divide_mode, BackgroundJob& job) {
     const char promotion_targets[4] {'q', 'r', 'b', 'n'};
-    std::map<std::string, int64_t> leaf_nodes_dict;
-    if (depth < 2) {
-        perft(depth);
-    } else {
-        std::vector<std::pair<int, int>> legals { _legal_moves };
-        for (const auto [move_from, move_to] : legals) {
-            if (_chessboard[move_from].piece() == 'p' && (move_to / 8 == 0 || move_to / 8 == 7)) {
-                for (const auto promote_to : promotion_targets) {
-                    make_move(move_from, move_to, promote_to, true);
-                    leaf_nodes_dict[get_move_str(move_from, move_to, promote_to)] = perft(depth-1);
-                    unmake_move();
-                }
-            } else {
-                make_move(move_from, move_to, 'q', true);
-                leaf_nodes_dict[get_move_str(move_from, move_to)] = perft(depth-1);
-                unmake_move();
+    STATS_TIMER(kTimerPerft);
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    std::vector<std::tuple<int, int, char>> root_moves;
+    for (const auto& [move_from, move_to] : legal_moves()) {
+        if (_chessboard[move_from].piece() == 'p' && (move_to / 8 == 0 || move_to / 8 == 7)) {
+            for (const auto promote_to : promotion_targets) {
+                root_moves.emplace_back(move_from, move_to, promote_to);
             }
+        } else {
+            root_moves.emplace_back(move_from, move_to, 0);
+        }
+    }
+    job.set_total(root_moves.size());
+
+    _stop = &job.stop_flag();
+    _perft_progress = &job.node_counter();
+    std::map<std::string, int64_t> leaf_nodes_dict;
+    int64_t nodes = 0;
+    for (const auto& [move_from, move_to, promote_to] : root_moves) {
+        make_move(move_from, move_to, promote_to ? promote_to : 'q', true);
+        const int64_t count = perft(depth-1);
+        unmake_move();
+        flush_perft_progress();
+        // a subtree cut short by the stop request is left out
+        if (job.stop_requested()) {
+            break;
+        }
+        nodes += count;
+        leaf_nodes_dict[promote_to ? get_move_str(move_from, move_to, promote_to) : get_move_str(move_from, move_to)] = count;
+        job.root_move_done(count);
+    }
+    _stop = nullptr;
+    _perft_progress = nullptr;
+
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    printf("\n");
+    if (divide_mode) {
+        for (const auto& [move, count] : leaf_nodes_dict) {
+            printf("%s: %ld\n", move.c_str(), count);
         }
     }
-    return leaf_nodes_dict;
+    if (leaf_nodes_dict.size() < root_moves.size()) {
+        printf("Stopped after %lu/%lu root moves, partial ", leaf_nodes_dict.size(), root_moves.size());
+    }
+    printf("Nodes: %ld \tTime: %.2lf ms\n", nodes, t_tm.count());
+    fflush(stdout);
 }
 
 void Board::interactive_mode() {
+    BackgroundJob job;
+    Mcts::Tree mcts_tree;
+    search_options_t search_options;
     std::cout << kCrudechessWelcomeString << std::endl;
     bool active = true;
     std::string input, cmd, args;
     size_t sep_pos;
     while (active) {
         std::cout << "> ";
-        std::getline(std::cin, input);
+        if (!std::getline(std::cin, input)) {
+            break;
+        }
         sep_pos = input.find(' ');
         cmd = input.substr(0, sep_pos);
         if (sep_pos == std::string::npos) {
@@ -469,8 +870,8 @@ void Board::interactive_mode() {
                 if (sep_pos == std::string::npos) {
                     std::string finit = FEN_INIT;
                     set_fen(finit);
-                } else {
-                    set_fen(args);
+                } else if (!set_fen(args)) {
+                    printf("Invalid FEN or illegal position\n");
                 }
             }
         }
@@ -478,7 +879,7 @@ void Board::interactive_mode() {
             if (args.size()) {
                 show_legal_moves(alg_to_num(args));
             } else {
-                for (const auto& [from_move, to_move] : _legal_moves) {
+                for (const auto& [from_move, to_move] : legal_moves()) {
                     printf("%s%s, ", num_to_alg(from_move).c_str(), num_to_alg(to_move).c_str());
                 }
                 printf("\n");
@@ -487,6 +888,14 @@ void Board::interactive_mode() {
         else if (cmd=="s" || cmd=="spp" || cmd=="pieces") {
             show_piece_positions(args[0]);
         }
+        else if ((cmd=="m" || cmd=="mv" || cmd=="move") && args.find(' ') == std::string::npos) {
+            Pgn::move_t move;
+            if (san_to_move(args, move)) {
+                make_move(move.from_num, move.to_num, move.promote_to);
+            } else {
+                std::cout << "Illegal or ambiguous move\n";
+            }
+        }
         else if (cmd=="m" || cmd=="mv" || cmd=="move") {
             const int from_num = alg_to_num(args.substr(0, 2));
             const int to_num = alg_to_num(args.substr(3, 2));
@@ -496,23 +905,130 @@ void Board::interactive_mode() {
         else if (cmd=="u" || cmd=="um" || cmd=="undo" || cmd=="unmove") {
             unmake_move();
         }
-        else if (cmd=="p" || cmd=="perft") {
-            auto s_tm = std::chrono::high_resolution_clock::now();
-            const int nodes = this->perft(std::stoi(args));
-            auto e_tm = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> t_tm = e_tm-s_tm;
-            std::cout << "Nodes: " << nodes << " \tTime: " << t_tm.count();
-            std::cout << " ms" << std::endl;
+        else if (cmd=="p" || cmd=="perft" || cmd=="d" || cmd=="divide") {
+            const int depth = std::stoi(args);
+            const bool divide_mode = (cmd=="d" || cmd=="divide");
+            if (depth < 1) {
+                std::cout << "Nodes: " << perft(depth) << std::endl;
+            } else if (!job.start(divide_mode ? "divide" : "perft", [board = *this, depth, divide_mode](BackgroundJob& bg_job) mutable {
+                           board.perft_roots(depth, divide_mode, bg_job);
+                       })) {
+                std::cout << "A job is running, `stop' it first" << std::endl;
+            }
         }
-        else if (cmd=="d" || cmd=="divide") {
-            auto s_tm = std::chrono::high_resolution_clock::now();
-            const auto nodes_dict = divide(std::stoi(args));
-            auto e_tm = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> t_tm = e_tm-s_tm;
-            for (const auto& [move, count] : nodes_dict) {
-                printf("%s: %ld\n", move.c_str(), count);
+        else if (cmd=="stop") {
+            if (job.running()) {
+                job.stop();
+            } else {
+                std::cout << "No job running" << std::endl;
+            }
+        }
+        else if (cmd=="status") {
+            job.print_status();
+        }
+        else if (cmd=="hash") {
+            set_perft_hash(std::strtoull(args.c_str(), nullptr, 10));
+            if (_perft_table) {
+                printf("Perft hash: %lu buckets\n", _perft_table->size());
+            } else {
+                printf("Perft hash off\n");
             }
-            std::cout << "Time: " << t_tm.count() << " ms" << std::endl;
+        }
+        else if (cmd=="e" || cmd=="eval") {
+            const uint64_t probes = _pawn_table.probes();
+            const uint64_t hits = _pawn_table.hits();
+            printf("Eval: %d cp (relative to %s)\n", evaluate(), _to_move == 'w' ? "white" : "black");
+            if (NNUE::loaded()) {
+                printf("Classical: %d cp (NNUE %s)\n", evaluate_classical(), NNUE::simd_name());
+            }
+            printf("Pawn hash: %s\n", _pawn_table.hits() > hits ? "hit" : (_pawn_table.probes() > probes ? "miss" : "-"));
+        }
+        else if (cmd=="n" || cmd=="nnue") {
+            if (args == "off") {
+                NNUE::unload();
+            } else if (args.substr(0, 4) == "pst ") {
+                if (NNUE::save(args.substr(4), NNUE::pst_network())) {
+                    printf("Wrote %s\n", args.substr(4).c_str());
+                }
+            } else if (NNUE::load(args)) {
+                printf("NNUE: %d hidden units, %s\n", NNUE::network().hidden, NNUE::simd_name());
+            }
+        }
+        else if (cmd=="san") {
+            const auto& legals = legal_moves();
+            for (const auto& [from_num, to_num] : legals) {
+                const bool promotion = _chessboard[from_num].piece() == 'p' && (to_num / 8 == 0 || to_num / 8 == 7);
+                for (const char promote_to : { 'q', 'r', 'b', 'n' }) {
+                    printf("%s ", move_to_san(from_num, to_num, promote_to).c_str());
+                    if (!promotion) {
+                        break;
+                    }
+                }
+            }
+            printf("\n");
+        }
+        else if (cmd=="stats") {
+            if (args == "reset") {
+                Stats::reset();
+            } else {
+                Stats::print();
+            }
+        }
+        else if (cmd=="mcts") {
+            Mcts::config_t config;
+            std::istringstream in(args);
+            in >> config.time_ms >> config.threads;
+            config.time_ms = (config.time_ms > 0) ? config.time_ms : 1000.0;
+            config.threads = std::max(config.threads, 1);
+            const auto result = mcts_search(mcts_tree, config);
+            const std::string move = (result.from_num == -1) ? "(none)" : move_to_san(result.from_num, result.to_num, result.promote_to);
+            Mcts::print_result(result, move, config.threads);
+        }
+        else if (cmd=="mate") {
+            Mate::config_t config;
+            config.max_moves = std::max(std::atoi(args.c_str()), 1);
+            config.checks_only = (args.find("checks") != std::string::npos);
+            Mate::Table table;
+            const auto result = solve_mate(config, table);
+            if (result.status == Mate::kProven) {
+                printf("Mate in %d:", result.moves);
+                for (const auto& san : result.line) {
+                    printf(" %s", san.c_str());
+                }
+                printf("\n");
+            } else {
+                printf("%s\n", result.status == Mate::kDisproven ? "No mate found" : "Node limit reached");
+            }
+            printf("Nodes: %lu \tTime: %.2lf ms\n", result.nodes, result.time_ms);
+        }
+        else if (cmd=="t" || cmd=="tb") {
+            if (args.size()) {
+                printf("Loaded %d tables\n", Tablebase::load_directory(args));
+            } else {
+                show_tablebase_moves();
+            }
+        }
+        else if (cmd=="book") {
+            if (args.empty()) {
+                show_book_moves();
+            } else if (args == "off") {
+                Polyglot::close_book();
+            } else if (Polyglot::open_book(args)) {
+                printf("Book: %lu entries\n", Polyglot::book_entries());
+            }
+        }
+        else if (cmd=="g" || cmd=="go" || cmd=="search") {
+            search_limits_t limits;
+            limits.depth = args.size() ? std::stoi(args) : 4;
+            limits.options = search_options;
+            search(limits, true);
+        }
+        else if (cmd=="option") {
+            const size_t sep = args.find(' ');
+            if (!args.empty() && (sep == std::string::npos || !search_options.set(args.substr(0, sep), args.substr(sep+1) == "on"))) {
+                printf("Usage: option <null|lmr|futility|rfp|checkext> <on|off>\n");
+            }
+            printf("Search options: %s\n", search_options.str().c_str());
         }
         else {
             std::cout << "Unknown command: `" << cmd << "'" << std::endl;
@@ -676,85 +1192,3 @@ void Board::update_piece_sets_internal(const char colour, const int sq_from, con
         p_set.erase(sq_from);
     }
 }
-
-void load_and_run_tests(const std::string& test_file_path, const int max_depth) {
-    Board b;
-    std::ifstream file;
-    file.open(test_file_path);
-    std::string line;
-    printf("Testing at depth %d\n", max_depth);
-    printf("No.      FEN                               Result    Passed    Delta      Time\n");
-    printf("-----    ------------------------------    ------    ------    -------    ---------\n");
-    int fail = 0;
-    int pass = 0;
-    int test_no = 0;
-    bool failed = false;
-    int64_t result = 0;
-    int64_t expected = 0;
-    const auto start_time = std::chrono::high_resolution_clock::now();
-    std::chrono::system_clock::time_point s_tm, e_tm;
-    std::chrono::duration<double, std::milli> t_tm;
-    while (std::getline(file, line)) {
-        std::stringstream linestream(line);
-        std::string field;
-        int i = 0;
-        failed = false;
-        while (std::getline(linestream, field, ',')) {
-            if (field[0] == '#') {
-                break;
-            }
-            if (i == 0) {
-                s_tm = std::chrono::high_resolution_clock::now();
-                b.set_fen(field);
-                std::string fen_output_string = "";
-                if (field.size() > 30) {
-                    fen_output_string = field.substr(0, 12) + "[...]" + field.substr(field.size()-13);
-                } else {
-                    fen_output_string = field;
-                }
-                printf("%5d    %-30s    ", ++test_no, fen_output_string.c_str());
-            } else {
-                result = b.perft(i);
-                expected = std::stoi(field);
-                if (result == expected) {
-                    printf(".");
-                    fflush(stdout);
-                } else {
-                    failed = true;
-                    printf("F");
-                }
-            }
-            if (failed || i == max_depth) {
-                e_tm = std::chrono::high_resolution_clock::now();
-                t_tm = e_tm-s_tm;
-                const std::string padding(6-i, ' ');
-                const std::string delta_str = ((result > expected) ? "+" : "") + std::to_string(result-expected);
-                printf("%s    %d/%d       %-7s    %.2lf ms\n", padding.c_str(), failed ? i-1 : i, max_depth, delta_str.c_str(), t_tm.count());
-                if (failed) {
-                    ++fail;
-                    // printf("[ FAIL ] Test %d at depth %d - expected %d, got %d (delta: %s%d)\n", test_no, i, expected, result, result-expected>0 ? "+" : "", result-expected);
-                } else {
-                    ++pass;
-                }
-                break;
-            }
-            ++i;
-        }
-    }
-    e_tm = std::chrono::high_resolution_clock::now();
-    t_tm = e_tm-start_time;
-    printf("\n%d/%d tests passed (time: %.2lf ms)\n", pass, test_no, t_tm.count());
-    file.close();
-}
-
-#ifndef GTEST_UT
-int main(int argc, char* argv[]) {
-    if (argc > 2) {
-        load_and_run_tests(argv[1], atoi(argv[2]));
-    } else {
-        Board board;
-        board.interactive_mode();
-    }
-    return 0;
-}
-#endif
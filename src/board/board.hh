@@ -2,7 +2,12 @@
 
 #include <string>
 
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <unordered_set>
 #include <vector>
@@ -10,6 +15,22 @@
 #include "log.hh"
 
 #include "board_types.hh"
+#include "eval.hh"
+#include "mate.hh"
+#include "mcts.hh"
+#include "nnue.hh"
+#include "packed.hh"
+#include "pawn_hash.hh"
+#include "perft_table.hh"
+#include "pgn.hh"
+#include "planes.hh"
+#include "service.hh"
+#include "tablebase.hh"
+#include "tune.hh"
+#include "uperft.hh"
+#include "zobrist.hh"
+
+class BackgroundJob;
 
 #define FEN_INIT "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
 
@@ -24,7 +45,92 @@ struct move_record_t {
     int ep_square;
     int halfmove_clock;
     int fullmove_counter;
-    std::vector<std::pair<int, int>> moves_cache;
+    Zobrist::key_t hash;
+    Zobrist::key_t pawn_hash;
+};
+
+
+// Squares from which each piece type of the side to move would check the enemy
+// king (one bit per square), and its pieces whose move off their line to that
+// king discovers a check by a slider behind them
+struct check_info_t {
+    enum piece_index_t { kPawn = 0, kKnight, kBishop, kRook, kQueen, kKing, kPieceCount };
+
+    uint64_t check_squares[kPieceCount];    // kKing stays empty
+    uint64_t discoverers;
+    int king_sq;
+
+    static int index(const char piece) {
+        switch (piece) {
+            case 'p': return kPawn;
+            case 'n': return kKnight;
+            case 'b': return kBishop;
+            case 'r': return kRook;
+            case 'q': return kQueen;
+            default: return kKing;
+        }
+    }
+};
+
+
+struct scored_move_t {
+    int from_num;
+    int to_num;
+    char promote_to;
+    int score;
+};
+
+
+struct search_result_t {
+    int from_num;
+    int to_num;
+    char promote_to;
+    int score;
+    int depth;
+};
+
+
+// selective search features, all on by default; each can be switched off to
+// measure what it brings in time to depth and strength
+struct search_options_t {
+    bool null_move = true;          // adaptive null-move pruning
+    bool lmr = true;                // late move reductions
+    bool futility = true;           // futility pruning of quiet moves near the leaves
+    bool reverse_futility = true;   // static eval far above beta cuts near the leaves
+    bool check_extensions = true;
+
+    // names: null, lmr, futility, rfp, checkext; false for an unknown name
+    bool set(const std::string& name, const bool value);
+    std::string str() const;
+};
+
+
+// search stops at whichever limit comes first; 0 means no node or time limit
+struct search_limits_t {
+    static constexpr int kMaxDepth { 64 };
+
+    int depth = kMaxDepth;
+    uint64_t nodes = 0;
+    double time_ms = 0.0;
+    search_options_t options;
+    // called after every completed iteration with the elapsed time
+    std::function<void(const search_result_t&, const double)> on_iteration;
+};
+
+
+struct search_stats_t {
+    uint64_t nodes = 0;
+    uint64_t qnodes = 0;
+    uint64_t pawn_probes = 0;
+    uint64_t pawn_hits = 0;
+    uint64_t tb_hits = 0;
+    uint64_t null_cutoffs = 0;
+    uint64_t rfp_cutoffs = 0;
+    uint64_t futility_prunes = 0;
+    uint64_t reductions = 0;
+    uint64_t re_searches = 0;
+    uint64_t extensions = 0;
+    double time_ms = 0.0;
 };
 
 
@@ -58,18 +164,56 @@ public:
         _black_pieces.reserve(16);
 
         _pseudolegal_move_targets.reserve(27);
-        _legal_moves.reserve(218);
         setup();
     }
 
-    void set_fen(const std::string& fen);
+    bool set_fen(const std::string& fen);
+    bool position_legal() const;
     int64_t perft(const int depth);
+    void set_perft_hash(const size_t megabytes);
     void print(std::set<int>& highlit_squares) const;
     void print() const {
         std::set<int> hsq;
         print(hsq);
     }
     void interactive_mode();
+    int evaluate();
+    search_result_t search(const int depth, const bool verbose);
+    search_result_t search(const search_limits_t& limits, const bool verbose);
+    Zobrist::key_t hash() const { return _hash; }
+    Zobrist::key_t pawn_hash() const { return _pawn_hash; }
+
+    void set_pieces(const std::vector<piece_placement_t>& pieces, const char to_move);
+    std::vector<piece_placement_t> get_pieces() const;
+    const std::vector<std::pair<int, int>>& legal_moves() {
+        const size_t ply = _move_history.size();
+        if (ply >= _legal_moves_valid.size() || !_legal_moves_valid[ply]) {
+            get_legal_moves();
+        }
+        return _legal_moves_stack[ply];
+    }
+    char to_move() const { return _to_move; }
+    bool is_in_check() const;
+    const check_info_t& check_info();
+    bool gives_check(const int from_num, const int to_num, const char promote_to);
+    Tablebase::tb_result_t probe_tablebase() const;
+    uint64_t polyglot_key() const;
+    bool book_move(search_result_t& result);
+    std::string service_response(const Service::request_t& request);
+    bool play_move(const int from_num, const int to_num, const char promote_to);
+    bool undo_move();
+    bool san_to_move(std::string_view san, Pgn::move_t& move);
+    std::string move_to_san(const int from_num, const int to_num, const char promote_to);
+    void canonical_moves(std::vector<Pgn::move_t>& moves);
+    int game_end() { return detect_game_end(false); }
+    const search_stats_t& search_stats() const { return _search_stats; }
+    Mate::result_t solve_mate(const Mate::config_t& config, Mate::Table& table);
+    void uperft_children(std::vector<UPerft::record_t>& children);
+    Mcts::result_t mcts_search(Mcts::Tree& tree, const Mcts::config_t& config);
+    int eval_features(std::vector<Tune::feature_t>& features);
+    bool encode_packed(Packed::packed_position_t& pos) const;
+    bool decode_packed(const Packed::packed_position_t& pos);
+    void encode_planes(Planes::bitboards_t& planes) const;
 
 private:
     Square _chessboard[64];
@@ -83,9 +227,39 @@ private:
     std::vector<move_record_t> _move_history;
     int _w_king_sq = -1;
     int _b_king_sq = -1;
+    Zobrist::key_t _hash = 0;
+    Zobrist::key_t _pawn_hash = 0;
 
     std::vector<int> _pseudolegal_move_targets;
-    std::vector<std::pair<int, int>> _legal_moves;
+    // legal move lists, generated on demand, one per ply of _move_history: the list
+    // of a position stays valid while moves are made and unmade from it
+    std::deque<std::vector<std::pair<int, int>>> _legal_moves_stack;
+    std::vector<uint8_t> _legal_moves_valid;
+    // check info, computed on demand like the legal move lists
+    std::vector<check_info_t> _check_info_stack;
+    std::vector<uint8_t> _check_info_valid;
+
+    // set while a background job runs on this board, polled by perft
+    const std::atomic<bool>* _stop = nullptr;
+    // the job's live node count; perft adds its leaf nodes every kPerftProgressBatches
+    // leaf batches (depth 1 counts, hash hits) rather than once per root move
+    static constexpr uint32_t kPerftProgressBatches { 1024 };
+    std::atomic<uint64_t>* _perft_progress = nullptr;
+    uint64_t _perft_progress_pending = 0;
+    uint32_t _perft_progress_batches = 0;
+
+    PawnHashTable _pawn_table;
+    // shared by copies of the board (background jobs), nullptr when disabled
+    std::shared_ptr<PerftTable> _perft_table;
+    search_stats_t _search_stats;
+    search_limits_t _search_limits;
+    std::chrono::steady_clock::time_point _search_start;
+    bool _search_aborted = false;
+
+    // NNUE accumulators, two (white, black perspective) per ply of _move_history
+    std::vector<int16_t> _nnue_acc;
+    std::vector<uint8_t> _nnue_computed;
+    int _nnue_generation = -1;
 
 
     // board_t         chessboard;
@@ -104,7 +278,7 @@ private:
     // piece_id_t      black_king_id;
 
 private:
-    bool position_legal() const;
+    bool king_attacked(const char k_colour) const;
     std::string get_move_str(const int move_from, const int move_to, const char promote_to) const;
     std::string get_move_str(const int move_from, const int move_to) const;
     void clear_board();
@@ -112,19 +286,61 @@ private:
     int alg_to_num(const std::string& coords_str) const;
     std::string num_to_alg(const int sq_num) const;
     void get_pseudolegal_moves_from_sq(const int sq_num);
-    bool is_in_check() const;
-    void show_legal_moves(const int sq_num) const;
+    void show_legal_moves(const int sq_num);
     void show_piece_positions(const char colour) const;
     void get_legal_moves();
+    int count_legal_moves();
+    Zobrist::key_t compute_hash(const bool pawns_only) const;
+    Zobrist::key_t ep_hash() const;
+    bool ep_capture_legal();
 
     void make_move(const int from_num, const int to_num, const char promote_to, const bool perft_mode);
     void make_move(const int from_num, const int to_num, const char promote_to);
     void unmake_move();
+    void make_null_move();
+    void unmake_null_move();
+
+    int detect_game_end(const bool verbose);
+    int detect_game_end();
+    bool is_repetition(const int required) const;
+    bool insufficient_material() const;
+    bool is_draw() const;
+
+    void perft_roots(const int depth, const bool divide_mode, BackgroundJob& job);
+    void add_perft_progress(const int64_t nodes);
+    void flush_perft_progress();
+
+    void count_pawn_terms(Eval::pawn_terms_t& terms, uint8_t shelter_rank[2][8]) const;
+    const pawn_entry_t& probe_pawn_structure();
+    void count_shelter_terms(const pawn_entry_t& entry, const char colour, Eval::shelter_terms_t& terms) const;
+    int king_shelter(const pawn_entry_t& entry, const char colour) const;
+    int evaluate_classical();
+
+    int16_t* nnue_accumulator(const int ply, const int perspective);
+    void nnue_refresh(const int ply, const int perspective);
+    void nnue_update_internal(const char from_colour, const char from_piece, const int from_num, const int to_num,
+                              const char placed_piece, const char to_piece, const char move_type);
+    void nnue_null_move_internal();
+    int evaluate_nnue();
+
+    void generate_search_moves(std::vector<scored_move_t>& moves, const bool captures_only);
+    bool search_aborted();
+    bool has_non_pawn_material(const char colour) const;
+    int alpha_beta(const int depth, int alpha, const int beta, const int ply);
+    int quiescence(int alpha, const int beta, const int ply);
+    std::string search_move_str(const search_result_t& result) const;
+    void print_search_stats() const;
+
+    void mate_children(Mate::search_t& search, const bool or_node, const int moves_left, std::vector<Mate::child_t>& children);
+    void mate_mid(Mate::search_t& search, const bool or_node, const int moves_left, const uint32_t th_pn,
+                  const uint32_t th_dn, uint32_t& pn, uint32_t& dn);
 
-    int detect_game_end(const bool verbose) const;
-    int detect_game_end() const;
+    bool mcts_expand(Mcts::node_t* node, Mcts::Tree& tree, Mcts::Arena::cursor_t& cursor, const bool root, double& value);
+    bool mcts_playout(Mcts::Tree& tree, const double cpuct, Mcts::Arena::cursor_t& cursor, std::vector<Mcts::node_t*>& path);
 
-    std::map<std::string, int64_t> divide(const int depth);
+    void show_tablebase_moves();
+    bool book_entry_move(const uint16_t move, search_result_t& result);
+    void show_book_moves();
 
     void add_piece_internal(const char colour, const char piece, const int sq_num);
     std::pair<int, char> move_piece_internal(const int from_num, int to_num, const char promote_to = 'q', const bool update_lists = false);
@@ -145,9 +361,26 @@ static constexpr auto kCrudechessHelpString {
 "    l             - print all legal moves from current position\n"
 "    l <square>    - show legal moves from given square on board\n"
 "    m <from> <to> - move a piece (move must be legal)\n"
+"    m <san>       - make a move given in SAN, e.g. Nf3\n"
+"    san           - print all legal moves in SAN\n"
 "    u             - unmake last move\n"
-"    p <depth>     - run perft from current position \n"
-"    d <depth>     - run divide from current position \n"
+"    p <depth>     - run perft from current position (in the background)\n"
+"    d <depth>     - run divide from current position (in the background)\n"
+"    status        - show progress of the background job\n"
+"    stop          - stop the background job, printing partial results\n"
+"    hash <MB>     - set the size of the perft hash table, `hash 0' disables it\n"
+"    e             - evaluate current position\n"
+"    n <file>      - load NNUE network used by evaluation, `n off' to unload\n"
+"    n pst <file>  - write a test network built from the piece-square tables\n"
+"    g <depth>     - search current position to given depth\n"
+"    option        - show search options, `option <name> on|off' to switch one (null, lmr, futility, rfp, checkext)\n"
+"    mcts <ms> [threads] - Monte Carlo tree search for given time, the tree is reused after moves\n"
+"    mate <n>      - look for a mate in at most n moves, `mate <n> checks' tries checking moves only\n"
+"    t             - probe endgame tablebases for current position and its moves\n"
+"    t <dir>       - load endgame tablebases from directory\n"
+"    book          - show Polyglot book moves for current position\n"
+"    book <file>   - open Polyglot book (used before searching), `book off' to close\n"
+"    stats         - show performance counters, `stats reset' to clear them\n"
 "    c             - debug: is player to move in check\n"
 "    s <b|w>       - debug: show piece positions"
 };
@@ -32,6 +32,21 @@ enum piece_type_t {
     kPieceQueen  = 0b01110
 };
 
+enum game_end_t {
+    kGameOngoing = 0,
+    kGameCheckmate,
+    kGameStalemate,
+    kGameThreefold,
+    kGameFiftyMove,
+    kGameInsufficientMaterial
+};
+
+struct piece_placement_t {
+    char colour;
+    char piece;
+    int sq_num;
+};
+
 using square_val_t = uint8_t;
 static constexpr square_val_t kSquareWhitePieceBit { 0b10000 };
 static constexpr square_val_t kSquareRayPieceBit { 0b01000 };
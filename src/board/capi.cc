@@ -0,0 +1,123 @@
+#include <new>
+
+#include "board.hh"
+#include "crudechess.h"
+#include "fen.hh"
+#include "strfuns.hh"
+
+
+struct crudechess_board {
+    Board board;
+};
+
+
+namespace {
+    // maps whatever the library throws to an error code at the C boundary
+    template<typename F>
+    auto guarded(F&& body) -> decltype(body()) {
+        try {
+            return body();
+        } catch (const std::bad_alloc&) {
+            return CRUDECHESS_ENOMEM;
+        } catch (...) {
+            return CRUDECHESS_EINVAL;
+        }
+    }
+}
+
+
+int crudechess_api_version(void) {
+    return CRUDECHESS_API_VERSION;
+}
+
+crudechess_board_t* crudechess_board_create(void) {
+    try {
+        return new crudechess_board;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void crudechess_board_destroy(crudechess_board_t* board) {
+    delete board;
+}
+
+int crudechess_set_fen(crudechess_board_t* board, const char* fen) {
+    if (!board || !fen) {
+        return CRUDECHESS_EINVAL;
+    }
+    return guarded([&] {
+        const std::string fen_stripped = Strfuns::strip_copy(fen);
+        if (!Fen::fen_valid(fen_stripped) || !board->board.set_fen(fen_stripped)) {
+            board->board.set_fen(Fen::kFenInitial);
+            return CRUDECHESS_EINVAL;
+        }
+        return CRUDECHESS_OK;
+    });
+}
+
+char crudechess_to_move(const crudechess_board_t* board) {
+    try {
+        return board ? board->board.to_move() : 0;
+    } catch (...) {
+        return 0;
+    }
+}
+
+int crudechess_legal_moves(crudechess_board_t* board, crudechess_move_t* moves, size_t capacity) {
+    if (!board || (!moves && capacity)) {
+        return CRUDECHESS_EINVAL;
+    }
+    return guarded([&] {
+        const auto pieces = board->board.get_pieces();
+        char piece_on[64] {};
+        for (const auto& p : pieces) {
+            piece_on[p.sq_num] = p.piece;
+        }
+        size_t count = 0;
+        for (const auto& [from_num, to_num] : board->board.legal_moves()) {
+            const bool promotion = piece_on[from_num] == 'p' && (to_num / 8 == 0 || to_num / 8 == 7);
+            for (const char promote_to : { 'q', 'r', 'b', 'n' }) {
+                if (count < capacity) {
+                    moves[count] = { static_cast<uint8_t>(from_num), static_cast<uint8_t>(to_num), promotion ? promote_to : '\0' };
+                }
+                ++count;
+                if (!promotion) {
+                    break;
+                }
+            }
+        }
+        return static_cast<int>(count);
+    });
+}
+
+int crudechess_make_move(crudechess_board_t* board, crudechess_move_t move) {
+    if (!board || move.from > 63 || move.to > 63) {
+        return CRUDECHESS_EINVAL;
+    }
+    const char promote_to = move.promote_to ? move.promote_to : 'q';
+    if (promote_to != 'q' && promote_to != 'r' && promote_to != 'b' && promote_to != 'n') {
+        return CRUDECHESS_EINVAL;
+    }
+    return guarded([&] {
+        return board->board.play_move(move.from, move.to, promote_to) ? CRUDECHESS_OK : CRUDECHESS_EILLEGAL;
+    });
+}
+
+int crudechess_unmake_move(crudechess_board_t* board) {
+    if (!board) {
+        return CRUDECHESS_EINVAL;
+    }
+    return guarded([&] {
+        return board->board.undo_move() ? CRUDECHESS_OK : CRUDECHESS_EEMPTY;
+    });
+}
+
+int64_t crudechess_perft(crudechess_board_t* board, int depth) {
+    if (!board || depth < 0) {
+        return CRUDECHESS_EINVAL;
+    }
+    return guarded([&] {
+        return board->board.perft(depth);
+    });
+}
@@ -0,0 +1,157 @@
+#include <cstdlib>
+
+#include "board.hh"
+
+
+namespace {
+    constexpr int kRayMoves[8][2] { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1} };
+    constexpr int kKnightMoves[8][2] { {1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1} };
+
+    inline uint64_t sq_bit(const int sq_num) {
+        return uint64_t { 1 } << sq_num;
+    }
+
+    inline bool on_board(const int row, const int col) {
+        return 0 <= row && row <= 7 && 0 <= col && col <= 7;
+    }
+}
+
+
+/**
+ * @brief Check info of the current position, computed once per ply: the
+ * squares from which each piece type of the side to move attacks the enemy king,
+ * and the pieces of the side to move that block one of its sliders from it.
+ */
+const check_info_t& Board::check_info() {
+    const size_t ply = _move_history.size();
+    if (ply >= _check_info_stack.size()) {
+        _check_info_stack.resize(ply + 1);
+        _check_info_valid.resize(ply + 1, 0);
+    }
+    auto& info = _check_info_stack[ply];
+    if (_check_info_valid[ply]) {
+        return info;
+    }
+
+    info = check_info_t {};
+    const char us = _to_move;
+    info.king_sq = (us == 'w') ? _b_king_sq : _w_king_sq;
+    const int k_row = info.king_sq / 8;
+    const int k_col = info.king_sq % 8;
+
+    // our pawns capture towards the king, so they check it from one row behind
+    const int pawn_row = k_row + ((us == 'w') ? -1 : 1);
+    for (const int col : { k_col - 1, k_col + 1 }) {
+        if (on_board(pawn_row, col)) {
+            info.check_squares[check_info_t::kPawn] |= sq_bit(pawn_row*8 + col);
+        }
+    }
+    for (const auto& [mv_row, mv_col] : kKnightMoves) {
+        if (on_board(k_row + mv_row, k_col + mv_col)) {
+            info.check_squares[check_info_t::kKnight] |= sq_bit((k_row + mv_row)*8 + k_col + mv_col);
+        }
+    }
+    // a ray ends on its first piece; if that one is ours and the next piece
+    // behind it is our slider of that line, moving it off the line discovers check
+    for (const auto& [mv_row, mv_col] : kRayMoves) {
+        const bool diagonal = (mv_row != 0 && mv_col != 0);
+        auto& squares = info.check_squares[diagonal ? check_info_t::kBishop : check_info_t::kRook];
+        int blocker = -1;
+        for (int row = k_row + mv_row, col = k_col + mv_col; on_board(row, col); row += mv_row, col += mv_col) {
+            const auto& sq = _chessboard[row*8 + col];
+            if (blocker == -1) {
+                squares |= sq_bit(row*8 + col);
+                if (sq.colour() == 'e') {
+                    continue;
+                }
+                if (sq.colour() != us) {
+                    break;
+                }
+                blocker = row*8 + col;
+            } else if (sq.colour() != 'e') {
+                if (sq.colour() == us && (sq.piece() == 'q' || sq.piece() == (diagonal ? 'b' : 'r'))) {
+                    info.discoverers |= sq_bit(blocker);
+                }
+                break;
+            }
+        }
+    }
+    info.check_squares[check_info_t::kQueen] = info.check_squares[check_info_t::kBishop] | info.check_squares[check_info_t::kRook];
+
+    _check_info_valid[ply] = 1;
+    return info;
+}
+
+/**
+ * @brief Whether a legal move of the side to move checks the enemy king, found
+ * from the check info without making the move. Promotions, en passant and
+ * castling move or remove a second piece and are decided by scanning the lines
+ * to the king as they will be after the move.
+ */
+bool Board::gives_check(const int from_num, const int to_num, const char promote_to) {
+    const auto& info = check_info();
+    const char piece = _chessboard[from_num].piece();
+    const bool promotion = (piece == 'p' && (to_num / 8 == 0 || to_num / 8 == 7));
+    const bool ep = (piece == 'p' && to_num == _ep_square && from_num % 8 != to_num % 8);
+    const bool castling = (piece == 'k' && std::abs(to_num - from_num) == 2);
+
+    if (!promotion && !ep && !castling) {
+        if (info.check_squares[check_info_t::index(piece)] & sq_bit(to_num)) {
+            return true;
+        }
+        if (!(info.discoverers & sq_bit(from_num))) {
+            return false;
+        }
+        // a discoverer keeps the line blocked only by moving along it
+        const int row_diff = from_num / 8 - info.king_sq / 8;
+        const int col_diff = from_num % 8 - info.king_sq % 8;
+        const int row_step = (row_diff > 0) - (row_diff < 0);
+        const int col_step = (col_diff > 0) - (col_diff < 0);
+        return (to_num / 8 - info.king_sq / 8) * col_step != (to_num % 8 - info.king_sq % 8) * row_step;
+    }
+
+    const char us = _to_move;
+    const char placed = promotion ? promote_to : piece;
+    if (placed == 'n' || placed == 'p') {
+        if (info.check_squares[check_info_t::index(placed)] & sq_bit(to_num)) {
+            return true;
+        }
+    }
+    // squares whose contents change, first match wins
+    struct override_t {
+        int sq_num;
+        char colour;
+        char piece;
+    };
+    override_t overrides[4] { { from_num, 'e', 'e' }, { to_num, us, placed }, { -1, 'e', 'e' }, { -1, 'e', 'e' } };
+    if (ep) {
+        overrides[2] = { (from_num / 8)*8 + to_num % 8, 'e', 'e' };
+    } else if (castling) {
+        overrides[2] = { (to_num > from_num) ? from_num + 3 : from_num - 4, 'e', 'e' };
+        overrides[3] = { (to_num > from_num) ? from_num + 1 : from_num - 1, us, 'r' };
+    }
+    const auto square = [&](const int sq_num) {
+        for (const auto& o : overrides) {
+            if (o.sq_num == sq_num) {
+                return std::make_pair(o.colour, o.piece);
+            }
+        }
+        return std::make_pair(_chessboard[sq_num].colour(), _chessboard[sq_num].piece());
+    };
+    const int k_row = info.king_sq / 8;
+    const int k_col = info.king_sq % 8;
+    for (const auto& [mv_row, mv_col] : kRayMoves) {
+        const char slider = (mv_row != 0 && mv_col != 0) ? 'b' : 'r';
+        for (int row = k_row + mv_row, col = k_col + mv_col; on_board(row, col); row += mv_row, col += mv_col) {
+            const auto [colour, sq_piece] = square(row*8 + col);
+            if (colour == 'e') {
+                continue;
+            }
+            if (colour == us && (sq_piece == 'q' || sq_piece == slider)) {
+                return true;
+            }
+            break;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "board.hh"
+#include "epd.hh"
+#include "fen.hh"
+#include "service.hh"
+
+#include "log.hh"
+
+
+namespace {
+    bool contains(const std::vector<Pgn::move_t>& moves, const search_result_t& result) {
+        return std::any_of(moves.begin(), moves.end(), [&result](const Pgn::move_t& mv) {
+            return mv.from_num == result.from_num && mv.to_num == result.to_num && mv.promote_to == result.promote_to;
+        });
+    }
+}
+
+
+bool Epd::parse_line(const std::string& line, record_t& record) {
+    std::istringstream in(line);
+    std::string fields[4];
+    if (!(in >> fields[0] >> fields[1] >> fields[2] >> fields[3]) || fields[0][0] == '#') {
+        return false;
+    }
+    record.fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " 0 1";
+    if (!Fen::fen_valid(record.fen)) {
+        return false;
+    }
+    record.operations.clear();
+    std::string operations;
+    std::getline(in, operations);
+    std::istringstream ops(operations);
+    std::string operation;
+    while (std::getline(ops, operation, ';')) {
+        std::istringstream op(operation);
+        std::string opcode, operand;
+        if (!(op >> opcode)) {
+            continue;
+        }
+        std::getline(op >> std::ws, operand);
+        operand.erase(std::remove(operand.begin(), operand.end(), '"'), operand.end());
+        record.operations[opcode] = operand;
+    }
+    return true;
+}
+
+bool Epd::operand_moves(Board& board, const std::string& operand, std::vector<Pgn::move_t>& moves, std::string& error) {
+    moves.clear();
+    std::istringstream in(operand);
+    std::string san;
+    while (in >> san) {
+        Pgn::move_t move;
+        if (!board.san_to_move(san, move)) {
+            error = "illegal or ambiguous move '" + san + "'";
+            return false;
+        }
+        moves.push_back(move);
+    }
+    return true;
+}
+
+/**
+ * @brief Searches every position of a suite, one per thread at a time, writing
+ * JSON lines as positions finish.
+ */
+bool Epd::analyse(const std::string& path, const config_t& config) {
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERROR("Cannot read %s", path.c_str());
+        return false;
+    }
+    std::vector<record_t> records;
+    std::string line;
+    record_t record;
+    while (std::getline(file, line)) {
+        if (parse_line(line, record)) {
+            records.push_back(record);
+        }
+    }
+
+    search_limits_t limits;
+    limits.nodes = config.nodes;
+    limits.time_ms = config.time_ms;
+    limits.options = config.options;
+    if (config.depth > 0) {
+        limits.depth = config.depth;
+    }
+    std::atomic<size_t> next { 0 };
+    std::atomic<uint64_t> nodes { 0 };
+    std::atomic<int> scored { 0 };
+    std::atomic<int> solved { 0 };
+    std::atomic<int> errors { 0 };
+    std::mutex output_mutex;
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    const auto work = [&] {
+        Board board;
+        size_t i;
+        while ((i = next.fetch_add(1)) < records.size()) {
+            const auto& rec = records[i];
+            if (!board.set_fen(rec.fen)) {
+                ++errors;
+                const std::string id = rec.operations.count("id") ? rec.operations.at("id") : "";
+                const std::string json = "{\"n\":" + std::to_string(i + 1) + ",\"id\":" + Service::json_string(id) +
+                                         ",\"error\":\"illegal position\"}\n";
+                std::lock_guard lock(output_mutex);
+                fputs(json.c_str(), stdout);
+                fflush(stdout);
+                continue;
+            }
+            std::vector<Pgn::move_t> bm;
+            std::vector<Pgn::move_t> am;
+            std::string error;
+            const auto resolve = [&](const std::string& opcode, std::vector<Pgn::move_t>& moves) {
+                if (error.empty() && rec.operations.count(opcode) && !operand_moves(board, rec.operations.at(opcode), moves, error)) {
+                    error = opcode + ": " + error;
+                }
+            };
+            resolve("bm", bm);
+            resolve("am", am);
+            // a position whose solution cannot be read is searched but not scored
+            if (!error.empty()) {
+                bm.clear();
+                am.clear();
+                ++errors;
+            }
+            const bool has_target = !bm.empty() || !am.empty();
+            const auto is_solution = [&](const search_result_t& result) {
+                return (bm.empty() || contains(bm, result)) && !contains(am, result);
+            };
+            double solved_ms = -1.0;
+            search_limits_t position_limits = limits;
+            position_limits.on_iteration = [&](const search_result_t& result, const double time_ms) {
+                if (!is_solution(result)) {
+                    solved_ms = -1.0;
+                } else if (solved_ms < 0) {
+                    solved_ms = time_ms;
+                }
+            };
+            const auto result = board.search(position_limits, false);
+            const auto& stats = board.search_stats();
+            const uint64_t position_nodes = stats.nodes + stats.qnodes;
+            nodes += position_nodes;
+            const bool ok = has_target && result.from_num != -1 && is_solution(result);
+            scored += has_target;
+            solved += ok;
+
+            const std::string id = rec.operations.count("id") ? rec.operations.at("id") : "";
+            const std::string best = (result.from_num == -1) ? "" : board.move_to_san(result.from_num, result.to_num, result.promote_to);
+            char buffer[256];
+            snprintf(buffer, sizeof(buffer), ",\"score\":%d,\"depth\":%d,\"nodes\":%lu,\"time_ms\":%.2lf,\"solved\":%s",
+                     result.score, result.depth, position_nodes, stats.time_ms, has_target ? (ok ? "true" : "false") : "null");
+            std::string json = "{\"n\":" + std::to_string(i + 1) + ",\"id\":" + Service::json_string(id) +
+                               ",\"best\":" + Service::json_string(best) + buffer;
+            if (ok) {
+                snprintf(buffer, sizeof(buffer), ",\"solved_ms\":%.2lf", solved_ms);
+                json += buffer;
+            }
+            if (!error.empty()) {
+                json += ",\"error\":" + Service::json_string(error);
+            }
+            json += "}\n";
+            std::lock_guard lock(output_mutex);
+            fputs(json.c_str(), stdout);
+            fflush(stdout);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < config.threads; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& th : workers) {
+        th.join();
+    }
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    printf("{\"summary\":true,\"positions\":%lu,\"scored\":%d,\"solved\":%d,\"errors\":%d,\"nodes\":%lu,\"wall_ms\":%.2lf,\"nps\":%.0lf}\n",
+           records.size(), scored.load(), solved.load(), errors.load(), nodes.load(), t_tm.count(),
+           t_tm.count() > 0 ? nodes * 1000.0 / t_tm.count() : 0.0);
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "board.hh"
+#include "pgn.hh"
+
+// EPD test suites
+// A line holds the first four FEN fields followed by operations "opcode operands;",
+// e.g. `r1b1k2r/... w kq - bm Qxf7+; id "WAC.004";'. Analysis searches every
+// position with a fixed time or node budget on a pool of threads (each owning a
+// Board, one position at a time) and writes one JSON line per position as it
+// finishes, then a summary line:
+//     {"n":4,"id":"WAC.004","best":"Qxf7+","score":...,"depth":6,"nodes":...,"time_ms":...,"solved":true,"solved_ms":12.5}
+//     {"summary":true,"positions":300,"scored":300,"solved":271,"nodes":...,"wall_ms":...,"nps":...}
+// A position is solved when the final move is one of `bm' and none of `am';
+// solved_ms is the time of the iteration since which it has been. Positions
+// without bm/am have "solved":null, as do positions whose bm/am holds a move that
+// does not resolve in the position; those get an "error" field naming it and are
+// counted as "errors" in the summary.
+namespace Epd {
+    struct record_t {
+        std::string fen;
+        std::map<std::string, std::string> operations;  // operand text, quotes removed
+    };
+
+    struct config_t {
+        int threads = 1;
+        double time_ms = 0.0;
+        uint64_t nodes = 0;
+        int depth = 0;      // 0: no depth limit
+        search_options_t options;
+    };
+
+    // false for blank lines, comments and invalid positions
+    bool parse_line(const std::string& line, record_t& record);
+    // the SAN moves of an operand (e.g. bm), resolved in the board's position;
+    // false with `error' set if one of them is illegal or ambiguous there
+    bool operand_moves(Board& board, const std::string& operand, std::vector<Pgn::move_t>& moves, std::string& error);
+    bool analyse(const std::string& path, const config_t& config);
+}
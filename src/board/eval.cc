@@ -0,0 +1,193 @@
+#include <bit>
+
+#include "board.hh"
+#include "eval.hh"
+#include "nnue.hh"
+#include "stats.hh"
+
+
+namespace {
+    constexpr uint64_t kFileA { 0x0101010101010101ULL };
+
+    inline uint64_t file_mask(const int file) {
+        return kFileA << file;
+    }
+
+    inline uint64_t adjacent_files_mask(const int file) {
+        return (file > 0 ? file_mask(file-1) : 0) | (file < 7 ? file_mask(file+1) : 0);
+    }
+
+    // squares strictly in front of given rank, from the point of view of colour c
+    inline uint64_t ranks_ahead_mask(const int c, const int rank) {
+        if (c == 0) {
+            return rank == 7 ? 0 : ~0ULL << (8*(rank+1));
+        }
+        return (1ULL << (8*rank)) - 1;
+    }
+
+    // squares on given rank and behind it, from the point of view of colour c
+    inline uint64_t ranks_behind_mask(const int c, const int rank) {
+        return ~ranks_ahead_mask(c, rank);
+    }
+
+    inline uint64_t square_bb(const int file, const int rank) {
+        if (file < 0 || file > 7 || rank < 0 || rank > 7) {
+            return 0;
+        }
+        return 1ULL << (rank*8 + file);
+    }
+}
+
+
+/**
+ * @brief Counts the pawn structure terms (doubled, isolated, backward and passed
+ * pawns) and finds the shelter ranks of the current pawn skeleton.
+ */
+void Board::count_pawn_terms(Eval::pawn_terms_t& terms, uint8_t shelter_rank[2][8]) const {
+    uint64_t pawns[2] { 0, 0 };
+    for (const auto sq_num : _white_pieces) {
+        if (_chessboard[sq_num].piece() == 'p') {
+            pawns[0] |= 1ULL << sq_num;
+        }
+    }
+    for (const auto sq_num : _black_pieces) {
+        if (_chessboard[sq_num].piece() == 'p') {
+            pawns[1] |= 1ULL << sq_num;
+        }
+    }
+
+    terms = Eval::pawn_terms_t {};
+    for (int c = 0; c < 2; ++c) {
+        const int sign = (c == 0) ? 1 : -1;
+        const int forward = (c == 0) ? 1 : -1;
+        const uint64_t own = pawns[c];
+        const uint64_t their = pawns[1-c];
+
+        for (int file = 0; file < 8; ++file) {
+            const uint64_t on_file = own & file_mask(file);
+            const int count = std::popcount(on_file);
+            if (count > 1) {
+                terms.doubled += sign * (count-1);
+            }
+            if (on_file) {
+                const int rear_sq = (c == 0) ? std::countr_zero(on_file) : 63 - std::countl_zero(on_file);
+                shelter_rank[c][file] = (c == 0) ? rear_sq / 8 : 7 - rear_sq / 8;
+            } else {
+                shelter_rank[c][file] = 0;
+            }
+        }
+
+        uint64_t remaining = own;
+        while (remaining) {
+            const int sq_num = std::countr_zero(remaining);
+            remaining &= remaining - 1;
+            const int file = sq_num % 8;
+            const int rank = sq_num / 8;
+            const int rel_rank = (c == 0) ? rank : 7 - rank;
+            const uint64_t adjacent = adjacent_files_mask(file);
+
+            if (!(own & adjacent)) {
+                terms.isolated += sign;
+            } else if (!(own & adjacent & ranks_behind_mask(c, rank))) {
+                // no friendly pawn can support the advance and the stop square is guarded
+                const uint64_t stop_guards = square_bb(file-1, rank+2*forward) | square_bb(file+1, rank+2*forward);
+                if (their & stop_guards) {
+                    terms.backward += sign;
+                }
+            }
+
+            if (!(their & (file_mask(file) | adjacent) & ranks_ahead_mask(c, rank))) {
+                terms.passed[rel_rank] += sign;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Scores the pawn structure and stores the shelter ranks of a pawn
+ * skeleton, or fetches them from the pawn hash table if the skeleton has been
+ * seen before.
+ */
+const pawn_entry_t& Board::probe_pawn_structure() {
+    bool hit = false;
+    auto& entry = _pawn_table.probe(_pawn_hash, hit);
+    STATS_INC(kPawnHashProbes);
+    if (hit) {
+        STATS_INC(kPawnHashHits);
+        return entry;
+    }
+
+    Eval::pawn_terms_t terms;
+    count_pawn_terms(terms, entry.shelter_rank);
+    int score = terms.doubled * Eval::kDoubledPawn + terms.isolated * Eval::kIsolatedPawn + terms.backward * Eval::kBackwardPawn;
+    for (int rel_rank = 0; rel_rank < 8; ++rel_rank) {
+        score += terms.passed[rel_rank] * Eval::kPassedPawn[rel_rank];
+    }
+
+    entry.key = _pawn_hash;
+    entry.score = score;
+    return entry;
+}
+
+void Board::count_shelter_terms(const pawn_entry_t& entry, const char colour, Eval::shelter_terms_t& terms) const {
+    terms = Eval::shelter_terms_t {};
+    const int king_sq = (colour == 'w') ? _w_king_sq : _b_king_sq;
+    if (king_sq == -1) {
+        return;
+    }
+    const int c = (colour == 'w') ? 0 : 1;
+    const int rel_rank = (c == 0) ? king_sq / 8 : 7 - king_sq / 8;
+    if (rel_rank > 1) {
+        return;
+    }
+
+    const int king_file = king_sq % 8;
+    for (int file = std::max(king_file-1, 0); file <= std::min(king_file+1, 7); ++file) {
+        switch (entry.shelter_rank[c][file]) {
+            case 1:     ++terms.files[0]; break;
+            case 2:     ++terms.files[1]; break;
+            default:    ++terms.files[2]; break;
+        }
+    }
+}
+
+int Board::king_shelter(const pawn_entry_t& entry, const char colour) const {
+    Eval::shelter_terms_t terms;
+    count_shelter_terms(entry, colour, terms);
+    return terms.files[0] * Eval::kShelterRank2 + terms.files[1] * Eval::kShelterRank3 + terms.files[2] * Eval::kShelterMissing;
+}
+
+/**
+ * @brief Static evaluation, by the NNUE network when one is loaded.
+ *
+ * @return score in centipawns relative to the player to move
+ */
+int Board::evaluate() {
+    STATS_TIMER(kTimerEval);
+    if (NNUE::loaded()) {
+        return evaluate_nnue();
+    }
+    return evaluate_classical();
+}
+
+/**
+ * @brief Hand-written evaluation: material, piece-square tables, pawn structure
+ * and king shelter.
+ */
+int Board::evaluate_classical() {
+    int score = 0;
+    for (const auto sq_num : _white_pieces) {
+        const char piece = _chessboard[sq_num].piece();
+        score += Eval::piece_value(piece) + Eval::pst_value('w', piece, sq_num);
+    }
+    for (const auto sq_num : _black_pieces) {
+        const char piece = _chessboard[sq_num].piece();
+        score -= Eval::piece_value(piece) + Eval::pst_value('b', piece, sq_num);
+    }
+
+    const auto& pawn_entry = probe_pawn_structure();
+    score += pawn_entry.score;
+    score += king_shelter(pawn_entry, 'w') - king_shelter(pawn_entry, 'b');
+
+    return (_to_move == 'w') ? score : -score;
+}
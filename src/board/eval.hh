@@ -0,0 +1,126 @@
+#pragma once
+
+// Evaluation constants. Scores are in centipawns from white's point of view;
+// Board::evaluate() returns them relative to the player to move.
+// Square tables are laid out as seen from white's side (a8 first), so white
+// pieces index them with sq_num^56 and black pieces with sq_num.
+namespace Eval {
+    static constexpr int kScoreInfinity { 32767 };
+    static constexpr int kScoreMate { 32000 };
+    static constexpr int kScoreMateBound { kScoreMate - 1000 };
+
+    inline int piece_value(const char piece) {
+        switch (piece) {
+            case 'p':   return 100;
+            case 'n':   return 320;
+            case 'b':   return 330;
+            case 'r':   return 500;
+            case 'q':   return 900;
+            default:    return 0;
+        }
+    }
+
+    static constexpr int kPstPawn[64] {
+         0,   0,   0,   0,   0,   0,   0,   0,
+        50,  50,  50,  50,  50,  50,  50,  50,
+        10,  10,  20,  30,  30,  20,  10,  10,
+         5,   5,  10,  25,  25,  10,   5,   5,
+         0,   0,   0,  20,  20,   0,   0,   0,
+         5,  -5, -10,   0,   0, -10,  -5,   5,
+         5,  10,  10, -20, -20,  10,  10,   5,
+         0,   0,   0,   0,   0,   0,   0,   0
+    };
+
+    static constexpr int kPstKnight[64] {
+        -50, -40, -30, -30, -30, -30, -40, -50,
+        -40, -20,   0,   0,   0,   0, -20, -40,
+        -30,   0,  10,  15,  15,  10,   0, -30,
+        -30,   5,  15,  20,  20,  15,   5, -30,
+        -30,   0,  15,  20,  20,  15,   0, -30,
+        -30,   5,  10,  15,  15,  10,   5, -30,
+        -40, -20,   0,   5,   5,   0, -20, -40,
+        -50, -40, -30, -30, -30, -30, -40, -50
+    };
+
+    static constexpr int kPstBishop[64] {
+        -20, -10, -10, -10, -10, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,  10,  10,   5,   0, -10,
+        -10,   5,   5,  10,  10,   5,   5, -10,
+        -10,   0,  10,  10,  10,  10,   0, -10,
+        -10,  10,  10,  10,  10,  10,  10, -10,
+        -10,   5,   0,   0,   0,   0,   5, -10,
+        -20, -10, -10, -10, -10, -10, -10, -20
+    };
+
+    static constexpr int kPstRook[64] {
+          0,   0,   0,   0,   0,   0,   0,   0,
+          5,  10,  10,  10,  10,  10,  10,   5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+          0,   0,   0,   5,   5,   0,   0,   0
+    };
+
+    static constexpr int kPstQueen[64] {
+        -20, -10, -10,  -5,  -5, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,   5,   5,   5,   0, -10,
+         -5,   0,   5,   5,   5,   5,   0,  -5,
+          0,   0,   5,   5,   5,   5,   0,  -5,
+        -10,   5,   5,   5,   5,   5,   0, -10,
+        -10,   0,   5,   0,   0,   0,   0, -10,
+        -20, -10, -10,  -5,  -5, -10, -10, -20
+    };
+
+    static constexpr int kPstKing[64] {
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -20, -30, -30, -40, -40, -30, -30, -20,
+        -10, -20, -20, -20, -20, -20, -20, -10,
+         20,  20,   0,   0,   0,   0,  20,  20,
+         20,  30,  10,   0,   0,  10,  30,  20
+    };
+
+    inline int pst_value(const char colour, const char piece, const int sq_num) {
+        const int idx = (colour == 'w') ? sq_num ^ 56 : sq_num;
+        switch (piece) {
+            case 'p':   return kPstPawn[idx];
+            case 'n':   return kPstKnight[idx];
+            case 'b':   return kPstBishop[idx];
+            case 'r':   return kPstRook[idx];
+            case 'q':   return kPstQueen[idx];
+            case 'k':   return kPstKing[idx];
+            default:    return 0;
+        }
+    }
+
+    // Pawn structure terms
+    static constexpr int kDoubledPawn { -12 };
+    static constexpr int kIsolatedPawn { -15 };
+    static constexpr int kBackwardPawn { -10 };
+    // indexed by relative rank (0 - first rank, 7 - last rank)
+    static constexpr int kPassedPawn[8] { 0, 5, 10, 20, 35, 60, 100, 0 };
+
+    // Pawn structure term counts of a skeleton, white minus black
+    struct pawn_terms_t {
+        int doubled = 0;
+        int isolated = 0;
+        int backward = 0;
+        int passed[8] {};
+    };
+
+    // King shelter terms, per file in front of the king (own file and its neighbours)
+    static constexpr int kShelterRank2 { 10 };
+    static constexpr int kShelterRank3 { 5 };
+    static constexpr int kShelterMissing { -15 };
+
+    // files of each king shelter term: rank 2 pawn, rank 3 pawn, none of them
+    struct shelter_terms_t {
+        int files[3] {};
+    };
+}
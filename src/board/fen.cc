@@ -1,3 +1,4 @@
+#include <climits>
 #include <regex>
 #include <sstream>
 
@@ -16,7 +17,8 @@
  * @retval false - otherwise
  */
 bool Fen::fen_valid(const std::string& fen) {
-    if (!std::regex_match(fen, std::regex(kFenRegex))) {
+    static const std::regex fen_regex(kFenRegex);
+    if (!std::regex_match(fen, fen_regex)) {
         LOG_TRACE("FEN `%s' invalid: does not match regex", fen.c_str());
         return false;
     }
@@ -55,6 +57,12 @@ bool Fen::fen_valid(const std::string& fen) {
                 }
                 last_letter = ch;
             }
+        } else if (field_num == kHalfmoveClock || field_num == kFullmoveCounter) {
+            // digits only (regex), but they have to fit an int
+            if (field.size() > 10 || std::stoll(field) > INT_MAX) {
+                LOG_TRACE("FEN `%s' invalid: move counter out of range", fen.c_str());
+                return false;
+            }
         }
     }
 
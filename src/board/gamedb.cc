@@ -0,0 +1,374 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "board.hh"
+#include "fen.hh"
+#include "gamedb.hh"
+
+#include "log.hh"
+
+
+namespace {
+    constexpr int kBenchBatch { 256 };
+
+    inline uint64_t read_le(const uint8_t* p, const int bytes) {
+        uint64_t v = 0;
+        for (int i = bytes - 1; i >= 0; --i) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    inline void write_le(std::string& out, const uint64_t v, const int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<char>((v >> (8*i)) & 0xff));
+        }
+    }
+
+    inline int promotion_rank(const char promote_to) {
+        switch (promote_to) {
+            case 'r':   return 1;
+            case 'b':   return 2;
+            case 'n':   return 3;
+            default:    return 0;
+        }
+    }
+}
+
+
+bool GameDb::Reader::open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_WARNING("Cannot open %s", path.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kHeaderSize) {
+        LOG_WARNING("Not a game database: %s", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    _data = static_cast<const uint8_t*>(map);
+    _size = st.st_size;
+    const uint64_t count = read_le(_data + 8, 8);
+    const uint64_t index_offset = read_le(_data + 16, 8);
+    if (std::memcmp(_data, kFileMagic, 4) != 0 || read_le(_data + 4, 4) != kFileVersion ||
+        index_offset < kHeaderSize || index_offset > _size || (_size - index_offset) / 8 < count) {
+        LOG_WARNING("Not a game database: %s", path.c_str());
+        close();
+        return false;
+    }
+    _count = count;
+    _index = _data + index_offset;
+    return true;
+}
+
+void GameDb::Reader::close() {
+    if (_data) {
+        munmap(const_cast<uint8_t*>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+    _count = 0;
+    _index = nullptr;
+}
+
+bool GameDb::Reader::read(const uint64_t index, record_t& record) const {
+    if (index >= _count) {
+        return false;
+    }
+    // offsets come from the file: compare against what is left, never add to them
+    size_t offset = read_le(_index + 8*index, 8);
+    if (offset >= _size || _size - offset < 4) {
+        return false;
+    }
+    const uint8_t* p = _data + offset;
+    record.result = static_cast<result_t>(p[0]);
+    const uint8_t flags = p[1];
+    record.plies = read_le(p + 2, 2);
+    offset += 4;
+    record.start_fen = std::string_view();
+    if (flags & kFlagFen) {
+        if (offset >= _size) {
+            return false;
+        }
+        const size_t fen_length = _data[offset];
+        if (_size - offset - 1 < fen_length) {
+            return false;
+        }
+        record.start_fen = std::string_view(reinterpret_cast<const char*>(_data + offset + 1), fen_length);
+        offset += 1 + fen_length;
+    }
+    if (_size - offset < record.plies) {
+        return false;
+    }
+    record.moves = _data + offset;
+    return true;
+}
+
+GameDb::result_t GameDb::result_from_str(const std::string& result) {
+    if (result == "1-0") {
+        return kResultWhite;
+    } else if (result == "0-1") {
+        return kResultBlack;
+    } else if (result == "1/2-1/2") {
+        return kResultDraw;
+    }
+    return kResultUnknown;
+}
+
+const char* GameDb::result_str(const result_t result) {
+    switch (result) {
+        case kResultWhite:  return "1-0";
+        case kResultBlack:  return "0-1";
+        case kResultDraw:   return "1/2-1/2";
+        default:            return "*";
+    }
+}
+
+bool GameDb::encode(const Pgn::game_t& game, Board& board, std::string& out) {
+    const bool custom_fen = (game.start_fen != Fen::kFenInitial);
+    if (game.moves.size() > kMaxPlies || game.start_fen.size() > 255) {
+        return false;
+    }
+    board.set_fen(game.start_fen);
+    out.push_back(static_cast<char>(result_from_str(game.result)));
+    out.push_back(static_cast<char>(custom_fen ? kFlagFen : 0));
+    write_le(out, game.moves.size(), 2);
+    if (custom_fen) {
+        out.push_back(static_cast<char>(game.start_fen.size()));
+        out += game.start_fen;
+    }
+    std::vector<Pgn::move_t> moves;
+    for (const auto& move : game.moves) {
+        board.canonical_moves(moves);
+        const auto it = std::find_if(moves.begin(), moves.end(), [&move](const Pgn::move_t& mv) {
+            return mv.from_num == move.from_num && mv.to_num == move.to_num && mv.promote_to == move.promote_to;
+        });
+        if (it == moves.end()) {
+            return false;
+        }
+        out.push_back(static_cast<char>(it - moves.begin()));
+        board.play_move(move.from_num, move.to_num, move.promote_to);
+    }
+    return true;
+}
+
+bool GameDb::replay(const record_t& record, Board& board, std::vector<Pgn::move_t>* moves) {
+    if (record.start_fen.empty()) {
+        board.set_fen(Fen::kFenInitial);
+    } else {
+        // the stored FEN is as trustworthy as the file: a corrupt one is a corrupt record
+        const std::string fen(record.start_fen);
+        if (!Fen::fen_valid(fen)) {
+            return false;
+        }
+        try {
+            if (!board.set_fen(fen)) {
+                return false;
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    if (moves) {
+        moves->clear();
+    }
+    std::vector<Pgn::move_t> legal;
+    for (size_t ply = 0; ply < record.plies; ++ply) {
+        board.canonical_moves(legal);
+        if (record.moves[ply] >= legal.size()) {
+            return false;
+        }
+        const auto& move = legal[record.moves[ply]];
+        board.play_move(move.from_num, move.to_num, move.promote_to);
+        if (moves) {
+            moves->push_back(move);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Converts a PGN file. Games are replayed and encoded in parallel, then
+ * written in their original order; games with errors are left out.
+ */
+bool GameDb::convert_pgn(const std::string& pgn_path, const std::string& db_path, const int threads) {
+    std::map<uint64_t, std::string> records;
+    std::mutex records_mutex;
+    std::atomic<uint64_t> too_long { 0 };
+    const auto summary = Pgn::replay_file(pgn_path, threads, [&](const Pgn::game_t& game, Board& board) {
+        std::string record;
+        if (!encode(game, board, record)) {
+            ++too_long;
+            return;
+        }
+        std::lock_guard lock(records_mutex);
+        records.emplace(game.index, std::move(record));
+    });
+    Pgn::print_summary(summary);
+    if (too_long) {
+        printf("%lu games not encodable (over %lu plies or FEN too long)\n", too_long.load(), kMaxPlies);
+    }
+
+    std::ofstream file(db_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        LOG_ERROR("Cannot write %s", db_path.c_str());
+        return false;
+    }
+    std::string header(kFileMagic, 4);
+    write_le(header, kFileVersion, 4);
+    write_le(header, records.size(), 8);
+    std::string index;
+    uint64_t offset = kHeaderSize;
+    for (const auto& [game_index, record] : records) {
+        write_le(index, offset, 8);
+        offset += record.size();
+    }
+    write_le(header, offset, 8);
+    file.write(header.data(), header.size());
+    for (const auto& [game_index, record] : records) {
+        file.write(record.data(), record.size());
+    }
+    file.write(index.data(), index.size());
+    if (!file) {
+        LOG_ERROR("Cannot write %s", db_path.c_str());
+        return false;
+    }
+    file.close();
+
+    const auto pgn_size = std::filesystem::file_size(pgn_path);
+    const auto db_size = std::filesystem::file_size(db_path);
+    printf("Wrote %lu games to %s: %lu bytes (PGN: %lu bytes, %.1lfx smaller)\n", records.size(), db_path.c_str(),
+           db_size, pgn_size, db_size ? static_cast<double>(pgn_size) / db_size : 0.0);
+    return true;
+}
+
+/**
+ * @brief Replays every game of a database on a pool of threads and reports the
+ * throughput.
+ */
+void GameDb::benchmark(const std::string& db_path, const int threads) {
+    Reader reader;
+    if (!reader.open(db_path)) {
+        return;
+    }
+    std::atomic<uint64_t> next { 0 };
+    std::atomic<uint64_t> plies { 0 };
+    std::atomic<uint64_t> failed { 0 };
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    const auto work = [&] {
+        Board board;
+        record_t record;
+        uint64_t local_plies = 0;
+        uint64_t start;
+        while ((start = next.fetch_add(kBenchBatch)) < reader.size()) {
+            const uint64_t end = std::min(start + kBenchBatch, reader.size());
+            for (uint64_t i = start; i < end; ++i) {
+                if (!reader.read(i, record) || !replay(record, board, nullptr)) {
+                    ++failed;
+                    continue;
+                }
+                local_plies += record.plies;
+            }
+        }
+        plies += local_plies;
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& th : workers) {
+        th.join();
+    }
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    const double seconds = t_tm.count() / 1000.0;
+    printf("Games: %lu (%lu corrupt) \tPlies: %lu \tTime: %.2lf ms \tGames/s: %.0lf \tPlies/s: %.0lf\n", reader.size(),
+           failed.load(), plies.load(), t_tm.count(), seconds > 0 ? reader.size() / seconds : 0.0,
+           seconds > 0 ? plies / seconds : 0.0);
+}
+
+bool GameDb::print_game(const std::string& db_path, const uint64_t index) {
+    Reader reader;
+    record_t record;
+    if (!reader.open(db_path) || index == 0 || !reader.read(index - 1, record)) {
+        printf("No game %lu\n", index);
+        return false;
+    }
+    Board board;
+    std::vector<Pgn::move_t> moves;
+    if (!replay(record, board, &moves)) {
+        printf("Game %lu is corrupt\n", index);
+        return false;
+    }
+    // SAN needs the position before each move
+    if (record.start_fen.empty()) {
+        board.set_fen(Fen::kFenInitial);
+    } else {
+        board.set_fen(std::string(record.start_fen));
+        printf("[FEN \"%s\"]\n", std::string(record.start_fen).c_str());
+    }
+    printf("[Result \"%s\"]\n\n", result_str(record.result));
+    const bool black_first = (board.to_move() == 'b');
+    for (size_t ply = 0; ply < moves.size(); ++ply) {
+        const size_t move_no = (ply + black_first) / 2 + 1;
+        if (ply == 0 && black_first) {
+            printf("%lu... ", move_no);
+        } else if ((ply + black_first) % 2 == 0) {
+            printf("%lu. ", move_no);
+        }
+        printf("%s ", board.move_to_san(moves[ply].from_num, moves[ply].to_num, moves[ply].promote_to).c_str());
+        board.play_move(moves[ply].from_num, moves[ply].to_num, moves[ply].promote_to);
+    }
+    printf("%s\n", result_str(record.result));
+    return true;
+}
+
+
+/**
+ * @brief Legal moves in a canonical order, independent of how the position was
+ * reached: promotions expanded (q, r, b, n), sorted by from square, to square
+ * and promotion piece. legal_moves() itself follows the piece sets' iteration
+ * order.
+ */
+void Board::canonical_moves(std::vector<Pgn::move_t>& moves) {
+    moves.clear();
+    for (const auto& [from_num, to_num] : legal_moves()) {
+        if (_chessboard[from_num].piece() == 'p' && (to_num / 8 == 0 || to_num / 8 == 7)) {
+            for (const char promote_to : { 'q', 'r', 'b', 'n' }) {
+                moves.push_back({ from_num, to_num, promote_to });
+            }
+        } else {
+            moves.push_back({ from_num, to_num, 'q' });
+        }
+    }
+    std::sort(moves.begin(), moves.end(), [](const Pgn::move_t& a, const Pgn::move_t& b) {
+        if (a.from_num != b.from_num) {
+            return a.from_num < b.from_num;
+        }
+        if (a.to_num != b.to_num) {
+            return a.to_num < b.to_num;
+        }
+        return promotion_rank(a.promote_to) < promotion_rank(b.promote_to);
+    });
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pgn.hh"
+
+class Board;
+
+// Binary game database (.ccgb)
+// Each move is stored as one byte: its index in the position's canonical move list
+// (Board::canonical_moves - legal moves with promotions expanded, sorted by from
+// square, to square and promotion piece q, r, b, n), which never exceeds 218.
+// Little-endian layout:
+//     header:  char[4] "CCGB", uint32 version, uint64 game count, uint64 index offset
+//     records: uint8 result (0 unknown, 1 white wins, 2 black wins, 3 draw),
+//              uint8 flags (kFlagFen: start position follows), uint16 plies,
+//              [uint8 FEN length, FEN], uint8 move index[plies]
+//     index:   uint64 record offset[game count]
+// The file is memory-mapped by the reader, so any game is reachable in O(1).
+namespace GameDb {
+    static constexpr char kFileMagic[4] { 'C', 'C', 'G', 'B' };
+    static constexpr uint32_t kFileVersion { 1 };
+    static constexpr size_t kHeaderSize { 24 };
+    static constexpr uint8_t kFlagFen { 1 };
+    static constexpr size_t kMaxPlies { 65535 };
+
+    enum result_t : uint8_t {
+        kResultUnknown = 0,
+        kResultWhite,
+        kResultBlack,
+        kResultDraw
+    };
+
+    struct record_t {
+        result_t result;
+        std::string_view start_fen;     // empty for the starting position
+        const uint8_t* moves;
+        size_t plies;
+    };
+
+    class Reader {
+    public:
+        Reader() = default;
+        ~Reader() { close(); }
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        bool open(const std::string& path);
+        void close();
+        uint64_t size() const { return _count; }
+        bool read(const uint64_t index, record_t& record) const;
+
+    private:
+        const uint8_t* _data = nullptr;
+        size_t _size = 0;
+        uint64_t _count = 0;
+        const uint8_t* _index = nullptr;
+    };
+
+    result_t result_from_str(const std::string& result);
+    const char* result_str(const result_t result);
+
+    // appends the encoded record of a game replayed from its start position
+    bool encode(const Pgn::game_t& game, Board& board, std::string& out);
+    // plays a record on the board from its start position, optionally collecting the moves
+    bool replay(const record_t& record, Board& board, std::vector<Pgn::move_t>* moves);
+
+    bool convert_pgn(const std::string& pgn_path, const std::string& db_path, const int threads);
+    void benchmark(const std::string& db_path, const int threads);
+    bool print_game(const std::string& db_path, const uint64_t index);
+}
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "job.hh"
+
+
+bool BackgroundJob::start(const std::string& name, std::function<void(BackgroundJob&)> work) {
+    if (running()) {
+        return false;
+    }
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    _name = name;
+    _stop = false;
+    _done = 0;
+    _total = 0;
+    _nodes = 0;
+    _root_nodes = 0;
+    _start = _last_report = std::chrono::steady_clock::now();
+    _running = true;
+    _thread = std::thread([this, work = std::move(work)] {
+        work(*this);
+        _running = false;
+    });
+    return true;
+}
+
+void BackgroundJob::stop() {
+    _stop = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void BackgroundJob::root_move_done(const uint64_t nodes) {
+    _root_nodes += nodes;
+    ++_done;
+    const auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double, std::milli>(now - _last_report).count() >= kReportIntervalMs) {
+        _last_report = now;
+        print_status();
+    }
+}
+
+/**
+ * @brief Prints completed root moves, the live node count, NPS and an ETA: the
+ * total is extrapolated from the average subtree of the completed root moves and
+ * what remains of it is divided by the current NPS (subtrees differ in size, so
+ * it is a rough guide).
+ */
+void BackgroundJob::print_status() const {
+    if (!running()) {
+        printf("No job running\n");
+        return;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    const int done = _done;
+    const int total = _total;
+    const uint64_t nodes = _nodes.load(std::memory_order_relaxed);
+    const double nps = seconds > 0 ? nodes / seconds : 0.0;
+    printf("[%s] %d/%d root moves \tNodes: %lu \tNPS: %.0lf \tElapsed: %.1lf s \tETA: ", _name.c_str(), done, total,
+           nodes, nps, seconds);
+    if (done > 0 && nps > 0) {
+        const double expected = static_cast<double>(_root_nodes) * total / done;
+        printf("%.1lf s\n", std::max(expected - nodes, 0.0) / nps);
+    } else {
+        printf("-\n");
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Background jobs of the interactive mode
+// A single job runs at a time on a worker thread, on the job's own copy of the
+// board, so the REPL stays responsive. The job polls the stop flag and publishes
+// its progress through atomics: a live node count, which perft adds to as it goes,
+// and the completed root moves with their node counts. `stop' cancels it
+// cooperatively and the job reports the root moves it completed.
+class BackgroundJob {
+public:
+    static constexpr double kReportIntervalMs { 1000.0 };
+
+    BackgroundJob() = default;
+    ~BackgroundJob() { stop(); }
+    BackgroundJob(const BackgroundJob&) = delete;
+    BackgroundJob& operator=(const BackgroundJob&) = delete;
+
+    // false if another job is still running
+    bool start(const std::string& name, std::function<void(BackgroundJob&)> work);
+    // requests a stop and waits for the job to finish
+    void stop();
+    bool running() const { return _running.load(); }
+
+    const std::atomic<bool>& stop_flag() const { return _stop; }
+    bool stop_requested() const { return _stop.load(std::memory_order_relaxed); }
+    void set_total(const int total) { _total = total; }
+    // nodes searched so far, including the root move in progress
+    std::atomic<uint64_t>& node_counter() { return _nodes; }
+    // called by the job after each root move, prints a progress line now and then
+    void root_move_done(const uint64_t nodes);
+    void print_status() const;
+
+private:
+    std::thread _thread;
+    std::atomic<bool> _stop { false };
+    std::atomic<bool> _running { false };
+    std::string _name;
+    std::atomic<int> _done { 0 };
+    std::atomic<int> _total { 0 };
+    std::atomic<uint64_t> _nodes { 0 };
+    std::atomic<uint64_t> _root_nodes { 0 };    // nodes of the completed root moves
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _last_report;
+};
@@ -0,0 +1,237 @@
+#include <cstdio>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "bench.hh"
+#include "board.hh"
+#include "epd.hh"
+#include "gamedb.hh"
+#include "mate.hh"
+#include "packed.hh"
+#include "perft_job.hh"
+#include "pgn.hh"
+#include "planes.hh"
+#include "service.hh"
+#include "stats.hh"
+#include "tablebase.hh"
+#include "tune.hh"
+#include "uperft.hh"
+
+
+void load_and_run_tests(const std::string& test_file_path, const int max_depth, const size_t hash_mb) {
+    Board b;
+    b.set_perft_hash(hash_mb);
+    std::ifstream file;
+    file.open(test_file_path);
+    std::string line;
+    printf("Testing at depth %d\n", max_depth);
+    printf("No.      FEN                               Result    Passed    Delta      Time\n");
+    printf("-----    ------------------------------    ------    ------    -------    ---------\n");
+    int fail = 0;
+    int pass = 0;
+    int test_no = 0;
+    bool failed = false;
+    int64_t result = 0;
+    int64_t expected = 0;
+    const auto start_time = std::chrono::high_resolution_clock::now();
+    std::chrono::system_clock::time_point s_tm, e_tm;
+    std::chrono::duration<double, std::milli> t_tm;
+    while (std::getline(file, line)) {
+        std::stringstream linestream(line);
+        std::string field;
+        int i = 0;
+        failed = false;
+        while (std::getline(linestream, field, ',')) {
+            if (field[0] == '#') {
+                break;
+            }
+            if (i == 0) {
+                s_tm = std::chrono::high_resolution_clock::now();
+                std::string fen_output_string = "";
+                if (field.size() > 30) {
+                    fen_output_string = field.substr(0, 12) + "[...]" + field.substr(field.size()-13);
+                } else {
+                    fen_output_string = field;
+                }
+                printf("%5d    %-30s    ", ++test_no, fen_output_string.c_str());
+                if (!b.set_fen(field)) {
+                    printf("illegal position\n");
+                    ++fail;
+                    break;
+                }
+            } else {
+                {
+                    STATS_TIMER(kTimerPerft);
+                    result = b.perft(i);
+                }
+                expected = std::stoi(field);
+                if (result == expected) {
+                    printf(".");
+                    fflush(stdout);
+                } else {
+                    failed = true;
+                    printf("F");
+                }
+            }
+            if (failed || i == max_depth) {
+                e_tm = std::chrono::high_resolution_clock::now();
+                t_tm = e_tm-s_tm;
+                const std::string padding(6-i, ' ');
+                const std::string delta_str = ((result > expected) ? "+" : "") + std::to_string(result-expected);
+                printf("%s    %d/%d       %-7s    %.2lf ms\n", padding.c_str(), failed ? i-1 : i, max_depth, delta_str.c_str(), t_tm.count());
+                if (failed) {
+                    ++fail;
+                    // printf("[ FAIL ] Test %d at depth %d - expected %d, got %d (delta: %s%d)\n", test_no, i, expected, result, result-expected>0 ? "+" : "", result-expected);
+                } else {
+                    ++pass;
+                }
+                break;
+            }
+            ++i;
+        }
+    }
+    e_tm = std::chrono::high_resolution_clock::now();
+    t_tm = e_tm-start_time;
+    printf("\n%d/%d tests passed (time: %.2lf ms)\n", pass, test_no, t_tm.count());
+    if (Stats::kEnabled) {
+        Stats::print();
+    }
+    file.close();
+}
+
+#ifndef GTEST_UT
+// trailing `-name' arguments switch search options off, e.g. `-lmr -null'
+bool parse_search_options(const int argc, char* argv[], const int first, search_options_t& options) {
+    for (int i = first; i < argc; ++i) {
+        if (argv[i][0] != '-' || !options.set(argv[i] + 1, false)) {
+            printf("Unknown search option: %s\n", argv[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        const int threads = (argc > 2) ? atoi(argv[2]) : std::thread::hardware_concurrency();
+        return Service::run(std::max(threads, 1), (argc > 3) ? argv[3] : "");
+    } else if (argc > 2 && std::string(argv[1]) == "pgn") {
+        const int threads = (argc > 3) ? atoi(argv[3]) : std::thread::hardware_concurrency();
+        const auto summary = Pgn::replay_file(argv[2], std::max(threads, 1), nullptr);
+        Pgn::print_summary(summary);
+        return summary.error_count ? 1 : 0;
+    } else if (argc > 3 && std::string(argv[1]) == "gamedb") {
+        const std::string action = argv[2];
+        if (action == "convert" && argc > 4) {
+            const int threads = (argc > 5) ? atoi(argv[5]) : std::thread::hardware_concurrency();
+            return GameDb::convert_pgn(argv[3], argv[4], std::max(threads, 1)) ? 0 : 1;
+        } else if (action == "bench") {
+            const int threads = (argc > 4) ? atoi(argv[4]) : std::thread::hardware_concurrency();
+            GameDb::benchmark(argv[3], std::max(threads, 1));
+        } else if (action == "show" && argc > 4) {
+            return GameDb::print_game(argv[3], std::strtoull(argv[4], nullptr, 10)) ? 0 : 1;
+        } else {
+            printf("Usage: gamedb convert PGN DB [THREADS] | gamedb bench DB [THREADS] | gamedb show DB GAME\n");
+            return 1;
+        }
+    } else if (argc > 2 && std::string(argv[1]) == "datagen") {
+        if (std::string(argv[2]) == "check" && argc > 3) {
+            return Packed::check(argv[3]) ? 0 : 1;
+        } else if (argc < 4) {
+            printf("Usage: datagen OUT COUNT [THREADS] [random|perft] [SEED] | datagen check FILE\n");
+            return 1;
+        }
+        Packed::generator_config_t config;
+        config.path = argv[2];
+        config.count = std::strtoull(argv[3], nullptr, 10);
+        config.threads = std::max((argc > 4) ? atoi(argv[4]) : static_cast<int>(std::thread::hardware_concurrency()), 1);
+        if (argc > 5 && std::string(argv[5]) == "perft") {
+            config.mode = Packed::kModePerftSample;
+            config.max_ply = 10;
+        }
+        config.seed = (argc > 6) ? std::strtoull(argv[6], nullptr, 10) : 1;
+        return Packed::generate(config) ? 0 : 1;
+    } else if (argc > 1 && std::string(argv[1]) == "bench") {
+        const int depth = (argc > 2) ? atoi(argv[2]) : Bench::kDefaultDepth;
+        const int threads = (argc > 3) ? atoi(argv[3]) : 1;
+        search_options_t options;
+        if (depth < 1 || !parse_search_options(argc, argv, 4, options)) {
+            printf("Usage: bench [DEPTH] [THREADS] [-null] [-lmr] [-futility] [-rfp] [-checkext]\n");
+            return 1;
+        }
+        Bench::run(depth, std::max(threads, 1), options);
+    } else if (argc > 3 && std::string(argv[1]) == "epd") {
+        // budget: a time in ms, or a node count with an `n' suffix (e.g. 200000n)
+        Epd::config_t config;
+        const std::string budget = argv[3];
+        if (!budget.empty() && budget.back() == 'n') {
+            config.nodes = std::strtoull(budget.c_str(), nullptr, 10);
+        } else {
+            config.time_ms = std::atof(budget.c_str());
+        }
+        config.threads = std::max((argc > 4) ? atoi(argv[4]) : static_cast<int>(std::thread::hardware_concurrency()), 1);
+        if ((config.nodes == 0 && config.time_ms <= 0) || !parse_search_options(argc, argv, 5, config.options)) {
+            printf("Usage: epd FILE MS|NODESn [THREADS] [-null] [-lmr] [-futility] [-rfp] [-checkext]\n");
+            return 1;
+        }
+        return Epd::analyse(argv[2], config) ? 0 : 1;
+    } else if (argc > 2 && std::string(argv[1]) == "mate") {
+        Mate::config_t config;
+        config.max_moves = (argc > 3) ? std::max(atoi(argv[3]), 1) : config.max_moves;
+        config.checks_only = (argc > 4 && std::string(argv[4]) == "checks");
+        return Mate::solve_epd(argv[2], config) ? 0 : 1;
+    } else if (argc > 1 && std::string(argv[1]) == "perftjob") {
+        const int depth = (argc > 4) ? atoi(argv[4]) : 0;
+        if (depth < 1) {
+            printf("Usage: perftjob CHECKPOINT PERFT_FILE DEPTH\n");
+            return 1;
+        }
+        return PerftJob::run(argv[2], argv[3], depth) ? 0 : 1;
+    } else if (argc > 2 && std::string(argv[1]) == "tune") {
+        Tune::config_t config;
+        config.epochs = (argc > 3) ? atoi(argv[3]) : config.epochs;
+        config.threads = std::max((argc > 4) ? atoi(argv[4]) : static_cast<int>(std::thread::hardware_concurrency()), 1);
+        config.output_path = (argc > 5) ? argv[5] : "";
+        return Tune::run(argv[2], config) ? 0 : 1;
+    } else if (argc > 3 && std::string(argv[1]) == "planes") {
+        Planes::config_t config;
+        config.input_path = argv[2];
+        config.output_path = argv[3];
+        config.threads = std::max((argc > 4) ? atoi(argv[4]) : static_cast<int>(std::thread::hardware_concurrency()), 1);
+        if (argc > 5 && std::string(argv[5]) != "bits" && std::string(argv[5]) != "bytes") {
+            printf("Usage: planes INPUT OUT [THREADS] [bytes|bits]\n");
+            return 1;
+        }
+        config.format = (argc > 5 && std::string(argv[5]) == "bits") ? Planes::kFormatBits : Planes::kFormatBytes;
+        return Planes::export_file(config) ? 0 : 1;
+    } else if (argc > 1 && std::string(argv[1]) == "uperft") {
+        UPerft::config_t config;
+        config.fen = FEN_INIT;
+        config.depth = (argc > 2) ? atoi(argv[2]) : 0;
+        config.memory_mb = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : UPerft::kDefaultMemoryMb;
+        config.threads = std::max((argc > 4) ? atoi(argv[4]) : static_cast<int>(std::thread::hardware_concurrency()), 1);
+        config.verify = (argc > 5 && std::string(argv[5]) == "verify");
+        if (config.depth < 1 || config.memory_mb == 0) {
+            printf("Usage: uperft DEPTH [MEMORY_MB] [THREADS] [verify]\n");
+            return 1;
+        }
+        return UPerft::run(config) ? 0 : 1;
+    } else if (argc > 2 && std::string(argv[1]) == "tbgen") {
+        const int threads = (argc > 3) ? atoi(argv[3]) : std::thread::hardware_concurrency();
+        const std::string directory = (argc > 4) ? argv[4] : Tablebase::kDefaultDirectory;
+        return Tablebase::generate(argv[2], directory, std::max(threads, 1)) ? 0 : 1;
+    } else if (argc > 2) {
+        load_and_run_tests(argv[1], atoi(argv[2]), (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 0);
+    } else {
+        Board board;
+        board.interactive_mode();
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include "board.hh"
+#include "epd.hh"
+#include "mate.hh"
+
+#include "log.hh"
+
+
+namespace {
+    constexpr char kPromotionTargets[4] { 'q', 'r', 'b', 'n' };
+
+    inline uint32_t saturate(const uint64_t value) {
+        return static_cast<uint32_t>(std::min<uint64_t>(value, Mate::kInfinity));
+    }
+}
+
+
+Mate::Table::Table(const size_t entries) {
+    size_t size = 1;
+    while (size < entries) {
+        size <<= 1;
+    }
+    _table = Memory::LargeArray<entry_t>(size);
+    _mask = size - 1;
+}
+
+void Mate::Table::clear() {
+    std::fill(_table.begin(), _table.end(), entry_t { 0, 0, 0 });
+}
+
+bool Mate::Table::probe(const Zobrist::key_t key, uint32_t& pn, uint32_t& dn) const {
+    const auto& entry = _table[key & _mask];
+    if (entry.key != key || (entry.pn == 0 && entry.dn == 0)) {
+        return false;
+    }
+    pn = entry.pn;
+    dn = entry.dn;
+    return true;
+}
+
+void Mate::Table::store(const Zobrist::key_t key, const uint32_t pn, const uint32_t dn) {
+    _table[key & _mask] = { key, pn, dn };
+}
+
+
+/**
+ * @brief Expands a node into its children with their initial proof and disproof
+ * numbers: terminal values for mates, stalemates and exhausted move budgets,
+ * table values when present, else 1 for attacker nodes and the reply count for
+ * defender nodes.
+ *
+ * @param or_node attacker to move
+ * @param moves_left attacker moves left, including the one to play at an OR node
+ */
+void Board::mate_children(Mate::search_t& search, const bool or_node, const int moves_left, std::vector<Mate::child_t>& children) {
+    children.clear();
+    const auto& legals = legal_moves();
+    for (const auto& [from_num, to_num] : legals) {
+        const bool promotion = _chessboard[from_num].piece() == 'p' && (to_num / 8 == 0 || to_num / 8 == 7);
+        for (const char promote_to : kPromotionTargets) {
+            const bool check = gives_check(from_num, to_num, promote_to);
+            if (or_node && search.checks_only && !check) {
+                if (!promotion) {
+                    break;
+                }
+                continue;
+            }
+            make_move(from_num, to_num, promote_to, true);
+            ++search.nodes;
+            Mate::child_t child { from_num, to_num, promote_to, 1, 1 };
+            const int replies = count_legal_moves();
+            const int child_moves_left = or_node ? moves_left - 1 : moves_left;
+            if (replies == 0) {
+                // mate is a proof only when the defender is mated
+                const bool proof = or_node && check;
+                child.pn = proof ? 0 : Mate::kInfinity;
+                child.dn = proof ? Mate::kInfinity : 0;
+            } else if (or_node && child_moves_left == 0) {
+                child.pn = Mate::kInfinity;
+                child.dn = 0;
+            } else if (!search.table.probe(Mate::node_key(_hash, !or_node, child_moves_left), child.pn, child.dn) && or_node) {
+                child.pn = replies;
+            }
+            unmake_move();
+            children.push_back(child);
+            if (!promotion) {
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Multiple iterative deepening step of df-pn: searches the current node
+ * until its proof number reaches th_pn or its disproof number th_dn.
+ */
+void Board::mate_mid(Mate::search_t& search, const bool or_node, const int moves_left, const uint32_t th_pn,
+                     const uint32_t th_dn, uint32_t& pn, uint32_t& dn) {
+    std::vector<Mate::child_t> children;
+    mate_children(search, or_node, moves_left, children);
+    while (true) {
+        uint64_t sum = 0;
+        uint32_t best = Mate::kInfinity;
+        uint32_t second = Mate::kInfinity;
+        size_t best_idx = 0;
+        for (size_t i = 0; i < children.size(); ++i) {
+            // OR node: minimise pn, sum dn; AND node: minimise dn, sum pn
+            const uint32_t value = or_node ? children[i].pn : children[i].dn;
+            sum += or_node ? children[i].dn : children[i].pn;
+            if (value < best) {
+                second = best;
+                best = value;
+                best_idx = i;
+            } else if (value < second) {
+                second = value;
+            }
+        }
+        pn = or_node ? best : saturate(sum);
+        dn = or_node ? saturate(sum) : best;
+        if (children.empty()) {
+            // only OR nodes in checks-only mode can run out of candidate moves
+            pn = Mate::kInfinity;
+            dn = 0;
+        }
+        if (pn >= th_pn || dn >= th_dn || pn == 0 || dn == 0 || search.nodes >= search.max_nodes) {
+            break;
+        }
+
+        auto& child = children[best_idx];
+        uint32_t child_th_pn, child_th_dn;
+        if (or_node) {
+            child_th_pn = std::min<uint64_t>(th_pn, static_cast<uint64_t>(second) + 1);
+            child_th_dn = saturate(static_cast<uint64_t>(th_dn) - dn + child.dn);
+        } else {
+            child_th_dn = std::min<uint64_t>(th_dn, static_cast<uint64_t>(second) + 1);
+            child_th_pn = saturate(static_cast<uint64_t>(th_pn) - pn + child.pn);
+        }
+        make_move(child.from_num, child.to_num, child.promote_to, true);
+        mate_mid(search, !or_node, or_node ? moves_left - 1 : moves_left, child_th_pn, child_th_dn, child.pn, child.dn);
+        unmake_move();
+    }
+    search.table.store(Mate::node_key(_hash, or_node, moves_left), pn, dn);
+}
+
+/**
+ * @brief Looks for a mate by the side to move in at most config.max_moves moves,
+ * trying 1, 2, ... moves in turn.
+ */
+Mate::result_t Board::solve_mate(const Mate::config_t& config, Mate::Table& table) {
+    Mate::result_t result;
+    Mate::search_t search { table, config.checks_only, config.max_nodes };
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    result.status = Mate::kDisproven;
+    for (int moves = 1; moves <= config.max_moves; ++moves) {
+        uint32_t pn, dn;
+        mate_mid(search, true, moves, Mate::kInfinity, Mate::kInfinity, pn, dn);
+        if (pn == 0) {
+            result.status = Mate::kProven;
+            result.moves = moves;
+            break;
+        }
+        if (dn != 0) {
+            result.status = Mate::kUnknown;
+            break;
+        }
+    }
+
+    if (result.status == Mate::kProven) {
+        // follow proven children: a mating move of the attacker, the defence that
+        // is not mated sooner
+        std::vector<Mate::child_t> children;
+        int moves_left = result.moves;
+        bool or_node = true;
+        int plies = 0;
+        while (moves_left > 0) {
+            mate_children(search, or_node, moves_left, children);
+            auto it = std::find_if(children.begin(), children.end(), [](const Mate::child_t& c) { return c.pn == 0; });
+            if (it == children.end()) {
+                break;
+            }
+            for (auto c = children.begin(); !or_node && c != children.end(); ++c) {
+                make_move(c->from_num, c->to_num, c->promote_to, true);
+                uint32_t pn, dn;
+                const bool sooner = search.table.probe(Mate::node_key(_hash, true, moves_left - 1), pn, dn) && pn == 0;
+                unmake_move();
+                if (!sooner) {
+                    it = c;
+                    break;
+                }
+            }
+            result.line.push_back(move_to_san(it->from_num, it->to_num, it->promote_to));
+            make_move(it->from_num, it->to_num, it->promote_to, true);
+            ++plies;
+            moves_left -= or_node;
+            or_node = !or_node;
+        }
+        for (int i = 0; i < plies; ++i) {
+            unmake_move();
+        }
+    }
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    result.nodes = search.nodes;
+    result.time_ms = t_tm.count();
+    return result;
+}
+
+
+/**
+ * @brief Batch driver: one problem per EPD line, reporting solve time and nodes.
+ */
+bool Mate::solve_epd(const std::string& path, const config_t& config) {
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERROR("Cannot read %s", path.c_str());
+        return false;
+    }
+    Board board;
+    Table table;
+    std::string line;
+    int problems = 0;
+    int solved = 0;
+    int mismatched = 0;
+    int bad_operands = 0;
+    double total_ms = 0.0;
+    printf("No.      ID                      Mate    Found    Time          Nodes        Line\n");
+    printf("-----    --------------------    ----    -----    ----------    ---------    ----\n");
+    Epd::record_t record;
+    while (std::getline(file, line)) {
+        if (!Epd::parse_line(line, record)) {
+            continue;
+        }
+        config_t problem_config = config;
+        if (record.operations.count("dm")) {
+            problem_config.max_moves = std::max(std::atoi(record.operations["dm"].c_str()), 1);
+        }
+        const std::string id = record.operations.count("id") ? record.operations["id"] : "";
+        if (!board.set_fen(record.fen)) {
+            ++problems;
+            printf("%5d    %-20.20s    %4d    %5s    (illegal position)\n", problems, id.c_str(), problem_config.max_moves, "-");
+            continue;
+        }
+        std::vector<Pgn::move_t> best_moves;
+        std::string bm_error;
+        if (record.operations.count("bm") && !Epd::operand_moves(board, record.operations["bm"], best_moves, bm_error)) {
+            LOG_WARNING("Problem %d (%s): bm: %s", problems + 1, id.c_str(), bm_error.c_str());
+            ++bad_operands;
+        }
+        table.clear();
+        const auto result = board.solve_mate(problem_config, table);
+        ++problems;
+        total_ms += result.time_ms;
+        std::string found = "-";
+        if (result.status == kProven) {
+            ++solved;
+            found = std::to_string(result.moves);
+        } else if (result.status == kUnknown) {
+            found = "?";
+        }
+        std::string line_str;
+        for (const auto& san : result.line) {
+            line_str += san + " ";
+        }
+        Pgn::move_t key_move;
+        const bool mismatch = !best_moves.empty() && !result.line.empty() && board.san_to_move(result.line[0], key_move) &&
+            std::none_of(best_moves.begin(), best_moves.end(), [&key_move](const Pgn::move_t& mv) {
+                return mv.from_num == key_move.from_num && mv.to_num == key_move.to_num && mv.promote_to == key_move.promote_to;
+            });
+        mismatched += mismatch;
+        printf("%5d    %-20.20s    %4d    %5s    %10.2lf    %9lu    %s%s\n", problems, id.c_str(), problem_config.max_moves,
+               found.c_str(), result.time_ms, result.nodes, line_str.c_str(),
+               bm_error.empty() ? (mismatch ? "(bm differs)" : "") : "(bm unreadable)");
+    }
+    printf("\n%d/%d solved (%d key moves differ from bm, %d bm unreadable) \tTime: %.2lf ms\n", solved, problems, mismatched,
+           bad_operands, total_ms);
+    return solved == problems;
+}
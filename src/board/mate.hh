@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "memory.hh"
+#include "zobrist.hh"
+
+// Mate solver
+// Depth-first proof-number search (df-pn) for "mate in N" problems: OR nodes are
+// the attacker to move, AND nodes the defender. An attacker node with n moves left
+// is disproven when n runs out, so the tree is finite and the transposition table
+// is keyed by position and remaining moves. Defender nodes start with the number
+// of replies as proof number, so forcing lines are tried first. In checks-only
+// mode the attacker only considers checking moves, which solves most composed
+// direct mates much faster but misses quiet key moves.
+//
+// N is deepened from 1, so a proof is always a shortest mate.
+namespace Mate {
+    static constexpr uint32_t kInfinity { 100000000 };
+    static constexpr size_t kDefaultTableEntries { 1 << 20 };
+    static constexpr uint64_t kDefaultMaxNodes { 20000000 };
+
+    enum status_t {
+        kUnknown = 0,   // node limit reached
+        kProven,
+        kDisproven
+    };
+
+    struct entry_t {
+        Zobrist::key_t key;
+        uint32_t pn;
+        uint32_t dn;
+    };
+
+    // fixed-size, always-replace table: its size bounds the memory of a search
+    class Table {
+    public:
+        explicit Table(const size_t entries = kDefaultTableEntries);
+        void clear();
+        bool probe(const Zobrist::key_t key, uint32_t& pn, uint32_t& dn) const;
+        void store(const Zobrist::key_t key, const uint32_t pn, const uint32_t dn);
+
+    private:
+        Memory::LargeArray<entry_t> _table;
+        size_t _mask;
+    };
+
+    struct config_t {
+        int max_moves = 5;
+        bool checks_only = false;
+        uint64_t max_nodes = kDefaultMaxNodes;
+    };
+
+    struct result_t {
+        status_t status = kUnknown;
+        int moves = 0;                  // mate in (if proven)
+        std::vector<std::string> line;  // SAN, key move first
+        uint64_t nodes = 0;
+        double time_ms = 0.0;
+    };
+
+    // per-search state shared by the recursion
+    struct search_t {
+        Table& table;
+        bool checks_only;
+        uint64_t max_nodes;
+        uint64_t nodes = 0;
+    };
+
+    struct child_t {
+        int from_num;
+        int to_num;
+        char promote_to;
+        uint32_t pn;
+        uint32_t dn;
+    };
+
+    inline Zobrist::key_t node_key(const Zobrist::key_t hash, const bool or_node, const int moves_left) {
+        return hash ^ (0x9e3779b97f4a7c15ULL * (2 * moves_left + or_node + 1));
+    }
+
+    // solves every problem of an EPD file (`dm N' gives the mate length, else
+    // config.max_moves; `bm' is compared with the key move found)
+    bool solve_epd(const std::string& path, const config_t& config);
+}
@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <new>
+#include <thread>
+#include <tuple>
+
+#include "board.hh"
+#include "eval.hh"
+#include "mcts.hh"
+#include "memory.hh"
+
+
+namespace {
+    constexpr char kPromotionTargets[4] { 'q', 'r', 'b', 'n' };
+    constexpr double kFpuReduction { 0.2 };     // unvisited children: parent value minus this
+
+    Mcts::node_t* new_node(Mcts::Arena& arena, Mcts::Arena::cursor_t& cursor, const size_t max_bytes, const Zobrist::key_t key) {
+        void* mem = arena.allocate(sizeof(Mcts::node_t), cursor, max_bytes);
+        if (!mem) {
+            return nullptr;
+        }
+        auto* node = new (mem) Mcts::node_t {};
+        node->key = key;
+        return node;
+    }
+
+    // copies a finished search's subtree into another arena, nullptr when out of memory
+    Mcts::node_t* copy_subtree(const Mcts::node_t* node, Mcts::Arena& arena, Mcts::Arena::cursor_t& cursor, const size_t max_bytes,
+                               uint64_t& nodes) {
+        auto* copy = new_node(arena, cursor, max_bytes, node->key);
+        if (!copy) {
+            return nullptr;
+        }
+        ++nodes;
+        copy->visits.store(node->visits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        copy->value_sum.store(node->value_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        copy->state.store(node->state.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        copy->terminal_value = node->terminal_value;
+        if (node->edge_count == 0) {
+            return copy;
+        }
+        void* mem = arena.allocate(node->edge_count * sizeof(Mcts::edge_t), cursor, max_bytes);
+        if (!mem) {
+            return nullptr;
+        }
+        copy->edges = static_cast<Mcts::edge_t*>(mem);
+        copy->edge_count = node->edge_count;
+        for (int i = 0; i < node->edge_count; ++i) {
+            const auto& edge = node->edges[i];
+            Mcts::node_t* child = edge.child.load(std::memory_order_relaxed);
+            if (child && !(child = copy_subtree(child, arena, cursor, max_bytes, nodes))) {
+                return nullptr;
+            }
+            new (&copy->edges[i]) Mcts::edge_t { edge.from_num, edge.to_num, edge.promote_to, edge.prior, { child } };
+        }
+        return copy;
+    }
+
+    // average value of a node including its virtual losses, from the view of the player who moved into it
+    inline double node_q(const Mcts::node_t* node, const uint32_t n) {
+        const int32_t virtual_loss = node->virtual_loss.load(std::memory_order_relaxed);
+        return (static_cast<double>(node->value_sum.load(std::memory_order_relaxed)) / Mcts::kValueUnit - virtual_loss) / n;
+    }
+}
+
+
+Mcts::Arena::~Arena() {
+    for (char* block : _blocks) {
+        Memory::free_large(block, kBlockSize);
+    }
+}
+
+void* Mcts::Arena::allocate(size_t bytes, cursor_t& cursor, const size_t max_bytes) {
+    bytes = (bytes + 15) & ~size_t { 15 };
+    if (static_cast<size_t>(cursor.end - cursor.next) < bytes) {
+        std::lock_guard lock(_mutex);
+        if (_reserved.load(std::memory_order_relaxed) + kSliceSize > max_bytes) {
+            return nullptr;
+        }
+        if (_block_used + kSliceSize > kBlockSize) {
+            char* block = static_cast<char*>(Memory::allocate_large(kBlockSize));
+            if (!block) {
+                return nullptr;
+            }
+            _blocks.push_back(block);
+            _block_used = 0;
+        }
+        cursor.next = _blocks.back() + _block_used;
+        cursor.end = cursor.next + kSliceSize;
+        _block_used += kSliceSize;
+        _reserved.fetch_add(kSliceSize, std::memory_order_relaxed);
+    }
+    void* ptr = cursor.next;
+    cursor.next += bytes;
+    return ptr;
+}
+
+
+/**
+ * @brief Expands a node claimed by this thread: terminal positions are marked as
+ * such, otherwise the edges get their priors and the position its static value.
+ *
+ * @param value set to the value of the position for the side to move
+ * @return false when the arena is full (the node stays unexpanded)
+ */
+bool Board::mcts_expand(Mcts::node_t* node, Mcts::Tree& tree, Mcts::Arena::cursor_t& cursor, const bool root, double& value) {
+    const auto& legals = legal_moves();
+    if (legals.empty() || (!root && is_draw())) {
+        node->terminal_value = (legals.empty() && is_in_check()) ? -1 : 0;
+        node->state.store(Mcts::kTerminal, std::memory_order_release);
+        value = node->terminal_value;
+        return true;
+    }
+
+    std::vector<std::tuple<int, int, char, double>> moves;
+    double total = 0.0;
+    for (const auto& [from_num, to_num] : legals) {
+        const char from_piece = _chessboard[from_num].piece();
+        const bool promotion = from_piece == 'p' && (to_num / 8 == 0 || to_num / 8 == 7);
+        const bool ep = from_piece == 'p' && to_num == _ep_square;
+        const char victim = ep ? 'p' : _chessboard[to_num].piece();
+        for (const char promote_to : kPromotionTargets) {
+            // softmax over simple bonuses: winning material, promoting, checking
+            double score = 0.0;
+            if (victim != 'e') {
+                score += 1.0 + Eval::piece_value(victim) / 300.0 - Eval::piece_value(from_piece) / 3000.0;
+            }
+            if (promotion) {
+                score += (promote_to == 'q') ? 2.0 : -2.0;
+            }
+            if (gives_check(from_num, to_num, promote_to)) {
+                score += 1.0;
+            }
+            const double weight = std::exp(score);
+            total += weight;
+            moves.emplace_back(from_num, to_num, promote_to, weight);
+            if (!promotion) {
+                break;
+            }
+        }
+    }
+    void* mem = tree._arena->allocate(moves.size() * sizeof(Mcts::edge_t), cursor, tree._max_bytes);
+    if (!mem) {
+        node->state.store(Mcts::kUnexpanded, std::memory_order_release);
+        return false;
+    }
+    auto* edges = static_cast<Mcts::edge_t*>(mem);
+    for (size_t i = 0; i < moves.size(); ++i) {
+        const auto& [from_num, to_num, promote_to, weight] = moves[i];
+        new (&edges[i]) Mcts::edge_t { static_cast<uint8_t>(from_num), static_cast<uint8_t>(to_num), promote_to,
+                                       static_cast<float>(weight / total), { nullptr } };
+    }
+    node->edges = edges;
+    node->edge_count = moves.size();
+    value = std::tanh(evaluate() / Mcts::kEvalScale);
+    node->state.store(Mcts::kExpanded, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief One playout: descends by PUCT with virtual losses, expands or values
+ * the leaf and backs the value up the path.
+ *
+ * @return false when the arena is full
+ */
+bool Board::mcts_playout(Mcts::Tree& tree, const double cpuct, Mcts::Arena::cursor_t& cursor, std::vector<Mcts::node_t*>& path) {
+    path.clear();
+    Mcts::node_t* node = tree._root;
+    node->virtual_loss.fetch_add(1, std::memory_order_relaxed);
+    path.push_back(node);
+    bool ok = true;
+    double value = 0.0;     // for the side to move at the leaf
+    while (true) {
+        uint8_t state = node->state.load(std::memory_order_acquire);
+        if (state == Mcts::kUnexpanded) {
+            if (node->state.compare_exchange_strong(state, Mcts::kExpanding, std::memory_order_acq_rel)) {
+                ok = mcts_expand(node, tree, cursor, path.size() == 1, value);
+                if (!ok) {
+                    value = std::tanh(evaluate() / Mcts::kEvalScale);
+                }
+                break;
+            }
+        }
+        if (state == Mcts::kTerminal) {
+            value = node->terminal_value;
+            break;
+        }
+        if (state != Mcts::kExpanded) {
+            // being expanded by another thread
+            value = std::tanh(evaluate() / Mcts::kEvalScale);
+            break;
+        }
+
+        const uint32_t parent_n = node->visits.load(std::memory_order_relaxed) + node->virtual_loss.load(std::memory_order_relaxed);
+        const double sqrt_n = std::sqrt(std::max<uint32_t>(parent_n, 1));
+        const uint32_t node_visits = node->visits.load(std::memory_order_relaxed);
+        const double fpu = (node_visits ? -node_q(node, node_visits) : 0.0) - kFpuReduction;
+        Mcts::edge_t* best = nullptr;
+        double best_score = -1e9;
+        for (int i = 0; i < node->edge_count; ++i) {
+            auto& edge = node->edges[i];
+            const Mcts::node_t* child = edge.child.load(std::memory_order_acquire);
+            const uint32_t n = child ? child->visits.load(std::memory_order_relaxed) + child->virtual_loss.load(std::memory_order_relaxed) : 0;
+            const double q = n ? node_q(child, n) : fpu;
+            const double score = q + cpuct * edge.prior * sqrt_n / (1 + n);
+            if (score > best_score) {
+                best_score = score;
+                best = &edge;
+            }
+        }
+
+        make_move(best->from_num, best->to_num, best->promote_to, true);
+        Mcts::node_t* child = best->child.load(std::memory_order_acquire);
+        if (!child) {
+            Mcts::node_t* created = new_node(*tree._arena, cursor, tree._max_bytes, _hash);
+            if (!created) {
+                unmake_move();
+                ok = false;
+                value = std::tanh(evaluate() / Mcts::kEvalScale);
+                break;
+            }
+            // a losing thread leaves its node unused in the arena
+            if (best->child.compare_exchange_strong(child, created, std::memory_order_acq_rel)) {
+                child = created;
+                tree._nodes.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        child->virtual_loss.fetch_add(1, std::memory_order_relaxed);
+        path.push_back(child);
+        node = child;
+    }
+
+    double node_value = -value;
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        (*it)->value_sum.fetch_add(std::llround(node_value * Mcts::kValueUnit), std::memory_order_relaxed);
+        (*it)->visits.fetch_add(1, std::memory_order_relaxed);
+        (*it)->virtual_loss.fetch_sub(1, std::memory_order_relaxed);
+        node_value = -node_value;
+    }
+    for (size_t i = 1; i < path.size(); ++i) {
+        unmake_move();
+    }
+    return ok;
+}
+
+/**
+ * @brief MCTS from the current position within the playout and time limits,
+ * reusing the tree of the previous search when this position is in it.
+ *
+ * @return the most visited root move
+ */
+Mcts::result_t Board::mcts_search(Mcts::Tree& tree, const Mcts::config_t& config) {
+    Mcts::result_t result;
+    const auto s_tm = std::chrono::steady_clock::now();
+
+    // the previous root, one of its children or grandchildren
+    Mcts::node_t* reuse = nullptr;
+    std::vector<const Mcts::node_t*> candidates;
+    if (tree._root) {
+        candidates.push_back(tree._root);
+    }
+    for (size_t i = 0; i < candidates.size() && !reuse; ++i) {
+        const auto* node = candidates[i];
+        if (node->key == _hash && node->visits.load(std::memory_order_relaxed) > 0) {
+            reuse = const_cast<Mcts::node_t*>(node);
+            break;
+        }
+        const bool grandchildren = (node == tree._root);
+        for (int e = 0; e < node->edge_count; ++e) {
+            const auto* child = node->edges[e].child.load(std::memory_order_relaxed);
+            if (!child) {
+                continue;
+            }
+            if (grandchildren) {
+                candidates.push_back(child);
+            } else if (child->key == _hash) {
+                reuse = const_cast<Mcts::node_t*>(child);
+                break;
+            }
+        }
+    }
+    if (reuse && reuse != tree._root) {
+        auto arena = std::make_unique<Mcts::Arena>();
+        Mcts::Arena::cursor_t cursor;
+        uint64_t nodes = 0;
+        tree._root = copy_subtree(reuse, *arena, cursor, tree._max_bytes, nodes);
+        tree._arena = std::move(arena);
+        tree._nodes = tree._root ? nodes : 0;
+    } else if (!reuse) {
+        tree.clear();
+    }
+    result.reused_nodes = tree._nodes;
+
+    Mcts::Arena::cursor_t cursor;
+    if (!tree._root) {
+        tree._root = new_node(*tree._arena, cursor, tree._max_bytes, _hash);
+        if (!tree._root) {
+            result.memory_full = true;
+            return result;
+        }
+        tree._nodes = 1;
+    }
+    tree._root->virtual_loss.store(0, std::memory_order_relaxed);
+    const uint64_t root_visits = tree._root->visits.load(std::memory_order_relaxed);
+    std::vector<Mcts::node_t*> path;
+    // the root is expanded before the threads start, so that they share its edges
+    if (!mcts_playout(tree, config.cpuct, cursor, path) || tree._root->state.load() == Mcts::kTerminal) {
+        result.memory_full = (tree._root->state.load() != Mcts::kTerminal);
+        return result;
+    }
+
+    std::atomic<uint64_t> started { 1 };
+    std::atomic<bool> stop { false };
+    std::atomic<bool> memory_full { false };
+    const auto work = [&] {
+        Board board = *this;
+        Mcts::Arena::cursor_t thread_cursor;
+        std::vector<Mcts::node_t*> thread_path;
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (config.playouts && started.fetch_add(1, std::memory_order_relaxed) >= config.playouts) {
+                break;
+            }
+            if (!board.mcts_playout(tree, config.cpuct, thread_cursor, thread_path)) {
+                memory_full = true;
+                stop = true;
+            }
+            if (config.time_ms > 0) {
+                const std::chrono::duration<double, std::milli> t_tm = std::chrono::steady_clock::now() - s_tm;
+                if (t_tm.count() >= config.time_ms) {
+                    stop = true;
+                }
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < config.threads; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& th : workers) {
+        th.join();
+    }
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::steady_clock::now() - s_tm;
+
+    const Mcts::edge_t* best = nullptr;
+    uint32_t best_visits = 0;
+    for (int i = 0; i < tree._root->edge_count; ++i) {
+        const auto& edge = tree._root->edges[i];
+        const auto* child = edge.child.load(std::memory_order_relaxed);
+        const uint32_t visits = child ? child->visits.load(std::memory_order_relaxed) : 0;
+        if (!best || visits > best_visits) {
+            best = &edge;
+            best_visits = visits;
+        }
+    }
+    result.from_num = best->from_num;
+    result.to_num = best->to_num;
+    result.promote_to = best->promote_to;
+    result.visits = best_visits;
+    if (best_visits) {
+        result.value = node_q(best->child.load(std::memory_order_relaxed), best_visits);
+    }
+    result.playouts = tree._root->visits.load(std::memory_order_relaxed) - root_visits;
+    result.nodes = tree._nodes.load(std::memory_order_relaxed);
+    result.memory_bytes = tree._arena->reserved();
+    result.time_ms = t_tm.count();
+    result.memory_full = memory_full;
+    return result;
+}
+
+
+void Mcts::print_result(const result_t& result, const std::string& move, const int threads) {
+    const double seconds = result.time_ms / 1000.0;
+    const double per_core = (seconds > 0) ? result.playouts / seconds / std::max(threads, 1) : 0.0;
+    printf("bestmove %s value %.3lf visits %u\n", move.c_str(), result.value, result.visits);
+    printf("Playouts: %lu \tTime: %.2lf ms \tPlayouts/s per thread: %.0lf (%d threads)\n", result.playouts, result.time_ms,
+           per_core, threads);
+    printf("Nodes: %lu (%lu reused) \tMemory: %lu kB, %.1lf bytes/node%s\n", result.nodes, result.reused_nodes,
+           result.memory_bytes >> 10, result.nodes ? static_cast<double>(result.memory_bytes) / result.nodes : 0.0,
+           result.memory_full ? " (full)" : "");
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "zobrist.hh"
+
+class Board;
+
+// Monte Carlo tree search
+// PUCT selection (AlphaZero style) over the make/unmake board: move priors come
+// from a softmax of capture, promotion and check bonuses, and leaves are valued
+// by the static evaluation squashed to [-1, 1] instead of by a random playout.
+//
+// Tree parallelism: all threads descend the same tree. A thread going through a
+// node adds a virtual loss to it until its playout is backed up, so the others
+// prefer different lines. A node is expanded by the thread that wins a CAS on its
+// state, and its children are created on first visit by a CAS on the edge, so no
+// locks are taken on the tree.
+//
+// Nodes and edges are bump-allocated from an arena owned by the tree: every thread
+// carves its allocations out of its own slice, so the allocator does not serialise
+// threads, and the whole tree is freed at once. When a search starts from the
+// root or a grandchild of the previous one (after our move and the reply), that
+// subtree is copied into a fresh arena and the rest freed.
+namespace Mcts {
+    static constexpr double kDefaultCpuct { 1.5 };
+    static constexpr size_t kDefaultMemoryMb { 256 };
+    static constexpr double kEvalScale { 400.0 };       // centipawns for tanh(1)
+    static constexpr int64_t kValueUnit { 1 << 16 };    // fixed point value sums
+
+    class Arena {
+    public:
+        static constexpr size_t kBlockSize { 4 << 20 };
+        static constexpr size_t kSliceSize { 64 << 10 };
+
+        // a thread's current slice of the arena
+        struct cursor_t {
+            char* next = nullptr;
+            char* end = nullptr;
+        };
+
+        Arena() = default;
+        ~Arena();
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        // nullptr once max_bytes would be exceeded
+        void* allocate(const size_t bytes, cursor_t& cursor, const size_t max_bytes);
+        size_t reserved() const { return _reserved.load(std::memory_order_relaxed); }
+
+    private:
+        std::mutex _mutex;
+        std::vector<char*> _blocks;
+        size_t _block_used = kBlockSize;
+        std::atomic<size_t> _reserved { 0 };
+    };
+
+    enum node_state_t : uint8_t {
+        kUnexpanded = 0,
+        kExpanding,
+        kExpanded,
+        kTerminal
+    };
+
+    struct node_t;
+
+    struct edge_t {
+        uint8_t from_num;
+        uint8_t to_num;
+        char promote_to;
+        float prior;
+        std::atomic<node_t*> child;
+    };
+
+    // values are from the point of view of the player who moved into the node
+    struct node_t {
+        Zobrist::key_t key;
+        std::atomic<uint32_t> visits;
+        std::atomic<int32_t> virtual_loss;
+        std::atomic<int64_t> value_sum;
+        std::atomic<uint8_t> state;
+        int8_t terminal_value;      // for the side to move: -1 mated, 0 draw
+        uint16_t edge_count;
+        edge_t* edges;
+    };
+
+    struct config_t {
+        uint64_t playouts = 0;      // 0: no limit
+        double time_ms = 0.0;       // 0: no limit
+        int threads = 1;
+        double cpuct = kDefaultCpuct;
+    };
+
+    struct result_t {
+        int from_num = -1;
+        int to_num = -1;
+        char promote_to = 'q';
+        double value = 0.0;         // expected score of the move, -1 to 1
+        uint32_t visits = 0;
+        uint64_t playouts = 0;
+        uint64_t nodes = 0;         // tree size, reused nodes included
+        uint64_t reused_nodes = 0;
+        size_t memory_bytes = 0;
+        double time_ms = 0.0;
+        bool memory_full = false;
+    };
+
+    class Tree {
+    public:
+        explicit Tree(const size_t memory_mb = kDefaultMemoryMb)
+            : _arena(std::make_unique<Arena>()), _max_bytes(memory_mb << 20) {}
+        void clear() {
+            _arena = std::make_unique<Arena>();
+            _root = nullptr;
+            _nodes = 0;
+        }
+
+    private:
+        friend class ::Board;
+
+        std::unique_ptr<Arena> _arena;
+        size_t _max_bytes;
+        node_t* _root = nullptr;
+        std::atomic<uint64_t> _nodes { 0 };
+    };
+
+    void print_result(const result_t& result, const std::string& move, const int threads);
+}
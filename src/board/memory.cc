@@ -0,0 +1,108 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "memory.hh"
+
+#include "log.hh"
+
+
+namespace {
+    constexpr int kMpolInterleave { 3 };
+    constexpr int kMaxNodes { 64 };
+
+    inline size_t round_up(const size_t bytes, const size_t alignment) {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    // online NUMA nodes as an mbind node mask, 0 when there is only one
+    uint64_t interleave_mask() {
+        static const uint64_t mask = [] {
+            const char* env = std::getenv(Memory::kNumaEnvVar);
+            if (!env || std::string(env) != "interleave") {
+                return uint64_t { 0 };
+            }
+            // e.g. "0-1" or "0,2-3"
+            std::ifstream file("/sys/devices/system/node/online");
+            std::string ranges;
+            uint64_t nodes = 0;
+            if (std::getline(file, ranges)) {
+                size_t pos = 0;
+                while (pos < ranges.size()) {
+                    const size_t end = std::min(ranges.find(',', pos), ranges.size());
+                    const std::string range = ranges.substr(pos, end - pos);
+                    const size_t dash = range.find('-');
+                    const int first = std::atoi(range.c_str());
+                    const int last = (dash == std::string::npos) ? first : std::atoi(range.c_str() + dash + 1);
+                    for (int node = first; node <= last && node < kMaxNodes; ++node) {
+                        nodes |= uint64_t { 1 } << node;
+                    }
+                    pos = end + 1;
+                }
+            }
+            if ((nodes & (nodes - 1)) == 0) {
+                LOG_WARNING("%s=interleave: fewer than two NUMA nodes online", Memory::kNumaEnvVar);
+                return uint64_t { 0 };
+            }
+            return nodes;
+        }();
+        return mask;
+    }
+}
+
+
+void* Memory::allocate_large(const size_t bytes) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+    if (bytes < kHugePageSize) {
+        const size_t size = round_up(bytes, kCacheLineSize);
+        void* ptr = std::aligned_alloc(kCacheLineSize, size);
+        if (ptr) {
+            std::memset(ptr, 0, size);
+        }
+        return ptr;
+    }
+
+    // over-map by one huge page and trim both ends to get a 2 MB aligned block
+    const size_t size = round_up(bytes, kHugePageSize);
+    void* map = mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Cannot allocate %lu bytes", bytes);
+        return nullptr;
+    }
+    const uintptr_t start = reinterpret_cast<uintptr_t>(map);
+    const uintptr_t aligned = round_up(start, kHugePageSize);
+    if (aligned > start) {
+        munmap(map, aligned - start);
+    }
+    if (kHugePageSize > aligned - start) {
+        munmap(reinterpret_cast<void*>(aligned + size), kHugePageSize - (aligned - start));
+    }
+    void* ptr = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    if (const uint64_t mask = interleave_mask()) {
+        if (syscall(SYS_mbind, ptr, size, kMpolInterleave, &mask, kMaxNodes + 1, 0) != 0) {
+            LOG_WARNING("mbind failed, table not interleaved");
+        }
+    }
+    return ptr;
+}
+
+void Memory::free_large(void* ptr, const size_t bytes) {
+    if (!ptr) {
+        return;
+    }
+    if (bytes < kHugePageSize) {
+        std::free(ptr);
+    } else {
+        munmap(ptr, round_up(bytes, kHugePageSize));
+    }
+}
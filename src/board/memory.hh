@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// Memory for large hash tables
+// Tables of at least kHugePageSize bytes are mapped with mmap, aligned to 2 MB and
+// advised for transparent huge pages (MADV_HUGEPAGE), so that a random probe does
+// not also cost a TLB miss and page walk. Where THP is unavailable the advice is
+// ignored and the table stays in 4 kB pages. With CRUDECHESS_NUMA=interleave in the
+// environment their pages are interleaved over all online NUMA nodes (mbind), so
+// threads on every socket see the same average latency. Smaller tables come from
+// the heap, aligned to a cache line.
+namespace Memory {
+    static constexpr size_t kHugePageSize { 2 << 20 };
+    static constexpr size_t kCacheLineSize { 64 };
+    static constexpr auto kNumaEnvVar { "CRUDECHESS_NUMA" };
+
+    // zero-filled, nullptr when out of memory
+    void* allocate_large(const size_t bytes);
+    void free_large(void* ptr, const size_t bytes);
+
+    inline void prefetch(const void* ptr) {
+        __builtin_prefetch(ptr);
+    }
+
+    // fixed-size array of trivially copyable elements in large-table memory
+    template <typename T>
+    class LargeArray {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+    public:
+        LargeArray() = default;
+        explicit LargeArray(const size_t size) : _size(size) {
+            _data = static_cast<T*>(allocate_large(size * sizeof(T)));
+            if (!_data) {
+                _size = 0;
+            }
+        }
+        ~LargeArray() { free_large(_data, _size * sizeof(T)); }
+        LargeArray(const LargeArray& other) : LargeArray(other._size) {
+            if (_data) {
+                std::memcpy(static_cast<void*>(_data), other._data, _size * sizeof(T));
+            }
+        }
+        LargeArray(LargeArray&& other) noexcept
+            : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)) {}
+        LargeArray& operator=(LargeArray other) noexcept {
+            std::swap(_data, other._data);
+            std::swap(_size, other._size);
+            return *this;
+        }
+
+        T& operator[](const size_t idx) { return _data[idx]; }
+        const T& operator[](const size_t idx) const { return _data[idx]; }
+        T* begin() { return _data; }
+        T* end() { return _data + _size; }
+        size_t size() const { return _size; }
+
+    private:
+        T* _data = nullptr;
+        size_t _size = 0;
+    };
+}
@@ -1,4 +1,5 @@
 #include "board.hh"
+#include "stats.hh"
 
 
 void Board::get_pseudolegal_moves_from_sq(const int sq_num) {
@@ -26,7 +27,7 @@ void Board::get_pseudolegal_moves_from_sq(const int sq_num) {
         // captures
         std::vector<std::pair<int, int>> all_captures { { pawn_move, -1 }, { pawn_move, 1 } };
 
-        for (const auto [mv_row, mv_col] : all_moves) {
+        for (const auto& [mv_row, mv_col] : all_moves) {
             int dest_row = from_row + mv_row;
             int dest_col = from_col + mv_col;
             // -Wmaybe-redundant
@@ -41,7 +42,7 @@ void Board::get_pseudolegal_moves_from_sq(const int sq_num) {
             }
         }
 
-        for (const auto [mv_row, mv_col] : all_captures) {
+        for (const auto& [mv_row, mv_col] : all_captures) {
             int dest_row = from_row + mv_row;
             int dest_col = from_col + mv_col;
             // -Wmaybe-redundant
@@ -89,7 +90,7 @@ void Board::get_pseudolegal_moves_from_sq(const int sq_num) {
             all_moves = { {1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1} };
         }
 
-        for (const auto [mv_row, mv_col] : all_moves) {
+        for (const auto& [mv_row, mv_col] : all_moves) {
             int dest_row = from_row + mv_row;
             int dest_col = from_col + mv_col;
             if (0 <= dest_row && dest_row <= 7 && 0 <= dest_col && dest_col <= 7) {
@@ -114,7 +115,7 @@ void Board::get_pseudolegal_moves_from_sq(const int sq_num) {
             all_moves.push_back(std::make_pair(0, 1));
         }
 
-        for (const auto [mv_row, mv_col] : all_moves) {
+        for (const auto& [mv_row, mv_col] : all_moves) {
             int dest_row = from_row + mv_row;
             int dest_col = from_col + mv_col;
             while (0 <= dest_row && dest_row <= 7 && 0 <= dest_col && dest_col <= 7) {
@@ -137,7 +138,15 @@ void Board::get_pseudolegal_moves_from_sq(const int sq_num) {
 
 
 void Board::get_legal_moves() {
-    _legal_moves.clear();
+    STATS_INC(kLegalMoveGen);
+    STATS_TIMER(kTimerMoveGen);
+    const size_t ply = _move_history.size();
+    if (ply >= _legal_moves_stack.size()) {
+        _legal_moves_stack.resize(ply + 1);
+        _legal_moves_valid.resize(ply + 1, 0);
+    }
+    auto& legals = _legal_moves_stack[ply];
+    legals.clear();
     const auto& piece_set = (_to_move == 'w') ? _white_pieces : _black_pieces;
     for (const auto from_num : piece_set) {
         const auto& from_sq = _chessboard[from_num];
@@ -166,6 +175,7 @@ void Board::get_legal_moves() {
                 // illegal if king in check
                 if (is_in_check()) {
                     move_piece_internal(from_num + cs_dir, from_num);
+                    STATS_INC(kPseudolegalRejected);
                     continue;
                 }
                 // unmove the piece, then proceed as normal
@@ -173,7 +183,9 @@ void Board::get_legal_moves() {
             }
             move_piece_internal(from_num, to_num);
             if (!is_in_check()) {
-                _legal_moves.push_back(std::make_pair(from_num, to_num));
+                legals.push_back(std::make_pair(from_num, to_num));
+            } else {
+                STATS_INC(kPseudolegalRejected);
             }
             unmove_piece_internal(from_num, to_num, from_clr, from_piece, to_piece);
         }
@@ -181,4 +193,109 @@ void Board::get_legal_moves() {
         // printf("    board after:\n");
         // this->print();
     }
+    _legal_moves_valid[ply] = 1;
+}
+
+/**
+ * @brief Number of legal moves, promotions counted as four, without building the
+ * move list. Unless the side to move is in check, pseudolegal moves of unpinned
+ * pieces are counted without trying them; king moves, en passant and moves of
+ * pinned pieces are still tried.
+ */
+int Board::count_legal_moves() {
+    const size_t ply = _move_history.size();
+    if (ply < _legal_moves_valid.size() && _legal_moves_valid[ply]) {
+        int count = 0;
+        for (const auto& [from_num, to_num] : _legal_moves_stack[ply]) {
+            const bool promotion = _chessboard[from_num].piece() == 'p' && (to_num / 8 == 0 || to_num / 8 == 7);
+            count += promotion ? 4 : 1;
+        }
+        return count;
+    }
+
+    STATS_INC(kLegalMoveCount);
+    STATS_TIMER(kTimerMoveGen);
+    const bool in_check = is_in_check();
+    const int king_sq = (_to_move == 'w') ? _w_king_sq : _b_king_sq;
+    const int king_row = king_sq / 8;
+    const int king_col = king_sq % 8;
+    const char enemy_clr = (_to_move == 'w') ? 'b' : 'w';
+    // walks from the king through sq_num: pinned if the next piece behind it is
+    // an enemy slider moving along that line
+    const auto pinned = [&](const int sq_num) {
+        const int row_diff = sq_num / 8 - king_row;
+        const int col_diff = sq_num % 8 - king_col;
+        if (row_diff != 0 && col_diff != 0 && std::abs(row_diff) != std::abs(col_diff)) {
+            return false;
+        }
+        const int row_step = (row_diff > 0) - (row_diff < 0);
+        const int col_step = (col_diff > 0) - (col_diff < 0);
+        const char slider = (row_step != 0 && col_step != 0) ? 'b' : 'r';
+        bool behind = false;
+        for (int row = king_row + row_step, col = king_col + col_step; 0 <= row && row <= 7 && 0 <= col && col <= 7;
+             row += row_step, col += col_step) {
+            const auto& sq = _chessboard[row*8 + col];
+            if (sq.colour() == 'e') {
+                continue;
+            }
+            if (!behind) {
+                if (row*8 + col != sq_num) {
+                    return false;
+                }
+                behind = true;
+                continue;
+            }
+            return sq.colour() == enemy_clr && (sq.piece() == slider || sq.piece() == 'q');
+        }
+        return false;
+    };
+    const int promotion_row = (_to_move == 'w') ? 6 : 1;
+    int count = 0;
+    const auto& piece_set = (_to_move == 'w') ? _white_pieces : _black_pieces;
+    for (const auto from_num : piece_set) {
+        const auto& from_sq = _chessboard[from_num];
+        const char from_clr = from_sq.colour();
+        const char from_piece = from_sq.piece();
+        const int multiplier = (from_piece == 'p' && from_num / 8 == promotion_row) ? 4 : 1;
+
+        get_pseudolegal_moves_from_sq(from_num);
+
+        if (!in_check && from_piece != 'k' && !pinned(from_num)) {
+            if (from_piece == 'p' && _ep_square != -1) {
+                // the captured pawn may be pinned against the king instead
+                for (const auto to_num : _pseudolegal_move_targets) {
+                    if (to_num != _ep_square) {
+                        count += multiplier;
+                        continue;
+                    }
+                    move_piece_internal(from_num, to_num);
+                    count += !is_in_check();
+                    unmove_piece_internal(from_num, to_num, from_clr, from_piece, 'e');
+                }
+            } else {
+                count += multiplier * static_cast<int>(_pseudolegal_move_targets.size());
+            }
+            continue;
+        }
+
+        for (const auto to_num : _pseudolegal_move_targets) {
+            const char to_piece = _chessboard[to_num].piece();
+            // castling - checking king's passthrough square
+            if (from_piece == 'k' && std::abs(to_num - from_num) == 2) {
+                const int cs_dir = to_num > from_num ? 1 : -1;
+                move_piece_internal(from_num, from_num + cs_dir);
+                const bool passthrough_attacked = is_in_check();
+                move_piece_internal(from_num + cs_dir, from_num);
+                if (passthrough_attacked) {
+                    continue;
+                }
+            }
+            move_piece_internal(from_num, to_num);
+            if (!is_in_check()) {
+                count += multiplier;
+            }
+            unmove_piece_internal(from_num, to_num, from_clr, from_piece, to_piece);
+        }
+    }
+    return count;
 }
@@ -0,0 +1,341 @@
+// CRUDECHESS_NNUE_SCALAR keeps the portable loops on x86, to test the kernels against them
+#if defined(__AVX2__) && !defined(CRUDECHESS_NNUE_SCALAR)
+#define NNUE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) && !defined(CRUDECHESS_NNUE_SCALAR)
+#define NNUE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "board.hh"
+#include "eval.hh"
+#include "nnue.hh"
+
+#include "log.hh"
+
+
+namespace {
+    NNUE::network_t net;
+    bool net_loaded = false;
+    int net_generation = 0;
+
+    template <typename T>
+    bool read_values(std::ifstream& file, T* dst, const size_t count) {
+        file.read(reinterpret_cast<char*>(dst), count * sizeof(T));
+        return static_cast<bool>(file);
+    }
+
+    template <typename T>
+    void write_values(std::ofstream& file, const T* src, const size_t count) {
+        file.write(reinterpret_cast<const char*>(src), count * sizeof(T));
+    }
+}
+
+
+bool NNUE::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        LOG_WARNING("Cannot open network %s", path.c_str());
+        return false;
+    }
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t hidden = 0;
+    network_t loaded_net;
+    if (!read_values(file, magic, 4) || std::memcmp(magic, kFileMagic, 4) != 0 ||
+        !read_values(file, &version, 1) || version != kFileVersion ||
+        !read_values(file, &hidden, 1) || hidden == 0 || hidden % kHiddenAlign != 0 ||
+        !read_values(file, &loaded_net.scale, 1) || loaded_net.scale == 0) {
+        LOG_WARNING("Invalid network header in %s", path.c_str());
+        return false;
+    }
+    loaded_net.hidden = hidden;
+    loaded_net.ft_bias.resize(hidden);
+    loaded_net.ft_weights.resize(static_cast<size_t>(kFeatures) * hidden);
+    loaded_net.out_weights.resize(2 * hidden);
+    if (!read_values(file, loaded_net.ft_bias.data(), hidden) ||
+        !read_values(file, loaded_net.ft_weights.data(), loaded_net.ft_weights.size()) ||
+        !read_values(file, &loaded_net.out_bias, 1) ||
+        !read_values(file, loaded_net.out_weights.data(), loaded_net.out_weights.size())) {
+        LOG_WARNING("Truncated network file %s", path.c_str());
+        return false;
+    }
+    net = std::move(loaded_net);
+    net_loaded = true;
+    ++net_generation;
+    return true;
+}
+
+bool NNUE::save(const std::string& path, const network_t& network) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    const uint32_t version = kFileVersion;
+    const uint32_t hidden = network.hidden;
+    write_values(file, kFileMagic, 4);
+    write_values(file, &version, 1);
+    write_values(file, &hidden, 1);
+    write_values(file, &network.scale, 1);
+    write_values(file, network.ft_bias.data(), network.ft_bias.size());
+    write_values(file, network.ft_weights.data(), network.ft_weights.size());
+    write_values(file, &network.out_bias, 1);
+    write_values(file, network.out_weights.data(), network.out_weights.size());
+    return static_cast<bool>(file);
+}
+
+void NNUE::unload() {
+    net_loaded = false;
+    ++net_generation;
+}
+
+bool NNUE::loaded() {
+    return net_loaded;
+}
+
+int NNUE::generation() {
+    return net_generation;
+}
+
+const NNUE::network_t& NNUE::network() {
+    return net;
+}
+
+/**
+ * @brief Builds a test network that reproduces material and piece-square table
+ * evaluation (without kings and pawn structure). Own pieces of each type and file
+ * feed one hidden unit with (value + pst) / 8, which stays below the clipping
+ * limit for up to one queen per file; the output weights are +8 for the player
+ * to move and -8 for the opponent.
+ */
+NNUE::network_t NNUE::pst_network() {
+    network_t pst;
+    pst.hidden = 48;
+    pst.scale = 1;
+    pst.ft_bias.assign(pst.hidden, 0);
+    pst.ft_weights.assign(static_cast<size_t>(kFeatures) * pst.hidden, 0);
+    pst.out_weights.assign(2 * pst.hidden, 0);
+    const char types[5] { 'p', 'n', 'b', 'r', 'q' };
+    for (int king_sq = 0; king_sq < 64; ++king_sq) {
+        for (int t = 0; t < 5; ++t) {
+            for (int sq_num = 0; sq_num < 64; ++sq_num) {
+                // white perspective, own piece: the values are the same for black after the flip
+                const int feature = feature_index('w', king_sq, 'w', types[t], sq_num);
+                const int value = Eval::piece_value(types[t]) + Eval::pst_value('w', types[t], sq_num);
+                pst.ft_weights[static_cast<size_t>(feature) * pst.hidden + t*8 + sq_num % 8] = std::lround(value / 8.0);
+            }
+        }
+    }
+    for (int i = 0; i < 40; ++i) {
+        pst.out_weights[i] = 8;
+        pst.out_weights[pst.hidden + i] = -8;
+    }
+    return pst;
+}
+
+const char* NNUE::simd_name() {
+#if defined(NNUE_AVX2)
+    return "AVX2";
+#elif defined(NNUE_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+void NNUE::add_feature(int16_t* acc, const int feature) {
+    const int16_t* w = net.ft_weights.data() + static_cast<size_t>(feature) * net.hidden;
+#if defined(NNUE_AVX2)
+    for (int i = 0; i < net.hidden; i += 16) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_add_epi16(a, b));
+    }
+#elif defined(NNUE_SSE2)
+    for (int i = 0; i < net.hidden; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_add_epi16(a, b));
+    }
+#else
+    for (int i = 0; i < net.hidden; ++i) {
+        acc[i] += w[i];
+    }
+#endif
+}
+
+void NNUE::sub_feature(int16_t* acc, const int feature) {
+    const int16_t* w = net.ft_weights.data() + static_cast<size_t>(feature) * net.hidden;
+#if defined(NNUE_AVX2)
+    for (int i = 0; i < net.hidden; i += 16) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_sub_epi16(a, b));
+    }
+#elif defined(NNUE_SSE2)
+    for (int i = 0; i < net.hidden; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_sub_epi16(a, b));
+    }
+#else
+    for (int i = 0; i < net.hidden; ++i) {
+        acc[i] -= w[i];
+    }
+#endif
+}
+
+int32_t NNUE::output(const int16_t* us, const int16_t* them) {
+    const int hidden = net.hidden;
+    int32_t sum = net.out_bias;
+    for (int half = 0; half < 2; ++half) {
+        const int16_t* acc = half ? them : us;
+        const int16_t* w = net.out_weights.data() + half * hidden;
+#if defined(NNUE_AVX2)
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i limit = _mm256_set1_epi16(127);
+        __m256i total = _mm256_setzero_si256();
+        for (int i = 0; i < hidden; i += 16) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+            const __m256i clipped = _mm256_min_epi16(_mm256_max_epi16(a, zero), limit);
+            total = _mm256_add_epi32(total, _mm256_madd_epi16(clipped, b));
+        }
+        __m128i total128 = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+        total128 = _mm_add_epi32(total128, _mm_shuffle_epi32(total128, 0x4e));
+        total128 = _mm_add_epi32(total128, _mm_shuffle_epi32(total128, 0xb1));
+        sum += _mm_cvtsi128_si32(total128);
+#elif defined(NNUE_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i limit = _mm_set1_epi16(127);
+        __m128i total = _mm_setzero_si128();
+        for (int i = 0; i < hidden; i += 8) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+            const __m128i clipped = _mm_min_epi16(_mm_max_epi16(a, zero), limit);
+            total = _mm_add_epi32(total, _mm_madd_epi16(clipped, b));
+        }
+        total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4e));
+        total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xb1));
+        sum += _mm_cvtsi128_si32(total);
+#else
+        for (int i = 0; i < hidden; ++i) {
+            const int clipped = acc[i] < 0 ? 0 : (acc[i] > 127 ? 127 : acc[i]);
+            sum += clipped * w[i];
+        }
+#endif
+    }
+    return sum / net.scale;
+}
+
+
+int16_t* Board::nnue_accumulator(const int ply, const int perspective) {
+    const size_t hidden = NNUE::network().hidden;
+    const size_t needed = (ply + 1) * 2 * hidden;
+    if (_nnue_acc.size() < needed) {
+        _nnue_acc.resize(needed + 64 * 2 * hidden);
+        _nnue_computed.resize(_nnue_acc.size() / hidden, 0);
+    }
+    return _nnue_acc.data() + (ply * 2 + perspective) * hidden;
+}
+
+void Board::nnue_refresh(const int ply, const int perspective) {
+    const char persp_colour = perspective ? 'b' : 'w';
+    const int king_sq = perspective ? _b_king_sq : _w_king_sq;
+    int16_t* acc = nnue_accumulator(ply, perspective);
+    const auto& network = NNUE::network();
+    std::memcpy(acc, network.ft_bias.data(), network.hidden * sizeof(int16_t));
+    for (const auto& p_set : { &_white_pieces, &_black_pieces }) {
+        for (const auto sq_num : *p_set) {
+            const auto& sq = _chessboard[sq_num];
+            if (sq.piece() != 'k') {
+                NNUE::add_feature(acc, NNUE::feature_index(persp_colour, king_sq, sq.colour(), sq.piece(), sq_num));
+            }
+        }
+    }
+    _nnue_computed[ply * 2 + perspective] = 1;
+}
+
+/**
+ * @brief Derives the accumulators after a move from those before it. A king move
+ * leaves its own perspective to be refreshed lazily, in evaluate_nnue().
+ */
+void Board::nnue_update_internal(const char from_colour, const char from_piece, const int from_num, const int to_num,
+                                 const char placed_piece, const char to_piece, const char move_type) {
+    if (_nnue_generation != NNUE::generation()) {
+        std::fill(_nnue_computed.begin(), _nnue_computed.end(), 0);
+        _nnue_generation = NNUE::generation();
+    }
+    const int ply = _move_history.size();
+    const char their_colour = (from_colour == 'w') ? 'b' : 'w';
+    const size_t hidden = NNUE::network().hidden;
+    for (int perspective = 0; perspective < 2; ++perspective) {
+        int16_t* acc = nnue_accumulator(ply, perspective);
+        const int16_t* prev = nnue_accumulator(ply - 1, perspective);
+        const char persp_colour = perspective ? 'b' : 'w';
+        if (!_nnue_computed[(ply-1) * 2 + perspective] || (from_piece == 'k' && from_colour == persp_colour)) {
+            _nnue_computed[ply * 2 + perspective] = 0;
+            continue;
+        }
+        const int king_sq = perspective ? _b_king_sq : _w_king_sq;
+        const auto feature = [&](const char colour, const char piece, const int sq_num) {
+            return NNUE::feature_index(persp_colour, king_sq, colour, piece, sq_num);
+        };
+        std::memcpy(acc, prev, hidden * sizeof(int16_t));
+        if (from_piece != 'k') {
+            NNUE::sub_feature(acc, feature(from_colour, from_piece, from_num));
+            NNUE::add_feature(acc, feature(from_colour, placed_piece, to_num));
+        }
+        if (to_piece != 'e') {
+            NNUE::sub_feature(acc, feature(their_colour, to_piece, to_num));
+        }
+        if (move_type == 'e') {
+            NNUE::sub_feature(acc, feature(their_colour, 'p', to_num > from_num ? to_num - 8 : to_num + 8));
+        } else if (move_type == 'c') {
+            const int rook_from = (to_num > from_num) ? from_num + 3 : from_num - 4;
+            const int rook_to = (to_num > from_num) ? from_num + 1 : from_num - 1;
+            NNUE::sub_feature(acc, feature(from_colour, 'r', rook_from));
+            NNUE::add_feature(acc, feature(from_colour, 'r', rook_to));
+        }
+        _nnue_computed[ply * 2 + perspective] = 1;
+    }
+}
+
+/**
+ * @brief The pieces do not move on a null move: the accumulators are copied.
+ */
+void Board::nnue_null_move_internal() {
+    if (_nnue_generation != NNUE::generation()) {
+        std::fill(_nnue_computed.begin(), _nnue_computed.end(), 0);
+        _nnue_generation = NNUE::generation();
+    }
+    const int ply = _move_history.size();
+    const size_t hidden = NNUE::network().hidden;
+    for (int perspective = 0; perspective < 2; ++perspective) {
+        int16_t* acc = nnue_accumulator(ply, perspective);
+        _nnue_computed[ply * 2 + perspective] = _nnue_computed[(ply-1) * 2 + perspective];
+        if (_nnue_computed[ply * 2 + perspective]) {
+            std::memcpy(acc, nnue_accumulator(ply - 1, perspective), hidden * sizeof(int16_t));
+        }
+    }
+}
+
+int Board::evaluate_nnue() {
+    if (_nnue_generation != NNUE::generation()) {
+        std::fill(_nnue_computed.begin(), _nnue_computed.end(), 0);
+        _nnue_generation = NNUE::generation();
+    }
+    const int ply = _move_history.size();
+    nnue_accumulator(ply, 1);
+    for (int perspective = 0; perspective < 2; ++perspective) {
+        if (!_nnue_computed[ply * 2 + perspective]) {
+            nnue_refresh(ply, perspective);
+        }
+    }
+    const int us = (_to_move == 'w') ? 0 : 1;
+    return NNUE::output(nnue_accumulator(ply, us), nnue_accumulator(ply, 1 - us));
+}
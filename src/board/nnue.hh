@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Efficiently updatable neural network evaluation
+// Input features are HalfKP: for each perspective (white, black), one feature per
+// non-king piece, indexed by that perspective's king square, the piece (own/their
+// pawn, knight, bishop, rook, queen) and its square. Black's perspective sees the
+// board with ranks flipped, so both perspectives look alike.
+//     feature = king_sq * 641 + 1 + piece_idx * 64 + sq,   piece_idx = type*2 + (own ? 0 : 1)
+// The feature transformer sums the int16 weight rows of active features into an
+// accumulator of `hidden' int16 values per perspective. Only the pieces changed by
+// a move need to be added or removed, except when a king moves (full refresh of
+// that perspective).
+// Output: both accumulators (player to move first) are clipped to [0, 127] and
+// dotted with the int16 output weights:
+//     eval = (out_bias + sum(out_weights[i] * clip(acc[i]))) / scale   [centipawns]
+//
+// Weights file, little-endian:
+//     char[4] "CCNN", uint32 version (1), uint32 hidden (multiple of 16), int32 scale,
+//     int16 ft_bias[hidden], int16 ft_weights[kFeatures][hidden],
+//     int32 out_bias, int16 out_weights[2*hidden]
+namespace NNUE {
+    static constexpr int kKingBuckets { 64 };
+    static constexpr int kFeaturesPerKing { 641 };
+    static constexpr int kFeatures { kKingBuckets * kFeaturesPerKing };
+    static constexpr int kHiddenAlign { 16 };
+    static constexpr char kFileMagic[4] { 'C', 'C', 'N', 'N' };
+    static constexpr uint32_t kFileVersion { 1 };
+
+    struct network_t {
+        int hidden = 0;
+        int32_t scale = 1;
+        std::vector<int16_t> ft_bias;
+        std::vector<int16_t> ft_weights;
+        int32_t out_bias = 0;
+        std::vector<int16_t> out_weights;
+    };
+
+    bool load(const std::string& path);
+    bool save(const std::string& path, const network_t& net);
+    void unload();
+    bool loaded();
+    int generation();
+    const network_t& network();
+    network_t pst_network();
+    const char* simd_name();
+
+    // perspective and piece colours are 'w' or 'b'
+    inline int feature_index(const char perspective, const int king_sq, const char colour, const char piece, const int sq_num) {
+        int type = 0;
+        switch (piece) {
+            case 'p':   type = 0; break;
+            case 'n':   type = 1; break;
+            case 'b':   type = 2; break;
+            case 'r':   type = 3; break;
+            case 'q':   type = 4; break;
+        }
+        const int flip = (perspective == 'w') ? 0 : 56;
+        return (king_sq ^ flip) * kFeaturesPerKing + 1 + (type*2 + (colour == perspective ? 0 : 1)) * 64 + (sq_num ^ flip);
+    }
+
+    void add_feature(int16_t* acc, const int feature);
+    void sub_feature(int16_t* acc, const int feature);
+    int32_t output(const int16_t* us, const int16_t* them);
+}
@@ -0,0 +1,311 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "board.hh"
+#include "gamedb.hh"
+#include "packed.hh"
+
+#include "log.hh"
+
+
+namespace {
+    constexpr char kPieceCodes[8] { 'e', 'p', 'n', 'b', 'r', 'q', 'k', 'e' };
+    constexpr size_t kWriteBatch { 4096 };
+
+    inline uint8_t piece_code(const char colour, const char piece) {
+        uint8_t code = 0;
+        switch (piece) {
+            case 'p':   code = 1; break;
+            case 'n':   code = 2; break;
+            case 'b':   code = 3; break;
+            case 'r':   code = 4; break;
+            case 'q':   code = 5; break;
+            case 'k':   code = 6; break;
+        }
+        return (colour == 'b') ? code | 8 : code;
+    }
+
+    /**
+     * @brief Insert-only set of position hashes shared by all generator threads:
+     * open addressing over atomic slots, 0 marks an empty slot.
+     */
+    class HashSet {
+    public:
+        explicit HashSet(const uint64_t expected) {
+            const uint64_t size = std::bit_ceil(std::max<uint64_t>(expected * 2, 1 << 16));
+            _slots = std::make_unique<std::atomic<uint64_t>[]>(size);
+            _mask = size - 1;
+        }
+
+        // false if the key was present already
+        bool insert(uint64_t key) {
+            key = key ? key : 1;
+            uint64_t idx = key & _mask;
+            while (true) {
+                uint64_t current = _slots[idx].load(std::memory_order_relaxed);
+                if (current == key) {
+                    return false;
+                }
+                if (current == 0) {
+                    if (_slots[idx].compare_exchange_strong(current, key, std::memory_order_relaxed)) {
+                        return true;
+                    }
+                    if (current == key) {
+                        return false;
+                    }
+                }
+                idx = (idx + 1) & _mask;
+            }
+        }
+
+    private:
+        std::unique_ptr<std::atomic<uint64_t>[]> _slots;
+        uint64_t _mask;
+    };
+
+    uint8_t game_result(Board& board) {
+        switch (board.game_end()) {
+            case kGameCheckmate:
+                return board.to_move() == 'w' ? GameDb::kResultBlack : GameDb::kResultWhite;
+            case kGameOngoing:
+                return GameDb::kResultUnknown;
+            default:
+                return GameDb::kResultDraw;
+        }
+    }
+
+    void play_random_move(Board& board, std::mt19937_64& rng) {
+        const auto& moves = board.legal_moves();
+        const auto [from_num, to_num] = moves[rng() % moves.size()];
+        const char promotions[4] { 'q', 'r', 'b', 'n' };
+        board.play_move(from_num, to_num, promotions[rng() % 4]);
+    }
+}
+
+
+/**
+ * @brief Packs the current position into a 32-byte record; score and result are
+ * left at zero.
+ *
+ * @return false for positions with more than 32 pieces
+ */
+bool Board::encode_packed(Packed::packed_position_t& pos) const {
+    std::memset(&pos, 0, sizeof(pos));
+    int count = 0;
+    for (int sq_num = 0; sq_num < 64; ++sq_num) {
+        const auto& sq = _chessboard[sq_num];
+        if (sq.colour() == 'e') {
+            continue;
+        }
+        if (count == Packed::kMaxPieces) {
+            return false;
+        }
+        pos.occupancy |= 1ULL << sq_num;
+        pos.pieces[count / 2] |= piece_code(sq.colour(), sq.piece()) << (4 * (count % 2));
+        ++count;
+    }
+    pos.flags = (_to_move == 'b' ? 1 : 0) | (_castling_rights << 1);
+    pos.ep_square = (_ep_square == -1) ? Packed::kNoEpSquare : _ep_square;
+    pos.halfmove_clock = std::min(_halfmove_clock, 255);
+    pos.fullmove_counter = std::min(_fullmove_counter, 65535);
+    return true;
+}
+
+/**
+ * @brief Sets up the position of a packed record, without going through FEN.
+ *
+ * @return false (and an empty board) for malformed records and for boards that
+ * fail position_legal (kings, pawns on the back ranks, castling rights, en
+ * passant square)
+ */
+bool Board::decode_packed(const Packed::packed_position_t& pos) {
+    clear_board();
+    if (std::popcount(pos.occupancy) > Packed::kMaxPieces || (pos.ep_square != Packed::kNoEpSquare && pos.ep_square > 63)
+        || (pos.flags >> 5)) {
+        return false;
+    }
+    int count = 0;
+    for (uint64_t occupancy = pos.occupancy; occupancy; occupancy &= occupancy - 1, ++count) {
+        const int sq_num = std::countr_zero(occupancy);
+        const uint8_t code = (pos.pieces[count / 2] >> (4 * (count % 2))) & 0xf;
+        const char piece = kPieceCodes[code & 7];
+        if (piece == 'e') {
+            clear_board();
+            return false;
+        }
+        const char colour = (code & 8) ? 'b' : 'w';
+        add_piece_internal(colour, piece, sq_num);
+        update_piece_sets_internal(colour, -1, sq_num);
+    }
+    if (_w_king_sq == -1 || _b_king_sq == -1) {
+        clear_board();
+        return false;
+    }
+    _to_move = (pos.flags & 1) ? 'b' : 'w';
+    _castling_rights = (pos.flags >> 1) & 15;
+    _ep_square = (pos.ep_square == Packed::kNoEpSquare) ? -1 : pos.ep_square;
+    _halfmove_clock = pos.halfmove_clock;
+    _fullmove_counter = pos.fullmove_counter;
+    if (!position_legal()) {
+        clear_board();
+        return false;
+    }
+    _hash = compute_hash(false);
+    _pawn_hash = compute_hash(true);
+    return true;
+}
+
+
+/**
+ * @brief Generates a deduplicated position dataset. Random play labels positions
+ * with the result of the game they come from (unknown when it hits the length
+ * cap); perft sampling takes the end of a random walk of random depth, without a
+ * result. Every thread streams its records to the file in batches.
+ */
+bool Packed::generate(const generator_config_t& config) {
+    FILE* file = fopen(config.path.c_str(), "wb");
+    if (!file) {
+        LOG_ERROR("Cannot write %s", config.path.c_str());
+        return false;
+    }
+    Board start_board;
+    packed_position_t start;
+    start_board.encode_packed(start);
+
+    HashSet seen(config.count);
+    std::mutex file_mutex;
+    std::atomic<uint64_t> written { 0 };
+    std::atomic<uint64_t> duplicates { 0 };
+    std::atomic<uint64_t> games { 0 };
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+
+    const auto work = [&](const int thread_id) {
+        Board board;
+        std::mt19937_64 rng(config.seed * 0x9e3779b97f4a7c15ULL + thread_id);
+        std::vector<std::pair<packed_position_t, uint64_t>> game_positions;
+        std::vector<packed_position_t> buffer;
+        buffer.reserve(kWriteBatch);
+        const auto flush = [&] {
+            std::lock_guard lock(file_mutex);
+            fwrite(buffer.data(), sizeof(packed_position_t), buffer.size(), file);
+            buffer.clear();
+        };
+        bool done = false;
+        while (!done) {
+            board.decode_packed(start);
+            game_positions.clear();
+            packed_position_t pos;
+            if (config.mode == kModeRandomPlay) {
+                for (int ply = 0; ply < config.max_ply && board.game_end() == kGameOngoing; ++ply) {
+                    if (ply >= config.min_ply && board.encode_packed(pos)) {
+                        game_positions.emplace_back(pos, board.hash());
+                    }
+                    play_random_move(board, rng);
+                }
+                if (board.encode_packed(pos)) {
+                    game_positions.emplace_back(pos, board.hash());
+                }
+            } else {
+                const int depth = 1 + rng() % config.max_ply;
+                for (int ply = 0; ply < depth && !board.legal_moves().empty(); ++ply) {
+                    play_random_move(board, rng);
+                }
+                if (board.encode_packed(pos)) {
+                    game_positions.emplace_back(pos, board.hash());
+                }
+            }
+            ++games;
+
+            const uint8_t result = (config.mode == kModeRandomPlay) ? game_result(board) : static_cast<uint8_t>(GameDb::kResultUnknown);
+            for (auto& [packed, hash] : game_positions) {
+                if (!seen.insert(hash)) {
+                    ++duplicates;
+                    continue;
+                }
+                if (written.fetch_add(1) >= config.count) {
+                    done = true;
+                    break;
+                }
+                packed.result = result;
+                buffer.push_back(packed);
+                if (buffer.size() == kWriteBatch) {
+                    flush();
+                }
+            }
+        }
+        flush();
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < config.threads; ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& th : workers) {
+        th.join();
+    }
+    const bool ok = (fclose(file) == 0);
+
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    const double hours = t_tm.count() / 3600000.0;
+    printf("Positions: %lu \tDuplicates skipped: %lu \tGames: %lu \tTime: %.2lf ms \tPositions/hour: %.0lf\n",
+           config.count, duplicates.load(), games.load(), t_tm.count(), hours > 0 ? config.count / hours : 0.0);
+    return ok;
+}
+
+/**
+ * @brief Decodes every record of a dataset and checks that it packs back to the
+ * same bytes.
+ */
+bool Packed::check(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size % sizeof(packed_position_t) != 0) {
+        LOG_ERROR("Not a packed position file: %s", path.c_str());
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    const uint64_t count = st.st_size / sizeof(packed_position_t);
+    void* map = count ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const auto* records = static_cast<const packed_position_t*>(map);
+    Board board;
+    uint64_t bad = 0;
+    uint64_t results[4] { 0, 0, 0, 0 };
+    for (uint64_t i = 0; i < count; ++i) {
+        packed_position_t repacked;
+        if (!board.decode_packed(records[i]) || !board.encode_packed(repacked)) {
+            ++bad;
+            continue;
+        }
+        repacked.score = records[i].score;
+        repacked.result = records[i].result;
+        if (std::memcmp(&repacked, &records[i], sizeof(repacked)) != 0) {
+            ++bad;
+        }
+        ++results[records[i].result & 3];
+    }
+    if (map) {
+        munmap(map, st.st_size);
+    }
+    printf("Positions: %lu (%lu bad) \tWhite wins: %lu \tBlack wins: %lu \tDraws: %lu \tUnknown: %lu\n", count, bad,
+           results[GameDb::kResultWhite], results[GameDb::kResultBlack], results[GameDb::kResultDraw], results[GameDb::kResultUnknown]);
+    return bad == 0;
+}
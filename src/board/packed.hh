@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Packed positions (.ccpk)
+// A 32-byte record: the occupancy bitboard, then one 4-bit code per occupied
+// square in ascending square order (low nibble first; 1-6 white pawn, knight,
+// bishop, rook, queen, king, 9-14 black), the fullmove counter, a score slot, side
+// to move and castling rights (bit 0 black to move, bits 1-4 castling rights as in
+// Board), en passant square (255 for none), halfmove clock and game result
+// (GameDb::result_t). A dataset file is a plain array of records, so files can be
+// concatenated.
+namespace Packed {
+    static constexpr uint8_t kNoEpSquare { 255 };
+    static constexpr int kMaxPieces { 32 };
+
+    struct packed_position_t {
+        uint64_t occupancy;
+        uint8_t pieces[16];
+        uint16_t fullmove_counter;
+        int16_t score;          // centipawns from white's point of view, if known
+        uint8_t flags;
+        uint8_t ep_square;
+        uint8_t halfmove_clock;
+        uint8_t result;
+    };
+    static_assert(sizeof(packed_position_t) == 32);
+
+    enum generator_mode_t {
+        kModeRandomPlay = 0,
+        kModePerftSample
+    };
+
+    struct generator_config_t {
+        std::string path;
+        uint64_t count = 0;
+        int threads = 1;
+        generator_mode_t mode = kModeRandomPlay;
+        uint64_t seed = 1;
+        int min_ply = 8;        // random play: positions from earlier plies are skipped
+        int max_ply = 300;      // random play: game length cap, perft sampling: maximum depth
+    };
+
+    bool generate(const generator_config_t& config);
+    bool check(const std::string& path);
+}
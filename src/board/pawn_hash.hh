@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include "memory.hh"
+#include "zobrist.hh"
+
+
+// Cached result of pawn structure evaluation for a single pawn skeleton.
+// shelter_rank[c][f] is the relative rank (1-6) of the rearmost pawn of colour c
+// (0 - white, 1 - black) on file f, or 0 if there is none. King shelter is scored
+// from it without rescanning pawns, so it does not need kings in the key.
+struct pawn_entry_t {
+    Zobrist::key_t key;
+    int16_t score;
+    uint8_t shelter_rank[2][8];
+};
+
+
+class PawnHashTable {
+public:
+    static constexpr size_t kDefaultEntries { 1 << 14 };
+
+    // the table is allocated on the first probe: most boards (perft, move
+    // generation, replays) never evaluate a position
+    explicit PawnHashTable(const size_t entries = kDefaultEntries) {
+        _entries = 1;
+        while (_entries < entries) {
+            _entries <<= 1;
+        }
+    }
+
+    // Returns the slot for a given key; `hit' tells whether it already holds its evaluation.
+    pawn_entry_t& probe(const Zobrist::key_t key, bool& hit) {
+        if (!_table.size()) {
+            allocate();
+        }
+        auto& entry = _table[key & _mask];
+        hit = (entry.key == key);
+        ++_probes;
+        if (hit) {
+            ++_hits;
+        }
+        return entry;
+    }
+
+    void prefetch(const Zobrist::key_t key) const {
+        if (_table.size()) {
+            Memory::prefetch(&_table[key & _mask]);
+        }
+    }
+
+    uint64_t probes() const { return _probes; }
+    uint64_t hits() const { return _hits; }
+    void clear_stats() { _probes = 0; _hits = 0; }
+
+private:
+    void allocate() {
+        _table = Memory::LargeArray<pawn_entry_t>(_entries);
+        _mask = _table.size() - 1;
+        // key 0 is a valid pawn key (no pawns on board), mark empty slots differently
+        for (auto& entry : _table) {
+            entry.key = ~Zobrist::key_t(0);
+        }
+    }
+
+    Memory::LargeArray<pawn_entry_t> _table;
+    size_t _entries;
+    size_t _mask = 0;
+    uint64_t _probes = 0;
+    uint64_t _hits = 0;
+};
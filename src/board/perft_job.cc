@@ -0,0 +1,349 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "board.hh"
+#include "perft_job.hh"
+#include "pgn.hh"
+
+#include "log.hh"
+
+
+namespace {
+    constexpr double kReportMs { 1000.0 };
+
+    struct position_t {
+        std::string fen;
+        int64_t expected;
+        size_t first_unit;
+        size_t unit_count;
+    };
+
+    // the claiming process and a token of its run, so that a claim outlives
+    // neither its process nor a later process given the same pid
+    struct claim_t {
+        pid_t pid = 0;
+        uint64_t token = 0;     // process start time, a random nonce without /proc, 0 in old checkpoints
+    };
+
+    struct unit_t {
+        int position;
+        Pgn::move_t move;
+        int64_t nodes = -1;     // -1 until done
+        claim_t claim {};
+    };
+
+    std::string unit_key(const int position, const int from_num, const int to_num, const char promote_to) {
+        return std::to_string(position) + " " + std::to_string(from_num) + " " + std::to_string(to_num) + " " + promote_to;
+    }
+
+    // clock ticks from boot to the start of the process, field 22 of /proc/<pid>/stat; 0 if unknown
+    uint64_t process_start_time(const pid_t pid) {
+        std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+        std::string text;
+        if (!std::getline(file, text)) {
+            return 0;
+        }
+        // field 2 is the command name in parentheses, which may hold spaces
+        const size_t comm_end = text.rfind(')');
+        if (comm_end == std::string::npos) {
+            return 0;
+        }
+        std::istringstream in(text.substr(comm_end + 1));
+        std::string field;
+        for (int i = 3; i < 22 && in >> field; ++i) {
+        }
+        uint64_t start_time = 0;
+        in >> start_time;
+        return start_time;
+    }
+
+    claim_t own_claim() {
+        claim_t claim { getpid(), process_start_time(getpid()) };
+        if (claim.token == 0) {
+            std::random_device device;
+            claim.token = (static_cast<uint64_t>(device()) << 32 | device()) | 1;
+        }
+        return claim;
+    }
+
+    bool claim_alive(const claim_t& claim, const claim_t& own) {
+        if (claim.pid <= 0) {
+            return false;
+        }
+        // our pid in a claim of an earlier run: that process is gone
+        if (claim.pid == own.pid) {
+            return claim.token == own.token;
+        }
+        if (kill(claim.pid, 0) != 0 && errno != EPERM) {
+            return false;
+        }
+        // a live process with another start time reused the pid of the claimant
+        const uint64_t start_time = process_start_time(claim.pid);
+        return claim.token == 0 || start_time == 0 || start_time == claim.token;
+    }
+
+    class Checkpoint {
+    public:
+        explicit Checkpoint(std::vector<unit_t>& units) : _units(units) {
+            for (size_t i = 0; i < _units.size(); ++i) {
+                const auto& move = _units[i].move;
+                _index.emplace(unit_key(_units[i].position, move.from_num, move.to_num, move.promote_to), i);
+            }
+        }
+        ~Checkpoint() {
+            if (_fd >= 0) {
+                close(_fd);
+            }
+        }
+
+        bool open(const std::string& path) {
+            _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+            return _fd >= 0;
+        }
+        void lock() { flock(_fd, LOCK_EX); }
+        void unlock() { flock(_fd, LOCK_UN); }
+
+        // parses the lines appended since the last call (the lock must be held)
+        bool read_new() {
+            char buffer[1 << 16];
+            ssize_t n;
+            while ((n = pread(_fd, buffer, sizeof(buffer), _offset + _pending.size())) > 0) {
+                _pending.append(buffer, n);
+            }
+            if (n < 0) {
+                return false;
+            }
+            size_t start = 0;
+            size_t end;
+            while ((end = _pending.find('\n', start)) != std::string::npos) {
+                parse_line(_pending.substr(start, end - start));
+                start = end + 1;
+            }
+            _offset += start;
+            _pending.erase(0, start);
+            return true;
+        }
+
+        // a torn line left by a crash is terminated so that appends start on a new line
+        bool terminate_torn_line() {
+            const std::string newline("\n");
+            return _pending.empty() || (write(_fd, newline.data(), 1) == 1 && read_new());
+        }
+
+        // lines end with ';', so that a torn line is never mistaken for a record
+        bool append(const std::string& line) {
+            const std::string text = line + ";\n";
+            if (write(_fd, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+                return false;
+            }
+            return read_new();
+        }
+
+        bool sync() { return fsync(_fd) == 0; }
+
+        int job_depth() const { return _job_depth; }
+        size_t job_units() const { return _job_units; }
+        bool empty() const { return _offset == 0 && _pending.empty(); }
+
+    private:
+        void parse_line(const std::string& line) {
+            if (line.empty() || line.back() != ';') {
+                return;
+            }
+            std::istringstream in(line.substr(0, line.size() - 1));
+            std::string kind;
+            in >> kind;
+            if (kind == "job") {
+                in >> _job_depth >> _job_units;
+                return;
+            }
+            int position, from_num, to_num;
+            char promote_to;
+            int64_t value;
+            if (!(in >> position >> from_num >> to_num >> promote_to >> value)) {
+                return;
+            }
+            uint64_t token = 0;
+            in >> token;
+            const auto it = _index.find(unit_key(position, from_num, to_num, promote_to));
+            if (it == _index.end()) {
+                return;
+            }
+            if (kind == "claim") {
+                _units[it->second].claim = { static_cast<pid_t>(value), token };
+            } else if (kind == "done") {
+                _units[it->second].nodes = value;
+            }
+        }
+
+        std::vector<unit_t>& _units;
+        std::map<std::string, size_t> _index;
+        int _fd = -1;
+        uint64_t _offset = 0;
+        std::string _pending;
+        int _job_depth = -1;
+        size_t _job_units = 0;
+    };
+
+    bool load_positions(const std::string& path, const int depth, Board& board, std::vector<position_t>& positions,
+                        std::vector<unit_t>& units) {
+        std::ifstream file(path);
+        if (!file) {
+            return false;
+        }
+        std::string line;
+        std::vector<Pgn::move_t> moves;
+        while (std::getline(file, line)) {
+            std::stringstream linestream(line);
+            std::vector<std::string> fields;
+            std::string field;
+            while (std::getline(linestream, field, ',') && !field.empty() && field[0] != '#') {
+                fields.push_back(field);
+            }
+            if (static_cast<int>(fields.size()) <= depth) {
+                continue;
+            }
+            if (!board.set_fen(fields[0])) {
+                LOG_WARNING("Skipping illegal position %s", fields[0].c_str());
+                continue;
+            }
+            board.canonical_moves(moves);
+            const int position = positions.size() + 1;
+            positions.push_back({ fields[0], std::stoll(fields[depth]), units.size(), moves.size() });
+            for (const auto& move : moves) {
+                units.push_back({ position, move });
+            }
+        }
+        return true;
+    }
+}
+
+
+/**
+ * @brief Claims and runs free units until none is left, then reports the
+ * positions whose units are all done.
+ */
+bool PerftJob::run(const std::string& checkpoint_path, const std::string& test_file_path, const int depth) {
+    Board board;
+    std::vector<position_t> positions;
+    std::vector<unit_t> units;
+    if (!load_positions(test_file_path, depth, board, positions, units)) {
+        LOG_ERROR("Cannot read %s", test_file_path.c_str());
+        return false;
+    }
+    Checkpoint checkpoint(units);
+    if (!checkpoint.open(checkpoint_path)) {
+        LOG_ERROR("Cannot open %s", checkpoint_path.c_str());
+        return false;
+    }
+    checkpoint.lock();
+    bool ok = checkpoint.read_new() && checkpoint.terminate_torn_line();
+    if (ok && checkpoint.empty()) {
+        ok = checkpoint.append("job " + std::to_string(depth) + " " + std::to_string(units.size()) + " " + test_file_path);
+    }
+    checkpoint.unlock();
+    if (!ok) {
+        LOG_ERROR("Cannot use %s", checkpoint_path.c_str());
+        return false;
+    }
+    if (checkpoint.job_depth() != depth || checkpoint.job_units() != units.size()) {
+        LOG_ERROR("%s belongs to another job (depth %d, %lu units)", checkpoint_path.c_str(), checkpoint.job_depth(),
+                  checkpoint.job_units());
+        return false;
+    }
+
+    const claim_t own = own_claim();
+    uint64_t units_run = 0;
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    size_t next = 0;
+    while (true) {
+        checkpoint.lock();
+        ok = checkpoint.read_new();
+        // units skipped as claimed are looked at again once the end is reached,
+        // their process may have died since
+        const auto is_free = [&units, &own](const size_t i) { return units[i].nodes < 0 && !claim_alive(units[i].claim, own); };
+        while (next < units.size() && !is_free(next)) {
+            ++next;
+        }
+        for (size_t i = 0; next == units.size() && i < units.size(); ++i) {
+            if (is_free(i)) {
+                next = i;
+            }
+        }
+        if (!ok || next == units.size()) {
+            checkpoint.unlock();
+            break;
+        }
+        auto& unit = units[next];
+        const std::string key = unit_key(unit.position, unit.move.from_num, unit.move.to_num, unit.move.promote_to);
+        ok = checkpoint.append("claim " + key + " " + std::to_string(own.pid) + " " + std::to_string(own.token));
+        checkpoint.unlock();
+        if (!ok) {
+            break;
+        }
+
+        const auto u_tm = std::chrono::high_resolution_clock::now();
+        board.set_fen(positions[unit.position - 1].fen);
+        const std::string san = board.move_to_san(unit.move.from_num, unit.move.to_num, unit.move.promote_to);
+        board.play_move(unit.move.from_num, unit.move.to_num, unit.move.promote_to);
+        const int64_t nodes = board.perft(depth - 1);
+        const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - u_tm;
+
+        checkpoint.lock();
+        ok = checkpoint.append("done " + key + " " + std::to_string(nodes)) && checkpoint.sync();
+        checkpoint.unlock();
+        if (!ok) {
+            break;
+        }
+        ++units_run;
+        if (t_tm.count() >= kReportMs) {
+            printf("Position %d, %s: %ld nodes (%.2lf ms)\n", unit.position, san.c_str(), nodes, t_tm.count());
+        }
+    }
+    if (!ok) {
+        LOG_ERROR("Cannot update %s", checkpoint_path.c_str());
+        return false;
+    }
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+
+    int passed = 0;
+    int failed = 0;
+    uint64_t units_pending = 0;
+    for (size_t p = 0; p < positions.size(); ++p) {
+        const auto& position = positions[p];
+        int64_t nodes = 0;
+        bool complete = true;
+        for (size_t i = position.first_unit; i < position.first_unit + position.unit_count; ++i) {
+            if (units[i].nodes < 0) {
+                complete = false;
+                ++units_pending;
+            } else {
+                nodes += units[i].nodes;
+            }
+        }
+        if (!complete) {
+            continue;
+        }
+        if (nodes == position.expected) {
+            ++passed;
+        } else {
+            ++failed;
+            printf("[ FAIL ] Position %lu (%s): expected %ld, got %ld\n", p + 1, position.fen.c_str(), position.expected, nodes);
+        }
+    }
+    printf("Depth %d: %d/%lu positions passed, %d failed, %lu incomplete (%lu units left to other processes) \tUnits run: %lu \tTime: %.2lf ms\n",
+           depth, passed, positions.size(), failed, positions.size() - passed - failed, units_pending, units_run, t_tm.count());
+    return failed == 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+// Checkpointed perft runs
+// A run verifies every position of a perft test file at one depth. The work is
+// split into units, one per root move (promotions expanded) of every position
+// that has an expected count at that depth, in file order. A unit's result is
+// perft(depth - 1) after its move.
+//
+// Progress lives in an append-only text checkpoint file, shared by all processes
+// working on the run:
+//     job <depth> <units> <test file>;
+//     claim <position> <from> <to> <promote_to> <pid> <token>;
+//     done <position> <from> <to> <promote_to> <nodes>;
+// Units are claimed under an exclusive flock, so several processes on one host can
+// pull work from the same file. A unit is free unless it is done or claimed by a
+// process that is still alive, so a restarted run only redoes the units that were
+// in progress when it died. The token is the start time of the claimant (field 22
+// of /proc/<pid>/stat, a random nonce where /proc is missing): a claim is dead once
+// its pid runs a process with another start time, and a claim with our own pid but
+// another token was left by an earlier run. A line without its ';' (torn by a
+// crash) is ignored.
+namespace PerftJob {
+    // returns false on I/O errors, a checkpoint of another job or failed positions
+    bool run(const std::string& checkpoint_path, const std::string& test_file_path, const int depth);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#include "memory.hh"
+#include "zobrist.hh"
+
+// Perft transposition table
+// Buckets of four entries fill one cache line. An entry matches on the full key
+// and depth; a store replaces the entry of the same key, else the shallowest one.
+// The key is stored xor-ed with the data, so that a torn entry written by another
+// thread never matches and the table can be shared without locks.
+class PerftTable {
+public:
+    struct entry_t {
+        Zobrist::key_t check;   // key ^ data
+        uint64_t data;          // count << 8 | depth
+    };
+
+    struct alignas(Memory::kCacheLineSize) bucket_t {
+        entry_t entries[4];
+    };
+
+    explicit PerftTable(const size_t megabytes) {
+        const size_t buckets = (megabytes << 20) / sizeof(bucket_t);
+        size_t size = 1;
+        while (size * 2 <= buckets) {
+            size <<= 1;
+        }
+        _table = Memory::LargeArray<bucket_t>(size);
+        _mask = _table.size() ? _table.size() - 1 : 0;
+    }
+
+    bool probe(const Zobrist::key_t key, const int depth, int64_t& count) const {
+        const auto& bucket = _table[key & _mask];
+        for (const auto& entry : bucket.entries) {
+            if ((entry.check ^ entry.data) == key && static_cast<int>(entry.data & 0xff) == depth) {
+                count = entry.data >> 8;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void store(const Zobrist::key_t key, const int depth, const int64_t count) {
+        auto& bucket = _table[key & _mask];
+        entry_t* victim = &bucket.entries[0];
+        for (auto& entry : bucket.entries) {
+            if ((entry.check ^ entry.data) == key) {
+                victim = &entry;
+                break;
+            }
+            if ((entry.data & 0xff) < (victim->data & 0xff)) {
+                victim = &entry;
+            }
+        }
+        const uint64_t data = static_cast<uint64_t>(count) << 8 | depth;
+        *victim = { key ^ data, data };
+    }
+
+    void prefetch(const Zobrist::key_t key) const {
+        Memory::prefetch(&_table[key & _mask]);
+    }
+
+    size_t size() const { return _table.size(); }
+
+private:
+    Memory::LargeArray<bucket_t> _table;
+    size_t _mask = 0;
+};
@@ -0,0 +1,488 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "board.hh"
+#include "fen.hh"
+#include "pgn.hh"
+
+#include "log.hh"
+
+
+namespace {
+    struct game_span_t {
+        std::string_view text;
+        uint64_t index;
+        uint64_t line;
+    };
+
+    /**
+     * @brief Cuts a mapped PGN file into games. Only looks for line starts and
+     * braces, so handing out batches under a lock is cheap compared to replaying
+     * them.
+     */
+    class GameScanner {
+    public:
+        GameScanner(const char* data, const size_t size) : _data(data), _size(size) {}
+
+        bool next_batch(std::vector<game_span_t>& batch, const int count) {
+            std::lock_guard lock(_mutex);
+            batch.clear();
+            game_span_t span;
+            while (static_cast<int>(batch.size()) < count && next_game(span)) {
+                batch.push_back(span);
+            }
+            return !batch.empty();
+        }
+
+    private:
+        bool next_game(game_span_t& span) {
+            while (_pos < _size && std::isspace(static_cast<unsigned char>(_data[_pos]))) {
+                if (_data[_pos] == '\n') {
+                    ++_line;
+                }
+                ++_pos;
+            }
+            if (_pos >= _size) {
+                return false;
+            }
+            const size_t start = _pos;
+            span.line = _line;
+            bool movetext_seen = false;
+            int brace_depth = 0;
+            while (_pos < _size) {
+                const bool tag_line = (brace_depth == 0 && _data[_pos] == '[');
+                if (tag_line && movetext_seen) {
+                    break;
+                }
+                const char* eol = static_cast<const char*>(std::memchr(_data + _pos, '\n', _size - _pos));
+                const size_t line_end = eol ? eol - _data : _size;
+                if (!tag_line) {
+                    for (size_t i = _pos; i < line_end; ++i) {
+                        const char ch = _data[i];
+                        if (ch == '{') {
+                            ++brace_depth;
+                        } else if (ch == '}') {
+                            brace_depth = std::max(brace_depth - 1, 0);
+                        } else if (ch == ';' && brace_depth == 0) {
+                            break;
+                        }
+                        if (!std::isspace(static_cast<unsigned char>(ch))) {
+                            movetext_seen = true;
+                        }
+                    }
+                }
+                _pos = eol ? line_end + 1 : _size;
+                ++_line;
+            }
+            span.text = std::string_view(_data + start, _pos - start);
+            span.index = ++_index;
+            return true;
+        }
+
+        const char* _data;
+        size_t _size;
+        size_t _pos = 0;
+        uint64_t _line = 1;
+        uint64_t _index = 0;
+        std::mutex _mutex;
+    };
+
+    inline bool is_token_end(const char ch) {
+        return std::isspace(static_cast<unsigned char>(ch)) || ch == '{' || ch == '}' || ch == '(' || ch == ')' || ch == ';' || ch == '[';
+    }
+
+    bool skip_until(std::string_view text, size_t& pos, const char end) {
+        const size_t found = text.find(end, pos);
+        pos = (found == std::string_view::npos) ? text.size() : found + 1;
+        return found != std::string_view::npos;
+    }
+
+    bool parse_tag(std::string_view text, size_t& pos, Pgn::tag_t& tag) {
+        ++pos; // '['
+        const size_t name_start = pos;
+        while (pos < text.size() && !std::isspace(static_cast<unsigned char>(text[pos])) && text[pos] != ']') {
+            ++pos;
+        }
+        tag.name.assign(text.substr(name_start, pos - name_start));
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+            ++pos;
+        }
+        if (pos >= text.size() || text[pos] != '"') {
+            return false;
+        }
+        tag.value.clear();
+        for (++pos; pos < text.size() && text[pos] != '"'; ++pos) {
+            if (text[pos] == '\\' && pos + 1 < text.size()) {
+                ++pos;
+            }
+            tag.value.push_back(text[pos]);
+        }
+        return skip_until(text, pos, ']') && !tag.name.empty();
+    }
+}
+
+
+/**
+ * @brief Replays one game on the board.
+ *
+ * @param text the game, tag section and movetext
+ * @param game filled with tags, moves and result; index and line are left alone
+ * @param error set when false is returned
+ */
+bool Pgn::parse_game(std::string_view text, Board& board, game_t& game, std::string& error) {
+    game.tags.clear();
+    game.moves.clear();
+    game.result.clear();
+    game.start_fen = Fen::kFenInitial;
+    board.set_fen(game.start_fen);
+
+    bool in_movetext = false;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        const char ch = text[pos];
+        if (std::isspace(static_cast<unsigned char>(ch))) {
+            ++pos;
+            continue;
+        }
+        if (ch == '[') {
+            if (in_movetext) {
+                error = "tag inside movetext";
+                return false;
+            }
+            game.tags.emplace_back();
+            if (!parse_tag(text, pos, game.tags.back())) {
+                error = "malformed tag";
+                return false;
+            }
+            if (game.tags.back().name == "FEN") {
+                game.start_fen = game.tags.back().value;
+                if (!Fen::fen_valid(game.start_fen)) {
+                    error = "invalid FEN tag";
+                    return false;
+                }
+                if (!board.set_fen(game.start_fen)) {
+                    error = "illegal position in FEN tag";
+                    return false;
+                }
+            }
+            continue;
+        }
+        in_movetext = true;
+        if (ch == '{') {
+            if (!skip_until(text, pos, '}')) {
+                error = "unterminated comment";
+                return false;
+            }
+            continue;
+        }
+        if (ch == ';' || (ch == '%' && (pos == 0 || text[pos-1] == '\n'))) {
+            skip_until(text, pos, '\n');
+            continue;
+        }
+        if (ch == '(') {
+            int depth = 0;
+            while (pos < text.size()) {
+                if (text[pos] == '(') {
+                    ++depth;
+                } else if (text[pos] == ')' && --depth == 0) {
+                    break;
+                } else if (text[pos] == '{') {
+                    skip_until(text, pos, '}');
+                    continue;
+                }
+                ++pos;
+            }
+            if (pos >= text.size()) {
+                error = "unterminated variation";
+                return false;
+            }
+            ++pos;
+            continue;
+        }
+
+        const size_t token_start = pos;
+        while (pos < text.size() && !is_token_end(text[pos])) {
+            ++pos;
+        }
+        std::string_view token = text.substr(token_start, pos - token_start);
+        if (token.empty()) {
+            error = "unexpected '" + std::string(1, ch) + "'";
+            return false;
+        }
+        if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") {
+            game.result = token;
+            return true;
+        }
+        if (token[0] == '$') {
+            continue;
+        }
+        // move number ("12." or "12...") possibly glued to the move
+        if (std::isdigit(static_cast<unsigned char>(token[0]))) {
+            size_t skip = 0;
+            while (skip < token.size() && std::isdigit(static_cast<unsigned char>(token[skip]))) {
+                ++skip;
+            }
+            if (skip < token.size() && token[skip] == '.') {
+                while (skip < token.size() && token[skip] == '.') {
+                    ++skip;
+                }
+                token.remove_prefix(skip);
+                if (token.empty()) {
+                    continue;
+                }
+            }
+        }
+        move_t move;
+        if (!board.san_to_move(token, move) || !board.play_move(move.from_num, move.to_num, move.promote_to)) {
+            const uint64_t line = std::count(text.begin(), text.begin() + token_start, '\n');
+            error = "illegal or ambiguous move '" + std::string(token) + "' at ply " + std::to_string(game.moves.size() + 1)
+                  + " (game line " + std::to_string(line + 1) + ")";
+            return false;
+        }
+        game.moves.push_back(move);
+    }
+    if (!in_movetext && game.tags.empty()) {
+        error = "empty game";
+        return false;
+    }
+    return true; // result token is optional
+}
+
+/**
+ * @brief Replays every game of a PGN file on a pool of threads.
+ *
+ * @param visitor called for each successfully replayed game, may be empty
+ */
+Pgn::summary_t Pgn::replay_file(const std::string& path, const int threads, const visitor_t& visitor) {
+    summary_t summary;
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Cannot open %s", path.c_str());
+        summary.errors.push_back({ 0, 0, "cannot open file" });
+        summary.error_count = 1;
+        return summary;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return summary;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Cannot map %s", path.c_str());
+        summary.errors.push_back({ 0, 0, "cannot map file" });
+        summary.error_count = 1;
+        return summary;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    GameScanner scanner(static_cast<const char*>(map), st.st_size);
+    std::atomic<uint64_t> games { 0 };
+    std::atomic<uint64_t> plies { 0 };
+    std::atomic<uint64_t> error_count { 0 };
+    std::mutex error_mutex;
+
+    const auto work = [&] {
+        Board board;
+        game_t game;
+        std::string error;
+        std::vector<game_span_t> batch;
+        uint64_t local_games = 0;
+        uint64_t local_plies = 0;
+        while (scanner.next_batch(batch, kBatchGames)) {
+            for (const auto& span : batch) {
+                ++local_games;
+                game.index = span.index;
+                game.line = span.line;
+                bool parsed;
+                try {
+                    parsed = parse_game(span.text, board, game, error);
+                } catch (const std::exception& e) {
+                    // one broken game is reported like any other, the rest of the file is still replayed
+                    error = std::string("exception: ") + e.what();
+                    parsed = false;
+                }
+                if (!parsed) {
+                    ++error_count;
+                    std::lock_guard lock(error_mutex);
+                    summary.errors.push_back({ span.index, span.line, error });
+                    continue;
+                }
+                local_plies += game.moves.size();
+                if (visitor) {
+                    visitor(game, board);
+                }
+            }
+        }
+        games += local_games;
+        plies += local_plies;
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& th : workers) {
+        th.join();
+    }
+    munmap(map, st.st_size);
+
+    summary.games = games;
+    summary.plies = plies;
+    summary.error_count = error_count;
+    std::sort(summary.errors.begin(), summary.errors.end(), [](const error_t& a, const error_t& b) {
+        return a.index < b.index;
+    });
+    if (summary.errors.size() > kMaxReportedErrors) {
+        summary.errors.resize(kMaxReportedErrors);
+    }
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    summary.time_ms = t_tm.count();
+    return summary;
+}
+
+void Pgn::print_summary(const summary_t& summary) {
+    for (const auto& error : summary.errors) {
+        printf("Game %lu (line %lu): %s\n", error.index, error.line, error.message.c_str());
+    }
+    if (summary.error_count > summary.errors.size()) {
+        printf("... %lu more errors\n", summary.error_count - summary.errors.size());
+    }
+    const double seconds = summary.time_ms / 1000.0;
+    printf("Games: %lu (%lu errors) \tPlies: %lu \tTime: %.2lf ms \tGames/hour: %.0lf\n", summary.games, summary.error_count,
+           summary.plies, summary.time_ms, seconds > 0 ? summary.games * 3600.0 / seconds : 0.0);
+}
+
+
+/**
+ * @brief Resolves a SAN move (e.g. Nbd7, exd6, e8=Q+, O-O) against the legal moves.
+ *
+ * @return false if no legal move, or more than one, matches
+ */
+bool Board::san_to_move(std::string_view san, Pgn::move_t& move) {
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?')) {
+        san.remove_suffix(1);
+    }
+    if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+        const int king_sq = (_to_move == 'w') ? _w_king_sq : _b_king_sq;
+        move = { king_sq, king_sq + (san.size() == 3 ? 2 : -2), 'q' };
+        for (const auto& [from_num, to_num] : legal_moves()) {
+            if (from_num == move.from_num && to_num == move.to_num && _chessboard[from_num].piece() == 'k') {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    char piece = 'p';
+    if (!san.empty() && std::strchr("KQRBN", san.front())) {
+        piece = san.front() + 32;
+        san.remove_prefix(1);
+    }
+    char promote_to = 'q';
+    bool promotion = false;
+    if (piece == 'p' && san.size() >= 3 && std::strchr("QRBN", san.back())) {
+        promote_to = san.back() + 32;
+        promotion = true;
+        san.remove_suffix(san[san.size()-2] == '=' ? 2 : 1);
+    }
+    if (san.size() < 2) {
+        return false;
+    }
+    const char file_ch = san[san.size()-2];
+    const char rank_ch = san[san.size()-1];
+    if (file_ch < 'a' || file_ch > 'h' || rank_ch < '1' || rank_ch > '8') {
+        return false;
+    }
+    const int target = (rank_ch - '1') * 8 + (file_ch - 'a');
+    int from_file = -1;
+    int from_rank = -1;
+    for (const char ch : san.substr(0, san.size()-2)) {
+        if (ch >= 'a' && ch <= 'h') {
+            from_file = ch - 'a';
+        } else if (ch >= '1' && ch <= '8') {
+            from_rank = ch - '1';
+        } else if (ch != 'x' && ch != ':' && ch != '-') {
+            return false;
+        }
+    }
+
+    int matches = 0;
+    for (const auto& [from_num, to_num] : legal_moves()) {
+        if (to_num == target && _chessboard[from_num].piece() == piece &&
+            (from_file == -1 || from_num % 8 == from_file) && (from_rank == -1 || from_num / 8 == from_rank)) {
+            move = { from_num, to_num, promote_to };
+            ++matches;
+        }
+    }
+    const bool last_rank = (target / 8 == 0 || target / 8 == 7);
+    return matches == 1 && promotion == (piece == 'p' && last_rank);
+}
+
+/**
+ * @brief Writes a legal move in SAN, with the minimal disambiguation and a check
+ * or mate suffix. Complements get_move_str, which writes coordinates.
+ */
+std::string Board::move_to_san(const int from_num, const int to_num, const char promote_to) {
+    const char piece = _chessboard[from_num].piece();
+    std::string san;
+    if (piece == 'k' && std::abs(to_num - from_num) == 2) {
+        san = (to_num > from_num) ? "O-O" : "O-O-O";
+    } else {
+        const bool capture = _chessboard[to_num].piece() != 'e' || (piece == 'p' && to_num == _ep_square);
+        if (piece == 'p') {
+            if (capture) {
+                san.push_back('a' + from_num % 8);
+            }
+        } else {
+            san.push_back(piece - 32);
+            bool ambiguous = false;
+            bool same_file = false;
+            bool same_rank = false;
+            for (const auto& [other_from, other_to] : legal_moves()) {
+                if (other_to == to_num && other_from != from_num && _chessboard[other_from].piece() == piece) {
+                    ambiguous = true;
+                    same_file |= (other_from % 8 == from_num % 8);
+                    same_rank |= (other_from / 8 == from_num / 8);
+                }
+            }
+            if (ambiguous) {
+                if (!same_file) {
+                    san.push_back('a' + from_num % 8);
+                } else if (!same_rank) {
+                    san.push_back('1' + from_num / 8);
+                } else {
+                    san += num_to_alg(from_num);
+                }
+            }
+        }
+        if (capture) {
+            san.push_back('x');
+        }
+        san += num_to_alg(to_num);
+        if (piece == 'p' && (to_num / 8 == 0 || to_num / 8 == 7)) {
+            san.push_back('=');
+            san.push_back(promote_to - 32);
+        }
+    }
+    if (gives_check(from_num, to_num, promote_to)) {
+        make_move(from_num, to_num, promote_to, true);
+        san.push_back(legal_moves().empty() ? '#' : '+');
+        unmake_move();
+    }
+    return san;
+}
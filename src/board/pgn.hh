@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Board;
+
+// PGN game databases
+// The file is memory-mapped and cut into games by a sequential scanner (a game
+// ends where the tag section of the next one begins), which hands batches of
+// games to worker threads. Every worker owns a Board and replays its games by
+// resolving each SAN token against the legal move list, so a bad game is
+// reported with its number and line and the run continues.
+//
+// Movetext may contain move numbers, comments ({...} and ;...), variations (which
+// are skipped), NAGs and a result token. Games with a FEN tag start from that
+// position.
+namespace Pgn {
+    static constexpr int kBatchGames { 64 };
+    static constexpr size_t kMaxReportedErrors { 100 };
+
+    struct move_t {
+        int from_num;
+        int to_num;
+        char promote_to;    // 'q' when not a promotion
+    };
+
+    struct tag_t {
+        std::string name;
+        std::string value;
+    };
+
+    struct game_t {
+        uint64_t index = 0;     // 1-based
+        uint64_t line = 0;      // first line of the game
+        std::vector<tag_t> tags;
+        std::string start_fen;
+        std::vector<move_t> moves;
+        std::string result;
+    };
+
+    struct error_t {
+        uint64_t index;
+        uint64_t line;
+        std::string message;
+    };
+
+    struct summary_t {
+        uint64_t games = 0;
+        uint64_t plies = 0;
+        std::vector<error_t> errors;
+        uint64_t error_count = 0;
+        double time_ms = 0.0;
+    };
+
+    // called by worker threads for every game replayed without errors, with the
+    // board in the final position of the game
+    using visitor_t = std::function<void(const game_t&, Board&)>;
+
+    bool parse_game(std::string_view text, Board& board, game_t& game, std::string& error);
+    summary_t replay_file(const std::string& path, const int threads, const visitor_t& visitor);
+    void print_summary(const summary_t& summary);
+}
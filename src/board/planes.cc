@@ -0,0 +1,254 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "board.hh"
+#include "epd.hh"
+#include "gamedb.hh"
+#include "packed.hh"
+#include "planes.hh"
+
+#include "log.hh"
+
+
+namespace {
+    constexpr char kPlanePieces[6] { 'p', 'n', 'b', 'r', 'q', 'k' };
+
+    // byte n of kSpread[b] is bit n of b
+    constexpr auto kSpread = [] {
+        std::array<uint64_t, 256> table {};
+        for (int bits = 0; bits < 256; ++bits) {
+            for (int n = 0; n < 8; ++n) {
+                table[bits] |= static_cast<uint64_t>((bits >> n) & 1) << (8 * n);
+            }
+        }
+        return table;
+    }();
+
+    inline size_t align_up(const size_t size) {
+        return (size + Planes::kAlignment - 1) & ~(Planes::kAlignment - 1);
+    }
+
+    // a read-only mapping of the whole input file
+    struct input_t {
+        const char* data = nullptr;
+        size_t size = 0;
+
+        ~input_t() {
+            if (data) {
+                munmap(const_cast<char*>(data), size);
+            }
+        }
+    };
+
+    bool map_input(const std::string& path, input_t& input) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            LOG_ERROR("Cannot read %s", path.c_str());
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+        input.size = st.st_size;
+        void* map = input.size ? mmap(nullptr, input.size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        close(fd);
+        if (map == MAP_FAILED) {
+            LOG_ERROR("Cannot map %s", path.c_str());
+            input.size = 0;
+            return false;
+        }
+        input.data = static_cast<const char*>(map);
+        return true;
+    }
+
+    // one bit per square to one byte per square, a rank (8 squares) at a time
+    inline void expand_planes(const Planes::bitboards_t& planes, uint8_t* out) {
+        for (int plane = 0; plane < Planes::kPlaneCount; ++plane) {
+            for (int rank = 0; rank < 8; ++rank) {
+                const uint64_t spread = kSpread[(planes[plane] >> (8 * rank)) & 0xff];
+                std::memcpy(out + plane * 64 + rank * 8, &spread, sizeof(spread));
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Bitboards of the input planes of the current position, see planes.hh.
+ */
+void Board::encode_planes(Planes::bitboards_t& planes) const {
+    std::fill(std::begin(planes), std::end(planes), 0);
+    for (const auto& p_set : { &_white_pieces, &_black_pieces }) {
+        for (const auto sq_num : *p_set) {
+            const auto& sq = _chessboard[sq_num];
+            const int piece = std::find(std::begin(kPlanePieces), std::end(kPlanePieces), sq.piece()) - std::begin(kPlanePieces);
+            planes[Planes::kPlanePieces + (sq.colour() == 'b') * 6 + piece] |= 1ULL << sq_num;
+        }
+    }
+    planes[Planes::kPlaneSideToMove] = (_to_move == 'w') ? ~0ULL : 0;
+    // castling rights are stored as K = 8, Q = 4, k = 2, q = 1
+    for (int right = 0; right < 4; ++right) {
+        planes[Planes::kPlaneCastling + right] = (_castling_rights & (8 >> right)) ? ~0ULL : 0;
+    }
+    planes[Planes::kPlaneEp] = (_ep_square == -1) ? 0 : 1ULL << _ep_square;
+}
+
+
+/**
+ * @brief Converts a packed dataset or a FEN/EPD file to a plane file. The output
+ * is sized for every input position and mapped; each thread converts a
+ * contiguous slice of the input into the same slice of the output, then slices
+ * are moved together over the positions that were skipped.
+ *
+ * Text lines take the result from an EPD `c9' operation (1-0, 0-1, 1/2-1/2) and
+ * the score from `ce' (side to move's point of view, as EPD defines it).
+ */
+bool Planes::export_file(const config_t& config) {
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    input_t input;
+    if (!map_input(config.input_path, input)) {
+        return false;
+    }
+    const bool packed = config.input_path.size() > 5 && config.input_path.substr(config.input_path.size() - 5) == ".ccpk";
+    std::vector<std::string_view> lines;
+    uint64_t count;
+    if (packed) {
+        if (input.size % sizeof(Packed::packed_position_t) != 0) {
+            LOG_ERROR("Not a packed position file: %s", config.input_path.c_str());
+            return false;
+        }
+        count = input.size / sizeof(Packed::packed_position_t);
+    } else {
+        const std::string_view text(input.data, input.size);
+        for (size_t pos = 0; pos < text.size();) {
+            const size_t end = std::min(text.find('\n', pos), text.size());
+            if (end > pos) {
+                lines.push_back(text.substr(pos, end - pos));
+            }
+            pos = end + 1;
+        }
+        count = lines.size();
+    }
+
+    header_t header {};
+    std::memcpy(header.magic, kFileMagic, sizeof(header.magic));
+    header.version = kFileVersion;
+    header.format = config.format;
+    header.planes = kPlaneCount;
+    header.record_bytes = (config.format == kFormatBits) ? kPlaneCount * sizeof(uint64_t) : kPlaneCount * 64;
+    header.planes_offset = align_up(sizeof(header_t));
+    header.results_offset = header.planes_offset + align_up(count * header.record_bytes);
+    header.scores_offset = header.results_offset + align_up(count * sizeof(uint8_t));
+    const size_t file_size = header.scores_offset + align_up(count * sizeof(int16_t));
+
+    const int fd = open(config.output_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, file_size) != 0) {
+        LOG_ERROR("Cannot write %s", config.output_path.c_str());
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    void* map = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Cannot map %s", config.output_path.c_str());
+        return false;
+    }
+    uint8_t* out = static_cast<uint8_t*>(map);
+    uint8_t* out_planes = out + header.planes_offset;
+    uint8_t* out_results = out + header.results_offset;
+    int16_t* out_scores = reinterpret_cast<int16_t*>(out + header.scores_offset);
+
+    const int threads = std::max(config.threads, 1);
+    std::vector<uint64_t> converted(threads, 0);
+    const auto work = [&](const int thread_id) {
+        Board board;
+        Epd::record_t record;
+        bitboards_t planes;
+        const uint64_t begin = count * thread_id / threads;
+        const uint64_t end = count * (thread_id + 1) / threads;
+        uint64_t written = begin;
+        for (uint64_t i = begin; i < end; ++i) {
+            uint8_t result = GameDb::kResultUnknown;
+            int16_t score = 0;
+            if (packed) {
+                const auto& pos = reinterpret_cast<const Packed::packed_position_t*>(input.data)[i];
+                if (!board.decode_packed(pos)) {
+                    continue;
+                }
+                result = pos.result;
+                score = pos.score;
+            } else {
+                if (!Epd::parse_line(std::string(lines[i]), record)) {
+                    continue;
+                }
+                if (!board.set_fen(record.fen)) {
+                    continue;
+                }
+                if (record.operations.count("c9")) {
+                    result = GameDb::result_from_str(record.operations["c9"]);
+                }
+                if (record.operations.count("ce")) {
+                    const int ce = std::clamp(std::atoi(record.operations["ce"].c_str()), -32767, 32767);
+                    score = (board.to_move() == 'w') ? ce : -ce;
+                }
+            }
+            board.encode_planes(planes);
+            if (config.format == kFormatBits) {
+                std::memcpy(out_planes + written * header.record_bytes, planes, sizeof(planes));
+            } else {
+                expand_planes(planes, out_planes + written * header.record_bytes);
+            }
+            out_results[written] = result;
+            out_scores[written] = score;
+            ++written;
+        }
+        converted[thread_id] = written - begin;
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& th : workers) {
+        th.join();
+    }
+
+    uint64_t valid = 0;
+    for (int i = 0; i < threads; ++i) {
+        const uint64_t begin = count * i / threads;
+        if (valid != begin && converted[i]) {
+            std::memmove(out_planes + valid * header.record_bytes, out_planes + begin * header.record_bytes, converted[i] * header.record_bytes);
+            std::memmove(out_results + valid, out_results + begin, converted[i] * sizeof(uint8_t));
+            std::memmove(out_scores + valid, out_scores + begin, converted[i] * sizeof(int16_t));
+        }
+        valid += converted[i];
+    }
+    // the slots past the last position keep no stale records
+    std::memset(out_planes + valid * header.record_bytes, 0, (count - valid) * header.record_bytes);
+    std::memset(out_results + valid, 0, (count - valid) * sizeof(uint8_t));
+    std::memset(out_scores + valid, 0, (count - valid) * sizeof(int16_t));
+    header.count = valid;
+    header.skipped = count - valid;
+    std::memcpy(out, &header, sizeof(header));
+    munmap(map, file_size);
+
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    printf("Positions: %lu (skipped %lu) \tFormat: %s \tSize: %lu MB\n", header.count, header.skipped,
+           config.format == kFormatBits ? "bits" : "bytes", file_size >> 20);
+    printf("Time: %.2lf ms \tPositions/min: %.0lf\n", t_tm.count(), t_tm.count() > 0 ? header.count * 60000.0 / t_tm.count() : 0.0);
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Bitplane tensors (.ccpl) for ML training
+// Every position becomes kPlaneCount planes of 64 squares (a1 = 0, h8 = 63), from
+// white's point of view whatever the side to move:
+//     0-5    white pawns, knights, bishops, rooks, queens, king
+//     6-11   black pieces, same order
+//     12     side to move (all set when white is to move)
+//     13-16  castling rights K, Q, k, q (all set when held)
+//     17     en passant square
+// The file is a 4096-byte header followed by three arrays, each starting on a
+// 4096-byte boundary so it can be mapped directly (e.g. numpy.memmap):
+//     planes   count x kPlaneCount x 64 uint8 (0/1), or count x kPlaneCount
+//              uint64 bitboards (bit n = square n) when packed
+//     results  count uint8 (GameDb::result_t, 0 when unknown)
+//     scores   count int16 (centipawns from white's point of view, 0 when unknown)
+// All values are little endian.
+namespace Planes {
+    static constexpr char kFileMagic[4] { 'C', 'C', 'P', 'L' };
+    static constexpr uint32_t kFileVersion { 1 };
+    static constexpr int kPlaneCount { 18 };
+    static constexpr size_t kAlignment { 4096 };
+
+    enum plane_t {
+        kPlanePieces = 0,
+        kPlaneSideToMove = 12,
+        kPlaneCastling = 13,
+        kPlaneEp = 17
+    };
+
+    enum format_t : uint32_t {
+        kFormatBytes = 0,
+        kFormatBits
+    };
+
+    struct header_t {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t planes;
+        uint64_t count;
+        uint64_t record_bytes;          // size of one position in the plane array
+        uint64_t planes_offset;
+        uint64_t results_offset;
+        uint64_t scores_offset;
+        uint64_t skipped;               // input positions that could not be converted
+    };
+
+    struct config_t {
+        std::string input_path;         // .ccpk packed positions, else FEN/EPD lines
+        std::string output_path;
+        format_t format = kFormatBytes;
+        int threads = 1;
+    };
+
+    using bitboards_t = uint64_t[kPlaneCount];
+
+    bool export_file(const config_t& config);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+
+// Polyglot opening books
+// A .bin book is a sequence of 16-byte big-endian entries sorted by key:
+//     uint64 key, uint16 move, uint16 weight, uint32 learn
+// The key is the Polyglot Zobrist hash of the position, built from the 781
+// standard Random64 constants: 768 piece-square keys, 4 castling keys, 8 en
+// passant file keys and the white-to-move key.
+// The table is compiled in and checked once against the reference keys of the
+// Polyglot specification before a book is used.
+//
+// Books are memory-mapped and binary searched in place, never read into the heap.
+namespace Polyglot {
+    static constexpr int kRandomCount { 781 };
+    static constexpr int kRandomCastling { 768 };
+    static constexpr int kRandomEnPassant { 772 };
+    static constexpr int kRandomTurn { 780 };
+    static constexpr size_t kEntrySize { 16 };
+
+    struct book_entry_t {
+        uint64_t key;
+        uint16_t move;
+        uint16_t weight;
+        uint32_t learn;
+    };
+
+    // walks entries of the mapped book, decoding each one when dereferenced
+    class entry_iterator_t {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = book_entry_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = book_entry_t;
+
+        entry_iterator_t() = default;
+        explicit entry_iterator_t(const uint8_t* entry) : _entry(entry) {}
+
+        book_entry_t operator*() const;
+        entry_iterator_t& operator++() {
+            _entry += kEntrySize;
+            return *this;
+        }
+        entry_iterator_t operator++(int) {
+            const entry_iterator_t it = *this;
+            ++*this;
+            return it;
+        }
+        bool operator==(const entry_iterator_t& other) const = default;
+        size_t operator-(const entry_iterator_t& other) const { return (_entry - other._entry) / kEntrySize; }
+
+    private:
+        const uint8_t* _entry = nullptr;
+    };
+
+    // the entries of one key, in place in the mapped book; valid until the book is closed
+    struct entry_range_t {
+        entry_iterator_t first;
+        entry_iterator_t last;
+
+        entry_iterator_t begin() const { return first; }
+        entry_iterator_t end() const { return last; }
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+    };
+
+    bool random_verified();
+    uint64_t random64(const int idx);
+
+    bool open_book(const std::string& path);
+    void close_book();
+    bool book_open();
+    uint64_t book_entries();
+    entry_range_t probe(const uint64_t key);
+    entry_iterator_t pick(const entry_range_t& entries);
+}
@@ -36,9 +36,9 @@ void Board::print(std::set<int>& highlit_squares) const {
 }
 
 
-void Board::show_legal_moves(const int sq_num) const {
+void Board::show_legal_moves(const int sq_num) {
     std::set<int> sq_set;
-    for (const auto [fr, to] : _legal_moves) {
+    for (const auto& [fr, to] : legal_moves()) {
         if (fr == sq_num) {
             sq_set.insert(to);
         }
@@ -0,0 +1,412 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "board.hh"
+#include "eval.hh"
+#include "stats.hh"
+
+
+namespace {
+    constexpr char kPromotionTargets[4] { 'q', 'r', 'b', 'n' };
+
+    std::string score_str(const int score) {
+        if (score > Eval::kScoreMateBound) {
+            return "mate " + std::to_string((Eval::kScoreMate - score + 1) / 2);
+        } else if (score < -Eval::kScoreMateBound) {
+            return "mate -" + std::to_string((Eval::kScoreMate + score) / 2);
+        }
+        return "cp " + std::to_string(score);
+    }
+
+    // selectivity parameters, in plies and centipawns
+    constexpr int kNullMoveMinDepth { 3 };
+    constexpr int kNullMoveDeepDepth { 7 };     // R = 3 from here on, 2 below
+    constexpr int kLmrMinDepth { 3 };
+    constexpr int kLmrMinMoves { 3 };           // the first moves are never reduced
+    constexpr int kFutilityMaxDepth { 2 };
+    constexpr int kFutilityMargins[kFutilityMaxDepth + 1] { 0, 200, 500 };
+    constexpr int kReverseFutilityMaxDepth { 3 };
+    constexpr int kReverseFutilityMargin { 120 };   // per ply of depth
+    constexpr int kMaxExtendedPly { 2 * search_limits_t::kMaxDepth };
+    constexpr int kLmrTableSize { 64 };
+
+    // reduction of the move_number-th move at a depth: grows with the logarithm
+    // of both, so late moves of deep nodes are reduced most
+    const auto kLmrTable = [] {
+        std::array<std::array<uint8_t, kLmrTableSize>, kLmrTableSize> table {};
+        for (int depth = 1; depth < kLmrTableSize; ++depth) {
+            for (int move_number = 1; move_number < kLmrTableSize; ++move_number) {
+                table[depth][move_number] = static_cast<uint8_t>(0.75 + std::log(depth) * std::log(move_number) / 2.25);
+            }
+        }
+        return table;
+    }();
+
+    inline int lmr_reduction(const int depth, const int move_number) {
+        return kLmrTable[std::min(depth, kLmrTableSize - 1)][std::min(move_number, kLmrTableSize - 1)];
+    }
+
+    inline bool is_mate_score(const int score) {
+        return score > Eval::kScoreMateBound || score < -Eval::kScoreMateBound;
+    }
+}
+
+
+bool search_options_t::set(const std::string& name, const bool value) {
+    if (name == "null") {
+        null_move = value;
+    } else if (name == "lmr") {
+        lmr = value;
+    } else if (name == "futility") {
+        futility = value;
+    } else if (name == "rfp") {
+        reverse_futility = value;
+    } else if (name == "checkext") {
+        check_extensions = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string search_options_t::str() const {
+    const auto on_off = [](const bool value) { return value ? "on" : "off"; };
+    return std::string("null ") + on_off(null_move) + " lmr " + on_off(lmr) + " futility " + on_off(futility)
+         + " rfp " + on_off(reverse_futility) + " checkext " + on_off(check_extensions);
+}
+
+
+/**
+ * @brief Expands the current legal move list into search moves (one per
+ * promotion piece) and orders them: promotions and captures first (MVV-LVA),
+ * quiet moves after.
+ *
+ * @param moves output vector, cleared first
+ * @param captures_only skip quiet moves (quiescence search)
+ */
+void Board::generate_search_moves(std::vector<scored_move_t>& moves, const bool captures_only) {
+    moves.clear();
+    for (const auto& [from_num, to_num] : legal_moves()) {
+        const char from_piece = _chessboard[from_num].piece();
+        const char to_piece = _chessboard[to_num].piece();
+        const bool ep = (from_piece == 'p' && to_num == _ep_square);
+        int score = 0;
+        if (to_piece != 'e' || ep) {
+            score = 10 * Eval::piece_value(ep ? 'p' : to_piece) - Eval::piece_value(from_piece) / 100 + 10000;
+        }
+
+        if (from_piece == 'p' && (to_num / 8 == 0 || to_num / 8 == 7)) {
+            for (const auto promote_to : kPromotionTargets) {
+                moves.push_back({ from_num, to_num, promote_to, score + Eval::piece_value(promote_to) + 10000 });
+            }
+        } else if (!captures_only || score > 0) {
+            moves.push_back({ from_num, to_num, 'q', score });
+        }
+    }
+    std::stable_sort(moves.begin(), moves.end(), [](const scored_move_t& a, const scored_move_t& b) {
+        return a.score > b.score;
+    });
+}
+
+/**
+ * @brief Checks the node and time limits of the running search; once they are
+ * hit, every node returns at once and the iteration is discarded.
+ */
+bool Board::search_aborted() {
+    if (_search_aborted) {
+        return true;
+    }
+    const uint64_t nodes = _search_stats.nodes + _search_stats.qnodes;
+    if (_search_limits.nodes && nodes >= _search_limits.nodes) {
+        _search_aborted = true;
+    } else if (_search_limits.time_ms > 0 && (nodes & 255) == 0) {
+        const std::chrono::duration<double, std::milli> t_tm = std::chrono::steady_clock::now() - _search_start;
+        _search_aborted = (t_tm.count() >= _search_limits.time_ms);
+    }
+    return _search_aborted;
+}
+
+int Board::quiescence(int alpha, const int beta, const int ply) {
+    ++_search_stats.qnodes;
+    STATS_INC(kNodes);
+    if (search_aborted()) {
+        return 0;
+    }
+    if (legal_moves().empty()) {
+        return is_in_check() ? -Eval::kScoreMate + ply : 0;
+    }
+    if (is_draw()) {
+        return 0;
+    }
+
+    const int stand_pat = evaluate();
+    if (stand_pat >= beta) {
+        return stand_pat;
+    }
+    if (stand_pat > alpha) {
+        alpha = stand_pat;
+    }
+
+    std::vector<scored_move_t> moves;
+    generate_search_moves(moves, true);
+    int best = stand_pat;
+    for (const auto& mv : moves) {
+        make_move(mv.from_num, mv.to_num, mv.promote_to, true);
+        const int score = -quiescence(-beta, -alpha, ply+1);
+        unmake_move();
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Whether a side has a piece other than pawns and king: without one,
+ * zugzwang is common and passing is no safe lower bound.
+ */
+bool Board::has_non_pawn_material(const char colour) const {
+    const auto& pieces = (colour == 'w') ? _white_pieces : _black_pieces;
+    return std::any_of(pieces.begin(), pieces.end(), [this](const int sq_num) {
+        const char piece = _chessboard[sq_num].piece();
+        return piece != 'p' && piece != 'k';
+    });
+}
+
+/**
+ * @brief Fail-soft alpha-beta with the selectivity of _search_limits.options.
+ * In check the node is extended by a ply. Out of check, near the leaves a static
+ * eval well above beta cuts at once (reverse futility); otherwise passing the
+ * move is tried with a reduced search (null move) and cuts if it still fails high.
+ * Quiet moves that cannot reach alpha near the leaves are skipped (futility) and
+ * late quiet moves are searched with a reduced null window first (LMR), then
+ * again at full depth if they beat alpha.
+ */
+int Board::alpha_beta(int depth, int alpha, const int beta, const int ply) {
+    const auto& options = _search_limits.options;
+    const bool in_check = is_in_check();
+    if (in_check && options.check_extensions && ply < kMaxExtendedPly) {
+        ++depth;
+        ++_search_stats.extensions;
+    }
+    if (depth <= 0) {
+        return quiescence(alpha, beta, ply);
+    }
+    ++_search_stats.nodes;
+    STATS_INC(kNodes);
+    if (search_aborted()) {
+        return 0;
+    }
+    if (legal_moves().empty()) {
+        return in_check ? -Eval::kScoreMate + ply : 0;
+    }
+    if (is_draw()) {
+        return 0;
+    }
+    if (Tablebase::max_pieces()) {
+        const auto tb = probe_tablebase();
+        if (tb.found) {
+            ++_search_stats.tb_hits;
+            if (tb.wdl == 0) {
+                return 0;
+            }
+            return (tb.wdl > 0) ? Eval::kScoreMate - ply - tb.dtm : -Eval::kScoreMate + ply + tb.dtm;
+        }
+    }
+
+    const bool selective = !in_check && !is_mate_score(beta);
+    const int static_eval = selective ? evaluate() : 0;
+    if (selective && options.reverse_futility && depth <= kReverseFutilityMaxDepth
+        && static_eval - kReverseFutilityMargin * depth >= beta) {
+        ++_search_stats.rfp_cutoffs;
+        return static_eval;
+    }
+    const bool after_null = !_move_history.empty() && _move_history.back().move_type == 'n';
+    if (selective && options.null_move && depth >= kNullMoveMinDepth && !after_null && static_eval >= beta
+        && has_non_pawn_material(_to_move)) {
+        const int reduction = (depth >= kNullMoveDeepDepth) ? 3 : 2;
+        make_null_move();
+        const int score = -alpha_beta(depth - 1 - reduction, -beta, -beta + 1, ply + 1);
+        unmake_null_move();
+        if (_search_aborted) {
+            return 0;
+        }
+        if (score >= beta) {
+            ++_search_stats.null_cutoffs;
+            // a mate found after passing is not proven
+            return is_mate_score(score) ? beta : score;
+        }
+    }
+
+    const bool futile = selective && options.futility && depth <= kFutilityMaxDepth
+        && static_eval + kFutilityMargins[depth] <= alpha;
+    std::vector<scored_move_t> moves;
+    generate_search_moves(moves, false);
+    int best = -Eval::kScoreInfinity;
+    int move_number = 0;
+    for (const auto& mv : moves) {
+        ++move_number;
+        // captures and promotions are ordered first with a positive score
+        const bool quiet = (mv.score == 0);
+        const bool check = quiet && (futile || options.lmr) && gives_check(mv.from_num, mv.to_num, mv.promote_to);
+        if (futile && quiet && !check && move_number > 1) {
+            ++_search_stats.futility_prunes;
+            best = std::max(best, static_eval + kFutilityMargins[depth]);
+            continue;
+        }
+
+        make_move(mv.from_num, mv.to_num, mv.promote_to, true);
+        int score;
+        if (options.lmr && quiet && !check && !in_check && depth >= kLmrMinDepth && move_number > kLmrMinMoves) {
+            const int reduction = std::min(lmr_reduction(depth, move_number), depth - 2);
+            score = -alpha_beta(depth - 1 - reduction, -alpha - 1, -alpha, ply + 1);
+            ++_search_stats.reductions;
+            if (score > alpha && (reduction > 0 || beta - alpha > 1)) {
+                ++_search_stats.re_searches;
+                score = -alpha_beta(depth - 1, -beta, -alpha, ply + 1);
+            }
+        } else {
+            score = -alpha_beta(depth - 1, -beta, -alpha, ply + 1);
+        }
+        unmake_move();
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Iterative deepening alpha-beta search from the current position. If an
+ * opening book is open and has the position, its move is returned instead.
+ *
+ * @param depth maximum depth in plies
+ * @param verbose print a line per completed iteration and statistics at the end
+ * @return best move found, its score and the depth reached
+ */
+search_result_t Board::search(const int depth, const bool verbose) {
+    search_limits_t limits;
+    limits.depth = depth;
+    return search(limits, verbose);
+}
+
+/**
+ * @brief Iterative deepening search within node and time limits: an iteration
+ * cut short by a limit is discarded, so the result is that of the last completed
+ * one (the first root move if none completed).
+ */
+search_result_t Board::search(const search_limits_t& limits, const bool verbose) {
+    STATS_TIMER(kTimerSearch);
+    search_result_t result { -1, -1, 'q', 0, 0 };
+    if (book_move(result)) {
+        if (verbose) {
+            printf("book move %s\n", search_move_str(result).c_str());
+        }
+        return result;
+    }
+    _search_stats = search_stats_t {};
+    _search_limits = limits;
+    _search_aborted = false;
+    _search_start = std::chrono::steady_clock::now();
+    const uint64_t pawn_probes = _pawn_table.probes();
+    const uint64_t pawn_hits = _pawn_table.hits();
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+
+    std::vector<scored_move_t> root_moves;
+    generate_search_moves(root_moves, false);
+    if (root_moves.empty()) {
+        result.score = is_in_check() ? -Eval::kScoreMate : 0;
+        return result;
+    }
+
+    result = { root_moves.front().from_num, root_moves.front().to_num, root_moves.front().promote_to, 0, 0 };
+    for (int d = 1; d <= limits.depth; ++d) {
+        int alpha = -Eval::kScoreInfinity;
+        const int beta = Eval::kScoreInfinity;
+        scored_move_t best_move = root_moves.front();
+        for (auto& mv : root_moves) {
+            make_move(mv.from_num, mv.to_num, mv.promote_to, true);
+            const int score = -alpha_beta(d-1, -beta, -alpha, 1);
+            unmake_move();
+            if (_search_aborted) {
+                break;
+            }
+            if (score > alpha) {
+                alpha = score;
+                best_move = mv;
+            }
+        }
+        ++_search_stats.nodes;
+        if (_search_aborted) {
+            break;
+        }
+
+        // best move of this iteration is searched first in the next one
+        std::stable_partition(root_moves.begin(), root_moves.end(), [&best_move](const scored_move_t& mv) {
+            return mv.from_num == best_move.from_num && mv.to_num == best_move.to_num && mv.promote_to == best_move.promote_to;
+        });
+        result = { best_move.from_num, best_move.to_num, best_move.promote_to, alpha, d };
+        if (limits.on_iteration) {
+            const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+            limits.on_iteration(result, t_tm.count());
+        }
+
+        if (verbose) {
+            const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+            printf("depth %d score %s nodes %lu time %.0lf ms best %s\n", d, score_str(alpha).c_str(),
+                   _search_stats.nodes + _search_stats.qnodes, t_tm.count(), search_move_str(result).c_str());
+        }
+        if (alpha > Eval::kScoreMateBound || alpha < -Eval::kScoreMateBound) {
+            break;
+        }
+    }
+
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    _search_stats.time_ms = t_tm.count();
+    _search_stats.pawn_probes = _pawn_table.probes() - pawn_probes;
+    _search_stats.pawn_hits = _pawn_table.hits() - pawn_hits;
+    if (verbose) {
+        print_search_stats();
+    }
+    return result;
+}
+
+std::string Board::search_move_str(const search_result_t& result) const {
+    if (result.from_num == -1) {
+        return "(none)";
+    }
+    const char from_piece = _chessboard[result.from_num].piece();
+    if (from_piece == 'p' && (result.to_num / 8 == 0 || result.to_num / 8 == 7)) {
+        return get_move_str(result.from_num, result.to_num, result.promote_to);
+    }
+    return get_move_str(result.from_num, result.to_num);
+}
+
+void Board::print_search_stats() const {
+    const auto& st = _search_stats;
+    const uint64_t total_nodes = st.nodes + st.qnodes;
+    const double nps = st.time_ms > 0 ? total_nodes * 1000.0 / st.time_ms : 0.0;
+    const double pawn_rate = st.pawn_probes ? 100.0 * st.pawn_hits / st.pawn_probes : 0.0;
+    printf("Nodes: %lu (qnodes: %lu) \tTime: %.2lf ms \tNPS: %.0lf\n", total_nodes, st.qnodes, st.time_ms, nps);
+    printf("Pawn hash: %lu/%lu hits (%.1lf%%)\n", st.pawn_hits, st.pawn_probes, pawn_rate);
+    if (st.tb_hits) {
+        printf("Tablebase hits: %lu\n", st.tb_hits);
+    }
+    printf("Null-move cutoffs: %lu \tRFP cutoffs: %lu \tFutility prunes: %lu \tReductions: %lu (re-searched %lu) \tCheck extensions: %lu\n",
+           st.null_cutoffs, st.rfp_cutoffs, st.futility_prunes, st.reductions, st.re_searches, st.extensions);
+}
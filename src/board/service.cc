@@ -0,0 +1,493 @@
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "board.hh"
+#include "fen.hh"
+#include "service.hh"
+#include "stats.hh"
+#include "strfuns.hh"
+
+#include "log.hh"
+
+
+namespace {
+    struct output_t {
+        explicit output_t(const int out_fd) : fd(out_fd) {}
+        ~output_t() {
+            if (fd > STDERR_FILENO) {
+                close(fd);
+            }
+        }
+        int fd;
+        std::mutex mutex;
+    };
+
+    // the thread reading one connection; its fd stays open until `done' is set
+    struct reader_t {
+        std::thread thread;
+        int fd = -1;
+        std::mutex mutex;
+        bool done = false;
+    };
+
+    struct job_t {
+        std::string line;
+        std::shared_ptr<output_t> out;
+    };
+
+    class JobQueue {
+    public:
+        explicit JobQueue(const size_t capacity) : _capacity(capacity) {}
+
+        // blocks while the queue is full, so a fast client cannot queue unbounded work
+        void push(job_t&& job) {
+            std::unique_lock lock(_mutex);
+            _not_full.wait(lock, [this] { return _jobs.size() < _capacity; });
+            _jobs.push_back(std::move(job));
+            _not_empty.notify_one();
+        }
+
+        bool pop(job_t& job) {
+            std::unique_lock lock(_mutex);
+            _not_empty.wait(lock, [this] { return !_jobs.empty() || _closed; });
+            if (_jobs.empty()) {
+                return false;
+            }
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+            _not_full.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard lock(_mutex);
+            _closed = true;
+            _not_empty.notify_all();
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _not_empty;
+        std::condition_variable _not_full;
+        std::deque<job_t> _jobs;
+        size_t _capacity;
+        bool _closed = false;
+    };
+
+    void write_line(output_t& out, std::string text) {
+        text.push_back('\n');
+        std::lock_guard lock(out.mutex);
+        size_t written = 0;
+        while (written < text.size()) {
+            const ssize_t n = write(out.fd, text.data() + written, text.size() - written);
+            if (n <= 0) {
+                return; // client gone
+            }
+            written += n;
+        }
+    }
+
+    void read_lines(const int fd, const std::function<void(std::string&&)>& callback) {
+        char buffer[1 << 16];
+        std::string pending;
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+            pending.append(buffer, n);
+            size_t start = 0;
+            size_t end;
+            while ((end = pending.find('\n', start)) != std::string::npos) {
+                if (end > start) {
+                    callback(pending.substr(start, end - start));
+                }
+                start = end + 1;
+            }
+            pending.erase(0, start);
+        }
+        if (!pending.empty()) {
+            callback(std::move(pending));
+        }
+    }
+
+    void worker(JobQueue& queue) {
+        Board board;
+        job_t job;
+        while (queue.pop(job)) {
+            Service::request_t request;
+            std::string error;
+            if (!Service::parse_request(job.line, request, error)) {
+                write_line(*job.out, Service::error_response(request.id, error));
+                job.out.reset();
+                continue;
+            }
+            // nothing a request holds may take the server down
+            try {
+                write_line(*job.out, board.service_response(request));
+            } catch (const std::exception& e) {
+                write_line(*job.out, Service::error_response(request.id, std::string("internal error: ") + e.what()));
+            } catch (...) {
+                write_line(*job.out, Service::error_response(request.id, "internal error"));
+            }
+            job.out.reset();
+        }
+    }
+
+    void skip_space(const std::string& s, size_t& pos) {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\r' || s[pos] == '\n')) {
+            ++pos;
+        }
+    }
+
+    bool parse_string(const std::string& s, size_t& pos, std::string& out) {
+        if (pos >= s.size() || s[pos] != '"') {
+            return false;
+        }
+        out.clear();
+        for (++pos; pos < s.size(); ++pos) {
+            char ch = s[pos];
+            if (ch == '"') {
+                ++pos;
+                return true;
+            }
+            if (ch == '\\') {
+                if (++pos >= s.size()) {
+                    return false;
+                }
+                switch (s[pos]) {
+                    case 'n':   ch = '\n'; break;
+                    case 't':   ch = '\t'; break;
+                    case 'r':   ch = '\r'; break;
+                    case 'b':   ch = '\b'; break;
+                    case 'f':   ch = '\f'; break;
+                    case 'u':   return false; // not needed for FENs and commands
+                    default:    ch = s[pos]; break;
+                }
+            }
+            out.push_back(ch);
+        }
+        return false;
+    }
+
+    // scalar value; `raw' is its JSON text, `text' the decoded string or the raw literal
+    bool parse_value(const std::string& s, size_t& pos, std::string& raw, std::string& text) {
+        const size_t start = pos;
+        if (pos < s.size() && s[pos] == '"') {
+            if (!parse_string(s, pos, text)) {
+                return false;
+            }
+        } else {
+            while (pos < s.size() && (std::isalnum(static_cast<unsigned char>(s[pos])) || s[pos] == '-' || s[pos] == '+' || s[pos] == '.')) {
+                ++pos;
+            }
+            if (pos == start) {
+                return false;
+            }
+            text = s.substr(start, pos - start);
+        }
+        raw = s.substr(start, pos - start);
+        return true;
+    }
+
+    // a JSON number: -?digits[.digits][(e|E)[+-]digits]
+    bool json_number(const std::string& s) {
+        size_t pos = (!s.empty() && s[0] == '-') ? 1 : 0;
+        const auto digits = [&s, &pos] {
+            const size_t start = pos;
+            while (pos < s.size() && std::isdigit(static_cast<unsigned char>(s[pos]))) {
+                ++pos;
+            }
+            return pos > start;
+        };
+        if (!digits()) {
+            return false;
+        }
+        if (pos < s.size() && s[pos] == '.') {
+            ++pos;
+            if (!digits()) {
+                return false;
+            }
+        }
+        if (pos < s.size() && (s[pos] == 'e' || s[pos] == 'E')) {
+            ++pos;
+            if (pos < s.size() && (s[pos] == '+' || s[pos] == '-')) {
+                ++pos;
+            }
+            if (!digits()) {
+                return false;
+            }
+        }
+        return pos == s.size();
+    }
+
+    const char* game_status_name(const int game_end) {
+        switch (game_end) {
+            case kGameCheckmate:            return "checkmate";
+            case kGameStalemate:            return "stalemate";
+            case kGameThreefold:            return "threefold";
+            case kGameFiftyMove:            return "fifty_move";
+            case kGameInsufficientMaterial: return "insufficient_material";
+            default:                        return "ongoing";
+        }
+    }
+}
+
+
+bool Service::parse_request(const std::string& line, request_t& request, std::string& error) {
+    size_t pos = 0;
+    skip_space(line, pos);
+    if (pos >= line.size() || line[pos] != '{') {
+        error = "request is not a JSON object";
+        return false;
+    }
+    ++pos;
+    skip_space(line, pos);
+    bool first = true;
+    while (pos < line.size() && line[pos] != '}') {
+        if (!first) {
+            if (line[pos] != ',') {
+                error = "malformed JSON";
+                return false;
+            }
+            ++pos;
+            skip_space(line, pos);
+        }
+        first = false;
+        std::string key, raw, text;
+        if (!parse_string(line, pos, key)) {
+            error = "malformed JSON";
+            return false;
+        }
+        skip_space(line, pos);
+        if (pos >= line.size() || line[pos] != ':') {
+            error = "malformed JSON";
+            return false;
+        }
+        ++pos;
+        skip_space(line, pos);
+        if (!parse_value(line, pos, raw, text)) {
+            error = "unsupported or malformed value for \"" + key + "\"";
+            return false;
+        }
+        skip_space(line, pos);
+
+        if (key == "id") {
+            // strings are written back re-escaped, anything but a number is refused
+            if (raw[0] == '"') {
+                request.id = Service::json_string(text);
+            } else if (json_number(raw)) {
+                request.id = raw;
+            } else {
+                error = "id must be a number or a string";
+                return false;
+            }
+        } else if (key == "cmd") {
+            request.cmd = text;
+        } else if (key == "fen") {
+            request.fen = text;
+        } else if (key == "depth") {
+            char* end = nullptr;
+            request.depth = std::strtol(text.c_str(), &end, 10);
+            if (text.empty() || *end != '\0') {
+                error = "depth must be an integer";
+                return false;
+            }
+        }
+    }
+    if (pos >= line.size()) {
+        error = "malformed JSON";
+        return false;
+    }
+    if (request.cmd.empty()) {
+        error = "missing cmd";
+        return false;
+    }
+    return true;
+}
+
+std::string Service::json_string(const std::string& text) {
+    std::string out { "\"" };
+    for (const char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            out.push_back('\\');
+            out.push_back(ch);
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            out += ' ';
+        } else {
+            out.push_back(ch);
+        }
+    }
+    out.push_back('"');
+    return out;
+}
+
+std::string Service::error_response(const std::string& id, const std::string& error) {
+    return "{\"id\":" + id + ",\"ok\":false,\"error\":" + Service::json_string(error) + "}";
+}
+
+int Service::run(const int threads, const std::string& socket_path) {
+    signal(SIGPIPE, SIG_IGN);
+    JobQueue queue(threads * kQueuePerWorker);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(worker, std::ref(queue));
+    }
+
+    if (socket_path.empty()) {
+        auto out = std::make_shared<output_t>(STDOUT_FILENO);
+        read_lines(STDIN_FILENO, [&](std::string&& line) { queue.push({ std::move(line), out }); });
+        queue.close();
+        for (auto& th : workers) {
+            th.join();
+        }
+        return 0;
+    }
+
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Socket path too long: %s", socket_path.c_str());
+        return 1;
+    }
+    std::strcpy(addr.sun_path, socket_path.c_str());
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+        LOG_ERROR("Cannot listen on %s: %s", socket_path.c_str(), strerror(errno));
+        return 1;
+    }
+    printf("Serving on %s with %d workers\n", socket_path.c_str(), threads);
+    fflush(stdout);
+    std::list<reader_t> readers;
+    while (true) {
+        const int client_fd = accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("accept failed: %s", strerror(errno));
+            break;
+        }
+        for (auto it = readers.begin(); it != readers.end();) {
+            std::unique_lock lock(it->mutex);
+            if (!it->done) {
+                ++it;
+                continue;
+            }
+            lock.unlock();
+            it->thread.join();
+            it = readers.erase(it);
+        }
+        // the connection is closed once it is read to the end and its last response is written
+        auto& reader = readers.emplace_back();
+        reader.fd = client_fd;
+        reader.thread = std::thread([client_fd, &queue, &reader] {
+            auto out = std::make_shared<output_t>(client_fd);
+            read_lines(client_fd, [&](std::string&& line) { queue.push({ std::move(line), out }); });
+            std::lock_guard lock(reader.mutex);
+            reader.done = true;
+        });
+    }
+    close(listen_fd);
+    // readers still pushing into the queue are stopped before it closes
+    for (auto& reader : readers) {
+        {
+            std::lock_guard lock(reader.mutex);
+            if (!reader.done) {
+                shutdown(reader.fd, SHUT_RD);
+            }
+        }
+        reader.thread.join();
+    }
+    queue.close();
+    for (auto& th : workers) {
+        th.join();
+    }
+    return 1;
+}
+
+
+/**
+ * @brief Answers one service request; the board is reset to the request's position.
+ *
+ * @return JSON response line (without the newline)
+ */
+std::string Board::service_response(const Service::request_t& request) {
+    const std::string fen = request.fen.empty() ? Fen::kFenInitial : Strfuns::strip_copy(request.fen);
+    if (!Fen::fen_valid(fen)) {
+        return Service::error_response(request.id, "invalid FEN");
+    }
+    if (!set_fen(fen)) {
+        return Service::error_response(request.id, "illegal position");
+    }
+
+    std::string response = "{\"id\":" + request.id + ",\"ok\":true,";
+    char buffer[128];
+    if (request.cmd == "moves") {
+        response += "\"moves\":[";
+        bool first = true;
+        for (const auto& [from_num, to_num] : legal_moves()) {
+            const bool promotion = _chessboard[from_num].piece() == 'p' && (to_num / 8 == 0 || to_num / 8 == 7);
+            for (const char promote_to : { 'q', 'r', 'b', 'n' }) {
+                response += first ? "\"" : ",\"";
+                response += num_to_alg(from_num) + num_to_alg(to_num);
+                if (promotion) {
+                    response.push_back(promote_to);
+                }
+                response.push_back('"');
+                first = false;
+                if (!promotion) {
+                    break;
+                }
+            }
+        }
+        response += "]}";
+    } else if (request.cmd == "perft") {
+        if (request.depth < 0 || request.depth > Service::kMaxPerftDepth) {
+            return Service::error_response(request.id, "perft depth must be between 0 and " + std::to_string(Service::kMaxPerftDepth));
+        }
+        const auto s_tm = std::chrono::high_resolution_clock::now();
+        int64_t nodes = 0;
+        {
+            STATS_TIMER(kTimerPerft);
+            nodes = perft(request.depth);
+        }
+        const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+        snprintf(buffer, sizeof(buffer), "\"nodes\":%ld,\"time_ms\":%.3lf}", nodes, t_tm.count());
+        response += buffer;
+    } else if (request.cmd == "status") {
+        snprintf(buffer, sizeof(buffer), "\"status\":\"%s\",\"check\":%s}", game_status_name(detect_game_end(false)),
+                 is_in_check() ? "true" : "false");
+        response += buffer;
+    } else if (request.cmd == "eval") {
+        snprintf(buffer, sizeof(buffer), "\"eval\":%d}", evaluate());
+        response += buffer;
+    } else if (request.cmd == "search") {
+        const int depth = (request.depth < 0) ? Service::kDefaultSearchDepth : request.depth;
+        if (depth < 1 || depth > Service::kMaxSearchDepth) {
+            return Service::error_response(request.id, "search depth must be between 1 and " + std::to_string(Service::kMaxSearchDepth));
+        }
+        const auto result = search(depth, false);
+        std::string best = search_move_str(result);
+        best.back() = std::tolower(best.back()); // promotion piece, as in "moves"
+        snprintf(buffer, sizeof(buffer), "\"best\":\"%s\",\"score\":%d,\"depth\":%d,\"nodes\":%lu}",
+                 best.c_str(), result.score, result.depth, _search_stats.nodes);
+        response += buffer;
+    } else {
+        return Service::error_response(request.id, "unknown cmd: " + request.cmd);
+    }
+    return response;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+
+// Batch analysis service: `crudechess_board serve [THREADS] [SOCKET]'
+// Reads newline-delimited JSON requests from stdin, or from every client of a Unix
+// domain socket, and answers each with one JSON line on the same stream:
+//     {"id": 7, "cmd": "perft", "fen": "<FEN>", "depth": 4}
+//     {"id":7,"ok":true,"nodes":197281,"time_ms":35.2}
+// Commands (fen defaults to the starting position):
+//     moves           - "moves": ["e2e4", ...] (promotions as e7e8q)
+//     perft, depth    - "nodes", "time_ms"
+//     status          - "status": ongoing|checkmate|stalemate|threefold|fifty_move|insufficient_material, "check"
+//     eval            - "eval" (centipawns, relative to the player to move)
+//     search, depth   - "best", "score", "depth", "nodes"
+// Errors are answered with {"id":...,"ok":false,"error":"..."}. The id is echoed
+// back; it has to be a JSON number or string. FENs are checked for legality too
+// (kings, checks, castling rights, en passant square).
+//
+// Requests are served by a pool of worker threads, each owning a Board that is
+// reused between requests. Responses are streamed as soon as they are ready, so
+// they can come out of order when there is more than one worker.
+namespace Service {
+    static constexpr int kMaxPerftDepth { 8 };
+    static constexpr int kMaxSearchDepth { 12 };
+    static constexpr int kDefaultSearchDepth { 4 };
+    static constexpr int kQueuePerWorker { 256 };
+
+    struct request_t {
+        std::string id = "null";
+        std::string cmd;
+        std::string fen;
+        int depth = -1;
+    };
+
+    // quoted and escaped, control characters replaced by spaces
+    std::string json_string(const std::string& text);
+    bool parse_request(const std::string& line, request_t& request, std::string& error);
+    std::string error_response(const std::string& id, const std::string& error);
+    int run(const int threads, const std::string& socket_path);
+}
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "stats.hh"
+
+
+namespace {
+    constexpr const char* kCounterNames[Stats::kCounterCount] {
+        "nodes", "make_move", "unmake_move", "get_legal_moves", "count_legal_moves", "is_in_check",
+        "pseudolegal rejected", "pawn hash probes", "pawn hash hits", "perft hash probes", "perft hash hits",
+        "tablebase probes", "tablebase hits"
+    };
+    constexpr const char* kTimerNames[Stats::kTimerCount] {
+        "move generation", "evaluation", "search", "perft"
+    };
+
+    [[maybe_unused]] std::mutex registry_mutex;
+    [[maybe_unused]] std::vector<std::unique_ptr<Stats::thread_stats_t>> registry;
+}
+
+
+#ifdef CRUDECHESS_STATS
+Stats::thread_stats_t* Stats::register_thread() {
+    auto stats = std::make_unique<thread_stats_t>();
+    std::memset(stats.get(), 0, sizeof(thread_stats_t));
+    std::lock_guard lock(registry_mutex);
+    registry.push_back(std::move(stats));
+    return registry.back().get();
+}
+#endif
+
+/**
+ * @brief Sums the counters of all threads, including finished ones. Threads that
+ * are still running may be a few increments ahead of the result.
+ */
+Stats::thread_stats_t Stats::snapshot() {
+    thread_stats_t total;
+    std::memset(&total, 0, sizeof(total));
+#ifdef CRUDECHESS_STATS
+    std::lock_guard lock(registry_mutex);
+    for (const auto& stats : registry) {
+        for (int i = 0; i < kCounterCount; ++i) {
+            total.counters[i] += stats->counters[i];
+        }
+        for (int i = 0; i < kTimerCount; ++i) {
+            total.cycles[i] += stats->cycles[i];
+            total.timer_calls[i] += stats->timer_calls[i];
+        }
+    }
+#endif
+    return total;
+}
+
+void Stats::reset() {
+#ifdef CRUDECHESS_STATS
+    std::lock_guard lock(registry_mutex);
+    for (auto& stats : registry) {
+        std::memset(stats.get(), 0, sizeof(thread_stats_t));
+    }
+#endif
+}
+
+void Stats::print() {
+    if (!kEnabled) {
+        printf("Statistics not compiled in (configure with -DCRUDECHESS_STATS=ON)\n");
+        return;
+    }
+    const auto total = snapshot();
+    printf("Counter                         Value\n");
+    for (int i = 0; i < kCounterCount; ++i) {
+        printf("%-24s %12lu\n", kCounterNames[i], total.counters[i]);
+    }
+    if (total.counters[kPawnHashProbes]) {
+        printf("%-24s %11.1lf%%\n", "pawn hash hit rate", 100.0 * total.counters[kPawnHashHits] / total.counters[kPawnHashProbes]);
+    }
+    if (total.counters[kPerftHashProbes]) {
+        printf("%-24s %11.1lf%%\n", "perft hash hit rate", 100.0 * total.counters[kPerftHashHits] / total.counters[kPerftHashProbes]);
+    }
+    printf("Timer                           Calls        Cycles   Cycles/call\n");
+    for (int i = 0; i < kTimerCount; ++i) {
+        const uint64_t calls = total.timer_calls[i];
+        printf("%-24s %12lu %13lu %13.1lf\n", kTimerNames[i], calls, total.cycles[i], calls ? static_cast<double>(total.cycles[i]) / calls : 0.0);
+    }
+}
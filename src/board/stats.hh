@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(CRUDECHESS_STATS) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif defined(CRUDECHESS_STATS)
+#include <chrono>
+#endif
+
+// Hot-path performance counters, compiled in with -DCRUDECHESS_STATS=ON
+// Every thread increments its own cache-line-aligned block of counters, so
+// counting needs neither atomics nor shared cache lines; blocks are registered
+// once per thread and summed when a report is requested. Timers measure TSC
+// cycles (nanoseconds on non-x86 targets) of a scope.
+// Without CRUDECHESS_STATS the STATS_* macros expand to nothing.
+namespace Stats {
+    enum counter_t {
+        kNodes = 0,
+        kMakeMove,
+        kUnmakeMove,
+        kLegalMoveGen,
+        kLegalMoveCount,
+        kInCheck,
+        kPseudolegalRejected,
+        kPawnHashProbes,
+        kPawnHashHits,
+        kPerftHashProbes,
+        kPerftHashHits,
+        kTablebaseProbes,
+        kTablebaseHits,
+        kCounterCount
+    };
+
+    enum timer_t {
+        kTimerMoveGen = 0,
+        kTimerEval,
+        kTimerSearch,
+        kTimerPerft,
+        kTimerCount
+    };
+
+    struct alignas(64) thread_stats_t {
+        uint64_t counters[kCounterCount];
+        uint64_t cycles[kTimerCount];
+        uint64_t timer_calls[kTimerCount];
+    };
+
+#ifdef CRUDECHESS_STATS
+    static constexpr bool kEnabled { true };
+
+    thread_stats_t* register_thread();
+
+    inline thread_stats_t& local() {
+        static thread_local thread_stats_t* stats = nullptr;
+        if (__builtin_expect(stats == nullptr, 0)) {
+            stats = register_thread();
+        }
+        return *stats;
+    }
+
+    inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(const timer_t timer) : _timer(timer), _start(cycles()) {}
+        ~ScopedTimer() {
+            auto& stats = local();
+            stats.cycles[_timer] += cycles() - _start;
+            ++stats.timer_calls[_timer];
+        }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        timer_t _timer;
+        uint64_t _start;
+    };
+#else
+    static constexpr bool kEnabled { false };
+#endif
+
+    thread_stats_t snapshot();
+    void reset();
+    void print();
+}
+
+#ifdef CRUDECHESS_STATS
+#define STATS_ADD(counter, n)   (Stats::local().counters[Stats::counter] += (n))
+#define STATS_INC(counter)      STATS_ADD(counter, 1)
+#define STATS_CONCAT_(a, b)     a##b
+#define STATS_CONCAT(a, b)      STATS_CONCAT_(a, b)
+#define STATS_TIMER(timer)      Stats::ScopedTimer STATS_CONCAT(stats_timer_, __LINE__)(Stats::timer)
+#else
+#define STATS_ADD(counter, n)   ((void)0)
+#define STATS_INC(counter)      ((void)0)
+#define STATS_TIMER(timer)      ((void)0)
+#endif
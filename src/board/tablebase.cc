@@ -0,0 +1,929 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "board.hh"
+#include "stats.hh"
+#include "tablebase.hh"
+
+#include "log.hh"
+
+
+namespace {
+    using Tablebase::kMaxPieces;
+
+    constexpr auto kPieceOrder { "KQRBNP" };
+    constexpr uint8_t kValueUnknown { 255 };
+    constexpr uint8_t kNoExitWin { 255 };
+    constexpr int kMaxPlies { kValueUnknown - Tablebase::kValueMateBase - 1 };
+    constexpr int kBlockSize { 4096 };
+    constexpr uint64_t kNoIndex { ~0ULL };
+
+    // Material signature resolved into index slots: [0] white king, [1] black king,
+    // then white and black pieces in signature order.
+    struct material_t {
+        std::string signature;
+        int count = 0;
+        char colours[kMaxPieces] {};
+        char pieces[kMaxPieces] {};
+        bool pawns = false;
+        int king_pairs = 0;
+        uint64_t entries = 0;
+    };
+
+    struct tb_pos_t {
+        int sq[kMaxPieces];
+        int side;   // 0 - white to move, 1 - black to move
+    };
+
+    struct loaded_table_t {
+        material_t material;
+        const uint8_t* values = nullptr;
+        void* map = nullptr;
+        size_t map_size = 0;
+
+        ~loaded_table_t() {
+            if (map) {
+                munmap(map, map_size);
+            }
+        }
+    };
+
+    // The loaded tables are an immutable snapshot: a load publishes a new one and a
+    // probe keeps the snapshot it started with alive, so a table replaced by a
+    // reload is unmapped only once no probe uses it any more.
+    struct tables_t {
+        std::unordered_map<uint64_t, std::shared_ptr<const loaded_table_t>> by_material;
+        int max_pieces = 0;
+    };
+
+    std::mutex loaded_mutex;    // serialises loads
+    std::atomic<std::shared_ptr<const tables_t>> loaded_tables { std::make_shared<const tables_t>() };
+    // copy of the snapshot's max_pieces, to turn away big positions without touching it
+    std::atomic<int> loaded_max_pieces { 0 };
+
+    constexpr bool kings_apart(const int wk, const int bk) {
+        const int rank_distance = wk / 8 > bk / 8 ? wk / 8 - bk / 8 : bk / 8 - wk / 8;
+        const int file_distance = wk % 8 > bk % 8 ? wk % 8 - bk % 8 : bk % 8 - wk % 8;
+        return rank_distance > 1 || file_distance > 1;
+    }
+
+    // Index of the two kings: the white king in its symmetry region, the black king
+    // on any square apart from it (neither the same nor adjacent). Without pawns a
+    // white king on the a1-h8 diagonal keeps the black king on or below it.
+    struct king_pairs_t {
+        int16_t index[64][64];      // [wk][bk], -1 if not a canonical pair
+        uint8_t squares[Tablebase::kKingPairsPawns][2];
+        int count;
+    };
+
+    constexpr king_pairs_t make_king_pairs(const bool pawns) {
+        king_pairs_t pairs {};
+        pairs.count = 0;
+        for (int wk = 0; wk < 64; ++wk) {
+            const int wk_file = wk % 8;
+            const int wk_rank = wk / 8;
+            for (int bk = 0; bk < 64; ++bk) {
+                pairs.index[wk][bk] = -1;
+                if (wk_file > 3 || (!pawns && wk_rank > wk_file) || !kings_apart(wk, bk)) {
+                    continue;
+                }
+                if (!pawns && wk_rank == wk_file && bk / 8 > bk % 8) {
+                    continue;
+                }
+                pairs.index[wk][bk] = pairs.count;
+                pairs.squares[pairs.count][0] = wk;
+                pairs.squares[pairs.count][1] = bk;
+                ++pairs.count;
+            }
+        }
+        return pairs;
+    }
+    // [0] without pawns, [1] with pawns
+    constexpr king_pairs_t kKingPairs[2] { make_king_pairs(false), make_king_pairs(true) };
+    static_assert(kKingPairs[0].count == Tablebase::kKingPairsPawnless && kKingPairs[1].count == Tablebase::kKingPairsPawns);
+
+    inline int flip_file(const int sq_num) { return sq_num ^ 7; }
+    inline int flip_rank(const int sq_num) { return sq_num ^ 56; }
+    inline int transpose(const int sq_num) { return ((sq_num & 7) << 3) | (sq_num >> 3); }
+
+    int piece_rank(const char piece) {
+        const char* p = std::strchr(kPieceOrder, piece);
+        return p ? static_cast<int>(p - kPieceOrder) : 6;
+    }
+
+    int piece_strength(const char piece) {
+        switch (piece) {
+            case 'Q':   return 9;
+            case 'R':   return 5;
+            case 'B':   return 3;
+            case 'N':   return 3;
+            case 'P':   return 1;
+            default:    return 0;
+        }
+    }
+
+    std::string sort_side(std::string side) {
+        std::sort(side.begin(), side.end(), [](const char a, const char b) {
+            return piece_rank(a) < piece_rank(b);
+        });
+        return side;
+    }
+
+    // Orders both sides and puts the stronger one first (as white)
+    std::string canonical_signature(const std::string& white, const std::string& black, bool& flipped) {
+        const std::string w = sort_side(white);
+        const std::string b = sort_side(black);
+        int w_strength = 0;
+        int b_strength = 0;
+        for (const auto ch : w) { w_strength += piece_strength(ch); }
+        for (const auto ch : b) { b_strength += piece_strength(ch); }
+        bool white_first = true;
+        if (w_strength != b_strength) {
+            white_first = w_strength > b_strength;
+        } else if (w.size() != b.size()) {
+            white_first = w.size() > b.size();
+        } else {
+            // same strength and size: the side with the earlier (heavier) pieces goes first
+            white_first = !std::lexicographical_compare(b.begin(), b.end(), w.begin(), w.end(), [](const char x, const char y) {
+                return piece_rank(x) < piece_rank(y);
+            });
+        }
+        flipped = !white_first;
+        return white_first ? w + "v" + b : b + "v" + w;
+    }
+
+    uint64_t material_key(const std::vector<piece_placement_t>& pieces, const bool flip) {
+        uint64_t key = 0;
+        for (const auto& pc : pieces) {
+            const bool white = (pc.colour == 'w') != flip;
+            key += 1ULL << (3 * ((white ? 0 : 6) + piece_rank(pc.piece - 32)));
+        }
+        return key;
+    }
+
+    uint64_t material_key(const material_t& m) {
+        std::vector<piece_placement_t> pieces;
+        for (int i = 0; i < m.count; ++i) {
+            pieces.push_back({ m.colours[i], m.pieces[i], 0 });
+        }
+        return material_key(pieces, false);
+    }
+
+    bool parse_signature(const std::string& signature, material_t& m) {
+        const size_t sep = signature.find('v');
+        if (sep == std::string::npos) {
+            return false;
+        }
+        std::string white = signature.substr(0, sep);
+        std::string black = signature.substr(sep+1);
+        std::transform(white.begin(), white.end(), white.begin(), ::toupper);
+        std::transform(black.begin(), black.end(), black.begin(), ::toupper);
+        for (const auto& side : { white, black }) {
+            if (std::count(side.begin(), side.end(), 'K') != 1 ||
+                side.find_first_not_of(kPieceOrder) != std::string::npos) {
+                return false;
+            }
+        }
+        if (white.size() + black.size() > static_cast<size_t>(kMaxPieces)) {
+            return false;
+        }
+
+        bool flipped = false;
+        m.signature = canonical_signature(white, black, flipped);
+        const std::string w = m.signature.substr(0, m.signature.find('v'));
+        const std::string b = m.signature.substr(m.signature.find('v')+1);
+        m.count = 0;
+        m.colours[m.count] = 'w'; m.pieces[m.count++] = 'k';
+        m.colours[m.count] = 'b'; m.pieces[m.count++] = 'k';
+        for (const auto& [colour, side] : { std::make_pair('w', w), std::make_pair('b', b) }) {
+            for (const auto ch : side) {
+                if (ch != 'K') {
+                    m.colours[m.count] = colour;
+                    m.pieces[m.count++] = ch + 32;
+                }
+            }
+        }
+        m.pawns = m.signature.find('P') != std::string::npos;
+        m.king_pairs = m.pawns ? Tablebase::kKingPairsPawns : Tablebase::kKingPairsPawnless;
+        m.entries = 2ULL * m.king_pairs;
+        for (int i = 2; i < m.count; ++i) {
+            m.entries *= 64;
+        }
+        return true;
+    }
+
+    // kNoIndex when the kings are not a canonical pair (adjacent or on one square)
+    uint64_t raw_index(const material_t& m, const tb_pos_t& pos) {
+        const int pair = kKingPairs[m.pawns].index[pos.sq[0]][pos.sq[1]];
+        if (pair < 0) {
+            return kNoIndex;
+        }
+        uint64_t idx = pos.side * m.king_pairs + pair;
+        for (int i = 2; i < m.count; ++i) {
+            idx = idx * 64 + pos.sq[i];
+        }
+        return idx;
+    }
+
+    void sort_identical(const material_t& m, tb_pos_t& pos) {
+        for (int i = 2; i < m.count; ++i) {
+            for (int j = i; j > 2 && m.pieces[j] == m.pieces[j-1] && m.colours[j] == m.colours[j-1] && pos.sq[j] < pos.sq[j-1]; --j) {
+                std::swap(pos.sq[j], pos.sq[j-1]);
+            }
+        }
+    }
+
+    template <typename Fn>
+    void transform(const material_t& m, tb_pos_t& pos, Fn fn) {
+        for (int i = 0; i < m.count; ++i) {
+            pos.sq[i] = fn(pos.sq[i]);
+        }
+    }
+
+    // Canonical index of a position: symmetry reduction, then identical piece ordering
+    uint64_t encode(const material_t& m, tb_pos_t pos) {
+        const int wk_file = pos.sq[0] % 8;
+        const int wk_rank = pos.sq[0] / 8;
+        if (wk_file > 3) {
+            transform(m, pos, flip_file);
+        }
+        if (!m.pawns) {
+            if (wk_rank > 3) {
+                transform(m, pos, flip_rank);
+            }
+            if (pos.sq[0] / 8 > pos.sq[0] % 8) {
+                transform(m, pos, transpose);
+            }
+            if (pos.sq[0] / 8 == pos.sq[0] % 8 && pos.sq[1] / 8 > pos.sq[1] % 8) {
+                // white king on the diagonal: the black king goes on or below it
+                transform(m, pos, transpose);
+            }
+            if (pos.sq[0] / 8 == pos.sq[0] % 8 && pos.sq[1] / 8 == pos.sq[1] % 8) {
+                // both kings on the diagonal: both reflections are canonical, take the lower index
+                tb_pos_t other = pos;
+                transform(m, other, transpose);
+                sort_identical(m, pos);
+                sort_identical(m, other);
+                return std::min(raw_index(m, pos), raw_index(m, other));
+            }
+        }
+        sort_identical(m, pos);
+        return raw_index(m, pos);
+    }
+
+    void decode(const material_t& m, uint64_t idx, tb_pos_t& pos) {
+        for (int i = m.count-1; i > 1; --i) {
+            pos.sq[i] = idx % 64;
+            idx /= 64;
+        }
+        const int pair = idx % m.king_pairs;
+        pos.sq[0] = kKingPairs[m.pawns].squares[pair][0];
+        pos.sq[1] = kKingPairs[m.pawns].squares[pair][1];
+        pos.side = idx / m.king_pairs;
+    }
+
+    // Mailbox with FEN letters, for attack tests and un-move generation
+    void fill_mailbox(const material_t& m, const tb_pos_t& pos, char* mailbox) {
+        std::memset(mailbox, 0, 64);
+        for (int i = 0; i < m.count; ++i) {
+            mailbox[pos.sq[i]] = (m.colours[i] == 'w') ? m.pieces[i] - 32 : m.pieces[i];
+        }
+    }
+
+    constexpr int kKingSteps[8][2] { {1, 1}, {1, 0}, {1, -1}, {0, 1}, {0, -1}, {-1, 1}, {-1, 0}, {-1, -1} };
+    constexpr int kKnightSteps[8][2] { {1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1} };
+
+    inline bool on_board(const int row, const int col) {
+        return 0 <= row && row <= 7 && 0 <= col && col <= 7;
+    }
+
+    bool attacked(const char* mailbox, const int sq_num, const bool by_white) {
+        const int row = sq_num / 8;
+        const int col = sq_num % 8;
+        const auto is = [&](const int r, const int c, const char piece) {
+            return on_board(r, c) && mailbox[r*8 + c] == (by_white ? piece - 32 : piece);
+        };
+        const int pawn_row = by_white ? row - 1 : row + 1;
+        if (is(pawn_row, col-1, 'p') || is(pawn_row, col+1, 'p')) {
+            return true;
+        }
+        for (const auto& step : kKingSteps) {
+            if (is(row + step[0], col + step[1], 'k')) {
+                return true;
+            }
+        }
+        for (const auto& step : kKnightSteps) {
+            if (is(row + step[0], col + step[1], 'n')) {
+                return true;
+            }
+        }
+        for (const auto& step : kKingSteps) {
+            const char slider = (step[0] != 0 && step[1] != 0) ? 'b' : 'r';
+            int r = row + step[0];
+            int c = col + step[1];
+            while (on_board(r, c)) {
+                if (is(r, c, slider) || is(r, c, 'q')) {
+                    return true;
+                } else if (mailbox[r*8 + c]) {
+                    break;
+                }
+                r += step[0];
+                c += step[1];
+            }
+        }
+        return false;
+    }
+
+    bool position_valid(const material_t& m, const tb_pos_t& pos, char* mailbox) {
+        uint64_t occupied = 0;
+        for (int i = 0; i < m.count; ++i) {
+            const uint64_t bit = 1ULL << pos.sq[i];
+            if (occupied & bit) {
+                return false;
+            }
+            occupied |= bit;
+            if (m.pieces[i] == 'p' && (pos.sq[i] / 8 == 0 || pos.sq[i] / 8 == 7)) {
+                return false;
+            }
+        }
+        fill_mailbox(m, pos, mailbox);
+        // the player who has just moved cannot be in check
+        const int their_king = pos.side == 0 ? pos.sq[1] : pos.sq[0];
+        return !attacked(mailbox, their_king, pos.side == 0);
+    }
+
+    void to_placements(const material_t& m, const tb_pos_t& pos, std::vector<piece_placement_t>& pieces) {
+        pieces.clear();
+        for (int i = 0; i < m.count; ++i) {
+            pieces.push_back({ m.colours[i], m.pieces[i], pos.sq[i] });
+        }
+    }
+
+    const loaded_table_t* find_table(const tables_t& tables, const std::vector<piece_placement_t>& pieces, bool& flip) {
+        flip = false;
+        auto it = tables.by_material.find(material_key(pieces, false));
+        if (it == tables.by_material.end()) {
+            flip = true;
+            it = tables.by_material.find(material_key(pieces, true));
+            if (it == tables.by_material.end()) {
+                return nullptr;
+            }
+        }
+        return it->second.get();
+    }
+
+    Tablebase::tb_result_t decode_value(const uint8_t value) {
+        if (value == Tablebase::kValueInvalid || value == kValueUnknown) {
+            return { false, 0, 0 };
+        }
+        if (value == Tablebase::kValueDraw) {
+            return { true, 0, 0 };
+        }
+        const int plies = value - Tablebase::kValueMateBase;
+        return { true, (plies % 2) ? 1 : -1, plies };
+    }
+
+    Tablebase::tb_result_t lookup(const tables_t& tables, const std::vector<piece_placement_t>& pieces, const char to_move) {
+        const int count = pieces.size();
+        if (count > tables.max_pieces && count > 2) {
+            return { false, 0, 0 };
+        }
+        if (count == 2) {
+            return { true, 0, 0 };
+        }
+        bool flip = false;
+        const loaded_table_t* table = find_table(tables, pieces, flip);
+        if (!table) {
+            return { false, 0, 0 };
+        }
+
+        const material_t& m = table->material;
+        tb_pos_t pos;
+        pos.side = ((to_move == 'w') != flip) ? 0 : 1;
+        bool used[kMaxPieces] {};
+        for (int slot = 0; slot < m.count; ++slot) {
+            for (int i = 0; i < count; ++i) {
+                const char colour = ((pieces[i].colour == 'w') != flip) ? 'w' : 'b';
+                if (!used[i] && colour == m.colours[slot] && pieces[i].piece == m.pieces[slot]) {
+                    used[i] = true;
+                    pos.sq[slot] = flip ? flip_rank(pieces[i].sq_num) : pieces[i].sq_num;
+                    break;
+                }
+            }
+        }
+        const uint64_t idx = encode(m, pos);
+        return idx == kNoIndex ? Tablebase::tb_result_t { false, 0, 0 } : decode_value(table->values[idx]);
+    }
+
+    // Splits [0, size) into blocks handed out to `threads' workers
+    template <typename Fn>
+    void parallel_for(const int threads, const uint64_t size, Fn fn) {
+        std::atomic<uint64_t> next_block { 0 };
+        const auto worker = [&](const int thread_id) {
+            for (;;) {
+                const uint64_t begin = next_block.fetch_add(kBlockSize);
+                if (begin >= size) {
+                    break;
+                }
+                fn(begin, std::min(begin + kBlockSize, size), thread_id);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (int t = 1; t < threads; ++t) {
+            pool.emplace_back(worker, t);
+        }
+        worker(0);
+        for (auto& th : pool) {
+            th.join();
+        }
+    }
+
+    // Positions the player who has just moved could have come from, without captures
+    // or promotions (those lead in from other tables).
+    void unmove_predecessors(const material_t& m, const tb_pos_t& pos, std::vector<uint64_t>& preds) {
+        char mailbox[64];
+        fill_mailbox(m, pos, mailbox);
+        const char mover = pos.side == 0 ? 'b' : 'w';
+        const int defender_king = pos.side == 0 ? pos.sq[0] : pos.sq[1];
+        preds.clear();
+
+        const auto try_from = [&](const int slot, const int from_num) {
+            tb_pos_t prev = pos;
+            prev.sq[slot] = from_num;
+            prev.side = 1 - pos.side;
+            char prev_mailbox[64];
+            std::memcpy(prev_mailbox, mailbox, 64);
+            prev_mailbox[from_num] = mailbox[pos.sq[slot]];
+            prev_mailbox[pos.sq[slot]] = 0;
+            // the defender cannot have been left in check before the move
+            if (attacked(prev_mailbox, defender_king, mover == 'w')) {
+                return;
+            }
+            const uint64_t prev_idx = encode(m, prev);
+            if (prev_idx != kNoIndex) {
+                preds.push_back(prev_idx);
+            }
+        };
+
+        for (int slot = 0; slot < m.count; ++slot) {
+            if (m.colours[slot] != mover) {
+                continue;
+            }
+            const int sq_num = pos.sq[slot];
+            const int row = sq_num / 8;
+            const int col = sq_num % 8;
+            const char piece = m.pieces[slot];
+            if (piece == 'p') {
+                const int back = (mover == 'w') ? -1 : 1;
+                const int start_row = (mover == 'w') ? 1 : 6;
+                const int one = (row + back) * 8 + col;
+                if (row + back != (mover == 'w' ? 0 : 7) && !mailbox[one]) {
+                    try_from(slot, one);
+                    const int two = (row + 2*back) * 8 + col;
+                    if (row + 2*back == start_row && !mailbox[two]) {
+                        try_from(slot, two);
+                    }
+                }
+            } else if (piece == 'k' || piece == 'n') {
+                for (const auto& step : (piece == 'k' ? kKingSteps : kKnightSteps)) {
+                    const int r = row + step[0];
+                    const int c = col + step[1];
+                    if (on_board(r, c) && !mailbox[r*8 + c]) {
+                        try_from(slot, r*8 + c);
+                    }
+                }
+            } else {
+                for (const auto& step : kKingSteps) {
+                    const bool diagonal = step[0] != 0 && step[1] != 0;
+                    if ((diagonal && piece == 'r') || (!diagonal && piece == 'b')) {
+                        continue;
+                    }
+                    int r = row + step[0];
+                    int c = col + step[1];
+                    while (on_board(r, c) && !mailbox[r*8 + c]) {
+                        try_from(slot, r*8 + c);
+                        r += step[0];
+                        c += step[1];
+                    }
+                }
+            }
+        }
+        std::sort(preds.begin(), preds.end());
+        preds.erase(std::unique(preds.begin(), preds.end()), preds.end());
+    }
+
+    bool write_table(const material_t& m, const std::string& path, const std::vector<uint8_t>& values) {
+        Tablebase::tb_file_header_t header {};
+        std::memcpy(header.magic, Tablebase::kFileMagic, sizeof(header.magic));
+        header.version = Tablebase::kFileVersion;
+        std::strncpy(header.signature, m.signature.c_str(), sizeof(header.signature) - 1);
+        header.entries = m.entries;
+        header.flags = m.pawns ? 1 : 0;
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(values.data()), values.size());
+        return static_cast<bool>(file);
+    }
+
+    std::vector<std::string> sub_signatures(const material_t& m) {
+        std::vector<std::string> subs;
+        std::string sides[2];
+        for (int i = 0; i < m.count; ++i) {
+            sides[m.colours[i] == 'w' ? 0 : 1].push_back(m.pieces[i] - 32);
+        }
+        for (int c = 0; c < 2; ++c) {
+            for (size_t i = 0; i < sides[c].size(); ++i) {
+                const char piece = sides[c][i];
+                if (piece == 'K') {
+                    continue;
+                }
+                std::string reduced[2] { sides[0], sides[1] };
+                reduced[c].erase(i, 1);
+                bool flipped = false;
+                if (reduced[0].size() + reduced[1].size() > 2) {
+                    subs.push_back(canonical_signature(reduced[0], reduced[1], flipped));
+                }
+                if (piece == 'P') {
+                    for (const char promoted : { 'Q', 'R', 'B', 'N' }) {
+                        std::string promo[2] { sides[0], sides[1] };
+                        promo[c][i] = promoted;
+                        subs.push_back(canonical_signature(promo[0], promo[1], flipped));
+                    }
+                }
+            }
+        }
+        std::sort(subs.begin(), subs.end());
+        subs.erase(std::unique(subs.begin(), subs.end()), subs.end());
+        return subs;
+    }
+}
+
+
+/**
+ * @brief Memory-maps a table file and registers it for probing.
+ */
+bool Tablebase::load(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(tb_file_header_t)) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    tb_file_header_t header;
+    std::memcpy(&header, map, sizeof(header));
+    auto table = std::make_unique<loaded_table_t>();
+    if (std::memcmp(header.magic, kFileMagic, sizeof(header.magic)) != 0 || header.version != kFileVersion ||
+        !parse_signature(std::string(header.signature, strnlen(header.signature, sizeof(header.signature))), table->material) ||
+        table->material.entries != header.entries || sizeof(header) + header.entries > static_cast<size_t>(st.st_size)) {
+        LOG_WARNING("Not a valid tablebase file: %s", path.c_str());
+        munmap(map, st.st_size);
+        return false;
+    }
+    madvise(map, st.st_size, MADV_RANDOM);
+    table->map = map;
+    table->map_size = st.st_size;
+    table->values = static_cast<const uint8_t*>(map) + sizeof(header);
+
+    std::lock_guard<std::mutex> lock(loaded_mutex);
+    auto tables = std::make_shared<tables_t>(*loaded_tables.load());
+    tables->max_pieces = std::max(tables->max_pieces, table->material.count);
+    tables->by_material[material_key(table->material)] = std::move(table);
+    loaded_max_pieces = tables->max_pieces;
+    loaded_tables.store(std::move(tables));
+    return true;
+}
+
+int Tablebase::load_directory(const std::string& directory) {
+    int loaded = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (entry.path().extension() == kFileExtension && load(entry.path().string())) {
+            ++loaded;
+        }
+    }
+    return loaded;
+}
+
+int Tablebase::max_pieces() {
+    return loaded_max_pieces;
+}
+
+/**
+ * @brief Looks up a position. O(1): one hash map lookup for the material, the
+ * index computation and a single byte read from the mapped file.
+ */
+Tablebase::tb_result_t Tablebase::probe(const std::vector<piece_placement_t>& pieces, const char to_move) {
+    if (static_cast<int>(pieces.size()) > loaded_max_pieces.load(std::memory_order_relaxed) && pieces.size() > 2) {
+        return { false, 0, 0 };
+    }
+    const auto tables = loaded_tables.load();
+    return lookup(*tables, pieces, to_move);
+}
+
+/**
+ * @brief Generates the table for a material signature by retrograde analysis and
+ * writes it to `directory'. Tables reachable by captures and promotions are
+ * loaded from `directory' or generated first.
+ *
+ * The first pass runs Board's legal move generator on every position: it finds
+ * mates and stalemates, counts moves staying within the table, and resolves moves
+ * leaving it through the smaller tables. Then positions are resolved one ply level
+ * at a time: predecessors (un-moves) of positions lost in n plies are won in n+1,
+ * predecessors of positions won in n plies have their move counter decremented and
+ * are lost once every move loses. Whatever is left is drawn.
+ */
+bool Tablebase::generate(const std::string& signature, const std::string& directory, const int threads) {
+    material_t m;
+    if (!parse_signature(signature, m)) {
+        LOG_WARNING("Invalid material signature: %s", signature.c_str());
+        return false;
+    }
+    std::filesystem::create_directories(directory);
+    for (const auto& sub : sub_signatures(m)) {
+        material_t sub_m;
+        parse_signature(sub, sub_m);
+        if (loaded_tables.load()->by_material.count(material_key(sub_m))) {
+            continue;
+        }
+        if (!load(directory + "/" + sub + kFileExtension) && !generate(sub, directory, threads)) {
+            return false;
+        }
+    }
+
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    const uint64_t n = m.entries;
+    auto values = std::make_unique<std::atomic<uint8_t>[]>(n);
+    auto counters = std::make_unique<std::atomic<uint8_t>[]>(n);
+    std::vector<uint8_t> exit_win(n, kNoExitWin);
+    std::vector<uint8_t> exit_loss(n, 0);
+    std::vector<uint8_t> exit_draw(n, 0);
+    std::atomic<int> max_pending { 0 };
+    std::atomic<uint64_t> missing_exits { 0 };
+    // a mate longer than kMaxPlies has no value byte
+    std::atomic<bool> overflow { false };
+    const auto sub_tables = loaded_tables.load();
+
+    // pass 1: forward moves from every position
+    parallel_for(threads, n, [&](const uint64_t begin, const uint64_t end, const int) {
+        Board board;
+        std::vector<piece_placement_t> placements;
+        std::vector<uint64_t> children;
+        char mailbox[64];
+        for (uint64_t idx = begin; idx < end; ++idx) {
+            tb_pos_t pos;
+            decode(m, idx, pos);
+            values[idx] = kValueUnknown;
+            if (!position_valid(m, pos, mailbox) || encode(m, pos) != idx) {
+                values[idx] = kValueInvalid;
+                continue;
+            }
+            to_placements(m, pos, placements);
+            board.set_pieces(placements, pos.side == 0 ? 'w' : 'b');
+            const auto& moves = board.legal_moves();
+            if (moves.empty()) {
+                values[idx] = board.is_in_check() ? kValueMateBase : kValueDraw;
+                continue;
+            }
+
+            children.clear();
+            int win = kNoExitWin;
+            int loss = 0;
+            bool draw = false;
+            for (const auto& [from_num, to_num] : moves) {
+                int slot = 0;
+                int captured = -1;
+                for (int i = 0; i < m.count; ++i) {
+                    if (pos.sq[i] == from_num) {
+                        slot = i;
+                    } else if (pos.sq[i] == to_num) {
+                        captured = i;
+                    }
+                }
+                const bool promotion = m.pieces[slot] == 'p' && (to_num / 8 == 0 || to_num / 8 == 7);
+                if (captured == -1 && !promotion) {
+                    tb_pos_t child = pos;
+                    child.sq[slot] = to_num;
+                    child.side = 1 - pos.side;
+                    children.push_back(encode(m, child));
+                    continue;
+                }
+                for (const char promote_to : { 'q', 'r', 'b', 'n' }) {
+                    std::vector<piece_placement_t> child;
+                    for (int i = 0; i < m.count; ++i) {
+                        if (i == captured) {
+                            continue;
+                        }
+                        const char piece = (i == slot && promotion) ? promote_to : m.pieces[i];
+                        child.push_back({ m.colours[i], piece, i == slot ? to_num : pos.sq[i] });
+                    }
+                    const tb_result_t res = lookup(*sub_tables, child, pos.side == 0 ? 'b' : 'w');
+                    if (!res.found) {
+                        ++missing_exits;
+                    } else if (res.wdl < 0) {
+                        win = std::min(win, res.dtm + 1);
+                    } else if (res.wdl == 0) {
+                        draw = true;
+                    } else {
+                        loss = std::max(loss, res.dtm + 1);
+                    }
+                    if (!promotion) {
+                        break;
+                    }
+                }
+            }
+            if ((win != kNoExitWin && win > kMaxPlies) || loss > kMaxPlies) {
+                overflow = true;
+                continue;
+            }
+            std::sort(children.begin(), children.end());
+            children.erase(std::unique(children.begin(), children.end()), children.end());
+            counters[idx] = children.size();
+
+            if (children.empty()) {
+                // every move leaves the table, the outcome is already known
+                if (win != kNoExitWin) {
+                    values[idx] = kValueMateBase + win;
+                } else if (draw) {
+                    values[idx] = kValueDraw;
+                } else {
+                    values[idx] = kValueMateBase + loss;
+                }
+                int pending = max_pending.load();
+                const int level = (win != kNoExitWin) ? win : loss;
+                while (level > pending && !max_pending.compare_exchange_weak(pending, level)) {}
+                continue;
+            }
+            exit_win[idx] = win;
+            exit_loss[idx] = loss;
+            exit_draw[idx] = draw;
+            if (win != kNoExitWin) {
+                int pending = max_pending.load();
+                while (win > pending && !max_pending.compare_exchange_weak(pending, win)) {}
+            }
+        }
+    });
+    if (missing_exits) {
+        LOG_WARNING("%s: %lu exits into missing tables, treated as unknown", m.signature.c_str(), missing_exits.load());
+    }
+
+    // pass 2: retrograde propagation, one ply level at a time
+    int max_level = 0;
+    for (int level = 0; level <= kMaxPlies; ++level) {
+        std::atomic<uint64_t> at_level { 0 };
+        const uint8_t level_value = kValueMateBase + level;
+        parallel_for(threads, n, [&](const uint64_t begin, const uint64_t end, const int) {
+            std::vector<uint64_t> preds;
+            tb_pos_t pos;
+            for (uint64_t idx = begin; idx < end; ++idx) {
+                if (exit_win[idx] == level) {
+                    uint8_t expected = kValueUnknown;
+                    values[idx].compare_exchange_strong(expected, level_value);
+                }
+                if (values[idx].load(std::memory_order_relaxed) != level_value) {
+                    continue;
+                }
+                ++at_level;
+                decode(m, idx, pos);
+                unmove_predecessors(m, pos, preds);
+                for (const auto pred : preds) {
+                    if (level % 2 == 0) {
+                        if (level + 1 > kMaxPlies) {
+                            overflow = overflow || values[pred].load() == kValueUnknown;
+                            continue;
+                        }
+                        uint8_t expected = kValueUnknown;
+                        values[pred].compare_exchange_strong(expected, level_value + 1);
+                    } else if (counters[pred].fetch_sub(1) == 1 && exit_win[pred] == kNoExitWin && !exit_draw[pred]) {
+                        const int loss_level = std::max(level + 1, static_cast<int>(exit_loss[pred]));
+                        if (loss_level > kMaxPlies) {
+                            overflow = true;
+                            continue;
+                        }
+                        uint8_t expected = kValueUnknown;
+                        values[pred].compare_exchange_strong(expected, kValueMateBase + loss_level);
+                        int pending = max_pending.load();
+                        while (loss_level > pending && !max_pending.compare_exchange_weak(pending, loss_level)) {}
+                    }
+                }
+            }
+        });
+        if (at_level) {
+            max_level = level;
+        } else if (level > max_pending) {
+            break;
+        }
+    }
+
+    if (overflow) {
+        LOG_ERROR("%s: mate longer than %d plies, the table cannot store it and is not written", m.signature.c_str(), kMaxPlies);
+        return false;
+    }
+
+    std::vector<uint8_t> out(n);
+    uint64_t wins = 0, draws = 0, losses = 0;
+    for (uint64_t idx = 0; idx < n; ++idx) {
+        uint8_t value = values[idx];
+        if (value == kValueUnknown) {
+            value = kValueDraw;
+        }
+        out[idx] = value;
+        if (value == kValueDraw) {
+            ++draws;
+        } else if (value != kValueInvalid) {
+            ((value - kValueMateBase) % 2 ? wins : losses) += 1;
+        }
+    }
+
+    const std::string path = directory + "/" + m.signature + kFileExtension;
+    if (!write_table(m, path, out)) {
+        LOG_ERROR("Cannot write %s", path.c_str());
+        return false;
+    }
+    const std::chrono::duration<double> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    printf("%-8s %12lu entries  %10.1lf KB  %8.2lf s  W/D/L %lu/%lu/%lu  longest mate %d plies\n",
+           m.signature.c_str(), n, (n + sizeof(tb_file_header_t)) / 1024.0, t_tm.count(), wins, draws, losses, max_level);
+    fflush(stdout);
+    return load(path);
+}
+
+
+/**
+ * @brief Probes loaded tablebases for the current position. Positions with
+ * castling rights or a capturable en passant square are not in the tables.
+ */
+Tablebase::tb_result_t Board::probe_tablebase() const {
+    const size_t count = _white_pieces.size() + _black_pieces.size();
+    if (static_cast<int>(count) > Tablebase::max_pieces() || _castling_rights || ep_hash()) {
+        return { false, 0, 0 };
+    }
+    STATS_INC(kTablebaseProbes);
+    const auto result = Tablebase::probe(get_pieces(), _to_move);
+    if (result.found) {
+        STATS_INC(kTablebaseHits);
+    }
+    return result;
+}
+
+namespace {
+    std::string tb_result_str(const Tablebase::tb_result_t& res) {
+        if (!res.found) {
+            return "unknown";
+        } else if (res.wdl == 0) {
+            return "draw";
+        }
+        return std::string(res.wdl > 0 ? "win" : "loss") + " in " + std::to_string(res.dtm) + " plies";
+    }
+}
+
+void Board::show_tablebase_moves() {
+    const auto res = probe_tablebase();
+    if (!res.found) {
+        printf("Position not in loaded tablebases\n");
+        return;
+    }
+    printf("Tablebase: %s\n", tb_result_str(res).c_str());
+
+    std::vector<scored_move_t> moves;
+    generate_search_moves(moves, false);
+    for (const auto& mv : moves) {
+        const search_result_t as_result { mv.from_num, mv.to_num, mv.promote_to, 0, 0 };
+        const std::string move_str = search_move_str(as_result);
+        make_move(mv.from_num, mv.to_num, mv.promote_to, true);
+        auto child = probe_tablebase();
+        if (legal_moves().empty()) {
+            child = { true, is_in_check() ? -1 : 0, 0 };
+        }
+        unmake_move();
+        // child result is from the opponent's point of view
+        child.wdl = -child.wdl;
+        child.dtm += child.wdl ? 1 : 0;
+        printf("    %-6s %s\n", move_str.c_str(), tb_result_str(child).c_str());
+    }
+}
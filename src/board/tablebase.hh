@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "board_types.hh"
+
+// Endgame tablebases
+// A table holds one byte per position of a material signature (e.g. "KRPvKR",
+// stronger side first), for both players to move. Positions are indexed as
+//     (side * KK + kings) * 64^(n-2) + other pieces in signature order
+// where kings numbers the legal placements of both kings (not adjacent) with the
+// white king reduced by symmetry: to the a1-d1-d4 triangle without pawns, the
+// black king on or below the a1-h8 diagonal when the white king is on it
+// (KK = 462); to files a-d with pawns (KK = 1806). Identical pieces are stored in
+// ascending square order, so every position has exactly one index.
+//
+// Value byte: 0 - draw, 1 - illegal/unused index, 2+n - mate in n plies with
+// perfect play (even n: player to move is getting mated, odd n: is mating). A
+// table with a mate longer than 252 plies cannot be stored and is not generated.
+//
+// File layout (<signature>.cctb): tb_file_header_t followed by `entries' value bytes.
+// Positions with en passant or castling rights are never probed; positions right
+// after a double pawn push are generated as if no en passant capture was possible.
+namespace Tablebase {
+    static constexpr int kMaxPieces { 5 };
+    static constexpr char kFileMagic[4] { 'C', 'C', 'T', 'B' };
+    static constexpr uint32_t kFileVersion { 2 };
+    static constexpr auto kFileExtension { ".cctb" };
+    static constexpr auto kDefaultDirectory { "tb" };
+    static constexpr int kKingPairsPawnless { 462 };
+    static constexpr int kKingPairsPawns { 1806 };
+
+    static constexpr uint8_t kValueDraw { 0 };
+    static constexpr uint8_t kValueInvalid { 1 };
+    static constexpr uint8_t kValueMateBase { 2 };
+
+    struct tb_file_header_t {
+        char magic[4];
+        uint32_t version;
+        char signature[16];
+        uint64_t entries;
+        uint32_t flags;
+        uint32_t reserved;
+    };
+
+    struct tb_result_t {
+        bool found;
+        int wdl;            // 1 - win, 0 - draw, -1 - loss for the player to move
+        int dtm;            // plies to mate, 0 for draws
+    };
+
+    bool generate(const std::string& signature, const std::string& directory, const int threads);
+    bool load(const std::string& path);
+    int load_directory(const std::string& directory);
+    int max_pieces();
+    tb_result_t probe(const std::vector<piece_placement_t>& pieces, const char to_move);
+}
@@ -0,0 +1,370 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "board.hh"
+#include "eval.hh"
+#include "gamedb.hh"
+#include "packed.hh"
+#include "tune.hh"
+
+#include "log.hh"
+
+
+namespace {
+    constexpr char kPstPieces[6] { 'p', 'n', 'b', 'r', 'q', 'k' };
+    constexpr const char* kPstNames[6] { "kPstPawn", "kPstKnight", "kPstBishop", "kPstRook", "kPstQueen", "kPstKing" };
+    constexpr double kAdamBeta1 { 0.9 };
+    constexpr double kAdamBeta2 { 0.999 };
+    constexpr double kAdamEpsilon { 1e-8 };
+
+    inline int piece_index(const char piece) {
+        return std::find(std::begin(kPstPieces), std::end(kPstPieces), piece) - std::begin(kPstPieces);
+    }
+
+    std::vector<double> initial_weights() {
+        std::vector<double> weights(Tune::kWeightCount, 0.0);
+        for (int piece = 0; piece < 5; ++piece) {
+            weights[Tune::kMaterial + piece] = Eval::piece_value(kPstPieces[piece]);
+        }
+        for (int piece = 0; piece < 6; ++piece) {
+            for (int idx = 0; idx < 64; ++idx) {
+                // pst_value('b', ...) reads the table at the square itself
+                weights[Tune::kPst + piece*64 + idx] = Eval::pst_value('b', kPstPieces[piece], idx);
+            }
+        }
+        weights[Tune::kDoubled] = Eval::kDoubledPawn;
+        weights[Tune::kIsolated] = Eval::kIsolatedPawn;
+        weights[Tune::kBackward] = Eval::kBackwardPawn;
+        for (int rel_rank = 0; rel_rank < 8; ++rel_rank) {
+            weights[Tune::kPassed + rel_rank] = Eval::kPassedPawn[rel_rank];
+        }
+        weights[Tune::kShelter] = Eval::kShelterRank2;
+        weights[Tune::kShelter + 1] = Eval::kShelterRank3;
+        weights[Tune::kShelter + 2] = Eval::kShelterMissing;
+        return weights;
+    }
+
+    // the dataset as flat arrays: features of position i are [offsets[i], offsets[i + 1])
+    struct dataset_t {
+        std::vector<uint32_t> offsets { 0 };
+        std::vector<Tune::feature_t> features;
+        std::vector<float> targets;         // 1 white wins, 0.5 draw, 0 black wins
+        uint64_t mismatches = 0;            // features not reproducing the evaluation
+        uint64_t skipped = 0;               // no result or not decodable
+
+        size_t size() const { return targets.size(); }
+    };
+
+    bool load_dataset(const std::string& path, const int threads, dataset_t& data) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size % sizeof(Packed::packed_position_t) != 0) {
+            LOG_ERROR("Not a packed position file: %s", path.c_str());
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+        const uint64_t count = st.st_size / sizeof(Packed::packed_position_t);
+        void* map = count ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        const auto* records = static_cast<const Packed::packed_position_t*>(map);
+        const std::vector<double> weights = initial_weights();
+
+        // contiguous slices, concatenated in order afterwards
+        std::vector<dataset_t> parts(threads);
+        const auto work = [&](const int thread_id) {
+            auto& part = parts[thread_id];
+            Board board;
+            std::vector<Tune::feature_t> features;
+            const uint64_t begin = count * thread_id / threads;
+            const uint64_t end = count * (thread_id + 1) / threads;
+            for (uint64_t i = begin; i < end; ++i) {
+                const uint8_t result = records[i].result;
+                if (result == GameDb::kResultUnknown || result > GameDb::kResultDraw || !board.decode_packed(records[i])) {
+                    ++part.skipped;
+                    continue;
+                }
+                const int eval = board.eval_features(features);
+                double dot = 0.0;
+                for (const auto& feature : features) {
+                    dot += weights[feature.index] * feature.count;
+                }
+                part.mismatches += (std::lround(dot) != eval);
+                part.features.insert(part.features.end(), features.begin(), features.end());
+                part.offsets.push_back(part.features.size());
+                part.targets.push_back(result == GameDb::kResultWhite ? 1.0f : (result == GameDb::kResultBlack ? 0.0f : 0.5f));
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int i = 1; i < threads; ++i) {
+            workers.emplace_back(work, i);
+        }
+        work(0);
+        for (auto& th : workers) {
+            th.join();
+        }
+        if (map) {
+            munmap(map, st.st_size);
+        }
+
+        size_t features = 0;
+        size_t positions = 0;
+        for (const auto& part : parts) {
+            features += part.features.size();
+            positions += part.size();
+        }
+        data.features.reserve(features);
+        data.offsets.reserve(positions + 1);
+        data.targets.reserve(positions);
+        for (auto& part : parts) {
+            const uint32_t base = data.features.size();
+            data.features.insert(data.features.end(), part.features.begin(), part.features.end());
+            for (size_t i = 1; i < part.offsets.size(); ++i) {
+                data.offsets.push_back(base + part.offsets[i]);
+            }
+            data.targets.insert(data.targets.end(), part.targets.begin(), part.targets.end());
+            data.mismatches += part.mismatches;
+            data.skipped += part.skipped;
+            part = dataset_t {};
+        }
+        return true;
+    }
+
+    /**
+     * @brief Mean logistic loss of the dataset; adds the gradient of the summed
+     * loss to `gradient' if it is not empty.
+     */
+    double pass(const dataset_t& data, const std::vector<double>& weights, const double k, const int threads,
+                std::vector<double>& gradient) {
+        std::vector<std::vector<double>> gradients(threads, std::vector<double>(gradient.empty() ? 0 : Tune::kWeightCount, 0.0));
+        std::vector<double> losses(threads, 0.0);
+        const auto work = [&](const int thread_id) {
+            auto& grad = gradients[thread_id];
+            const bool with_gradient = !grad.empty();
+            double loss = 0.0;
+            const size_t begin = data.size() * thread_id / threads;
+            const size_t end = data.size() * (thread_id + 1) / threads;
+            for (size_t i = begin; i < end; ++i) {
+                const Tune::feature_t* first = data.features.data() + data.offsets[i];
+                const Tune::feature_t* last = data.features.data() + data.offsets[i + 1];
+                double eval = 0.0;
+                for (const auto* f = first; f != last; ++f) {
+                    eval += weights[f->index] * f->count;
+                }
+                const double p = 1.0 / (1.0 + std::exp(-k * eval));
+                const double r = data.targets[i];
+                const double p_clamped = std::clamp(p, 1e-12, 1.0 - 1e-12);
+                loss -= r * std::log(p_clamped) + (1.0 - r) * std::log(1.0 - p_clamped);
+                if (with_gradient) {
+                    const double g = (p - r) * k;
+                    for (const auto* f = first; f != last; ++f) {
+                        grad[f->index] += g * f->count;
+                    }
+                }
+            }
+            losses[thread_id] = loss;
+        };
+        std::vector<std::thread> workers;
+        for (int i = 1; i < threads; ++i) {
+            workers.emplace_back(work, i);
+        }
+        work(0);
+        for (auto& th : workers) {
+            th.join();
+        }
+        double loss = 0.0;
+        for (int t = 0; t < threads; ++t) {
+            loss += losses[t];
+            for (size_t w = 0; w < gradient.size(); ++w) {
+                gradient[w] += gradients[t][w];
+            }
+        }
+        return data.size() ? loss / data.size() : 0.0;
+    }
+
+    // golden-section search of the K minimising the loss of the starting weights
+    double fit_k(const dataset_t& data, const std::vector<double>& weights, const int threads) {
+        const double ratio = (std::sqrt(5.0) - 1.0) / 2.0;
+        std::vector<double> no_gradient;
+        double lo = 0.0001;
+        double hi = 0.05;
+        double a = hi - ratio * (hi - lo);
+        double b = lo + ratio * (hi - lo);
+        double loss_a = pass(data, weights, a, threads, no_gradient);
+        double loss_b = pass(data, weights, b, threads, no_gradient);
+        for (int i = 0; i < 24; ++i) {
+            if (loss_a < loss_b) {
+                hi = b;
+                b = a;
+                loss_b = loss_a;
+                a = hi - ratio * (hi - lo);
+                loss_a = pass(data, weights, a, threads, no_gradient);
+            } else {
+                lo = a;
+                a = b;
+                loss_a = loss_b;
+                b = lo + ratio * (hi - lo);
+                loss_b = pass(data, weights, b, threads, no_gradient);
+            }
+        }
+        return (lo + hi) / 2.0;
+    }
+
+    bool write_weights(const std::string& path, const std::vector<double>& weights, const double loss, const size_t positions) {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            LOG_ERROR("Cannot write %s", path.c_str());
+            return false;
+        }
+        const auto w = [&weights](const int idx) { return static_cast<int>(std::lround(weights[idx])); };
+        fprintf(file, "// Texel tuned over %lu positions, loss %.6lf\n", positions, loss);
+        fprintf(file, "// piece values: p %d, n %d, b %d, r %d, q %d\n\n", w(Tune::kMaterial), w(Tune::kMaterial + 1),
+                w(Tune::kMaterial + 2), w(Tune::kMaterial + 3), w(Tune::kMaterial + 4));
+        for (int piece = 0; piece < 6; ++piece) {
+            fprintf(file, "static constexpr int %s[64] {\n", kPstNames[piece]);
+            for (int row = 0; row < 8; ++row) {
+                fprintf(file, "   ");
+                for (int col = 0; col < 8; ++col) {
+                    fprintf(file, " %4d%s", w(Tune::kPst + piece*64 + row*8 + col), (row == 7 && col == 7) ? "" : ",");
+                }
+                fprintf(file, "\n");
+            }
+            fprintf(file, "};\n\n");
+        }
+        fprintf(file, "static constexpr int kDoubledPawn { %d };\n", w(Tune::kDoubled));
+        fprintf(file, "static constexpr int kIsolatedPawn { %d };\n", w(Tune::kIsolated));
+        fprintf(file, "static constexpr int kBackwardPawn { %d };\n", w(Tune::kBackward));
+        fprintf(file, "static constexpr int kPassedPawn[8] {");
+        for (int rel_rank = 0; rel_rank < 8; ++rel_rank) {
+            fprintf(file, " %d%s", w(Tune::kPassed + rel_rank), rel_rank == 7 ? " };\n" : ",");
+        }
+        fprintf(file, "static constexpr int kShelterRank2 { %d };\n", w(Tune::kShelter));
+        fprintf(file, "static constexpr int kShelterRank3 { %d };\n", w(Tune::kShelter + 1));
+        fprintf(file, "static constexpr int kShelterMissing { %d };\n", w(Tune::kShelter + 2));
+        return fclose(file) == 0;
+    }
+}
+
+
+/**
+ * @brief Sparse features of the classical evaluation of the current position,
+ * white minus black, sorted by weight index.
+ *
+ * @return evaluate_classical() turned to white's point of view, which the
+ * features must reproduce with the current weights
+ */
+int Board::eval_features(std::vector<Tune::feature_t>& features) {
+    features.clear();
+    const auto add = [&features](const int index, const int count) {
+        features.push_back({ static_cast<uint16_t>(index), static_cast<int16_t>(count) });
+    };
+    for (const auto& [pieces, colour, sign] : { std::make_tuple(&_white_pieces, 'w', 1), std::make_tuple(&_black_pieces, 'b', -1) }) {
+        for (const auto sq_num : *pieces) {
+            const char piece = _chessboard[sq_num].piece();
+            const int piece_idx = piece_index(piece);
+            if (piece != 'k') {
+                add(Tune::kMaterial + piece_idx, sign);
+            }
+            add(Tune::kPst + piece_idx*64 + ((colour == 'w') ? sq_num ^ 56 : sq_num), sign);
+        }
+    }
+
+    pawn_entry_t entry;
+    Eval::pawn_terms_t pawn_terms;
+    count_pawn_terms(pawn_terms, entry.shelter_rank);
+    add(Tune::kDoubled, pawn_terms.doubled);
+    add(Tune::kIsolated, pawn_terms.isolated);
+    add(Tune::kBackward, pawn_terms.backward);
+    for (int rel_rank = 0; rel_rank < 8; ++rel_rank) {
+        add(Tune::kPassed + rel_rank, pawn_terms.passed[rel_rank]);
+    }
+    Eval::shelter_terms_t white_shelter, black_shelter;
+    count_shelter_terms(entry, 'w', white_shelter);
+    count_shelter_terms(entry, 'b', black_shelter);
+    for (int term = 0; term < 3; ++term) {
+        add(Tune::kShelter + term, white_shelter.files[term] - black_shelter.files[term]);
+    }
+
+    // merge the counts of one weight, drop zeros
+    std::sort(features.begin(), features.end(), [](const Tune::feature_t& a, const Tune::feature_t& b) { return a.index < b.index; });
+    size_t out = 0;
+    for (size_t i = 0; i < features.size(); ++i) {
+        if (out > 0 && features[out - 1].index == features[i].index) {
+            features[out - 1].count += features[i].count;
+        } else {
+            features[out++] = features[i];
+        }
+    }
+    features.resize(out);
+    features.erase(std::remove_if(features.begin(), features.end(), [](const Tune::feature_t& f) { return f.count == 0; }),
+                   features.end());
+    const int score = evaluate_classical();
+    return (_to_move == 'w') ? score : -score;
+}
+
+
+bool Tune::run(const std::string& dataset_path, const config_t& config) {
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    dataset_t data;
+    if (!load_dataset(dataset_path, config.threads, data)) {
+        return false;
+    }
+    const std::chrono::duration<double, std::milli> load_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    printf("Positions: %lu (%lu skipped) \tFeatures: %.1lf per position, %lu MB \tLoad time: %.2lf ms\n", data.size(),
+           data.skipped, data.size() ? static_cast<double>(data.features.size()) / data.size() : 0.0,
+           (data.features.size() * sizeof(feature_t) + data.size() * (sizeof(uint32_t) + sizeof(float))) >> 20, load_tm.count());
+    if (data.mismatches) {
+        LOG_ERROR("%lu positions: features do not reproduce the evaluation", data.mismatches);
+        return false;
+    }
+    if (data.size() == 0) {
+        LOG_ERROR("No positions with a result in %s", dataset_path.c_str());
+        return false;
+    }
+
+    std::vector<double> weights = initial_weights();
+    const double k = fit_k(data, weights, config.threads);
+    std::vector<double> no_gradient;
+    double loss = pass(data, weights, k, config.threads, no_gradient);
+    printf("K: %.6lf \tInitial loss: %.6lf\n", k, loss);
+
+    std::vector<double> gradient(kWeightCount);
+    std::vector<double> m(kWeightCount, 0.0);
+    std::vector<double> v(kWeightCount, 0.0);
+    for (int epoch = 1; epoch <= config.epochs; ++epoch) {
+        const auto e_tm = std::chrono::high_resolution_clock::now();
+        std::fill(gradient.begin(), gradient.end(), 0.0);
+        loss = pass(data, weights, k, config.threads, gradient);
+        const double correction1 = 1.0 - std::pow(kAdamBeta1, epoch);
+        const double correction2 = 1.0 - std::pow(kAdamBeta2, epoch);
+        for (int w = 0; w < kWeightCount; ++w) {
+            const double g = gradient[w] / data.size();
+            m[w] = kAdamBeta1 * m[w] + (1.0 - kAdamBeta1) * g;
+            v[w] = kAdamBeta2 * v[w] + (1.0 - kAdamBeta2) * g * g;
+            weights[w] -= config.learning_rate * (m[w] / correction1) / (std::sqrt(v[w] / correction2) + kAdamEpsilon);
+        }
+        const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - e_tm;
+        printf("Epoch %4d \tLoss: %.6lf \tTime: %.2lf ms\n", epoch, loss, t_tm.count());
+        fflush(stdout);
+    }
+    loss = pass(data, weights, k, config.threads, no_gradient);
+    printf("Final loss: %.6lf \tPiece values: %.0lf %.0lf %.0lf %.0lf %.0lf\n", loss, weights[kMaterial], weights[kMaterial + 1],
+           weights[kMaterial + 2], weights[kMaterial + 3], weights[kMaterial + 4]);
+    if (!config.output_path.empty()) {
+        return write_weights(config.output_path, weights, loss, data.size());
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Texel tuning of the classical evaluation
+// The evaluation is linear in its weights: material, piece-square tables, pawn
+// structure and king shelter terms. Every position of a packed dataset is turned
+// into a sparse feature vector once (weight index, white minus black count), so
+// an epoch is one pass of dot products and gradient updates over flat arrays,
+// split between threads with one gradient buffer each.
+//
+// The loss is the logistic loss of sigmoid(K * eval) against the game result
+// (1, 0.5, 0 for white). K is fitted to the starting weights first, then the
+// weights are optimised by full-batch Adam. Positions without a result are
+// skipped.
+namespace Tune {
+    // weight layout
+    static constexpr int kMaterial { 0 };               // p, n, b, r, q
+    static constexpr int kPst { 5 };                    // p, n, b, r, q, k tables, 64 entries each
+    static constexpr int kDoubled { kPst + 6*64 };
+    static constexpr int kIsolated { kDoubled + 1 };
+    static constexpr int kBackward { kIsolated + 1 };
+    static constexpr int kPassed { kBackward + 1 };     // by relative rank
+    static constexpr int kShelter { kPassed + 8 };      // rank 2, rank 3, missing
+    static constexpr int kWeightCount { kShelter + 3 };
+
+    struct feature_t {
+        uint16_t index;
+        int16_t count;
+    };
+
+    struct config_t {
+        int epochs = 100;
+        int threads = 1;
+        double learning_rate = 1.0;     // centipawns per step
+        std::string output_path;        // tuned weights as eval.hh constants, if set
+    };
+
+    bool run(const std::string& dataset_path, const config_t& config);
+}
@@ -0,0 +1,400 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "board.hh"
+#include "uperft.hh"
+
+#include "log.hh"
+
+
+namespace {
+    constexpr int kShardBits { 6 };
+    constexpr int kShards { 1 << kShardBits };
+    constexpr size_t kChunkPositions { 1024 };
+    constexpr char kPromotionTargets[4] { 'q', 'r', 'b', 'n' };
+
+    inline bool record_less(const UPerft::record_t& a, const UPerft::record_t& b) {
+        if (a.hash != b.hash) {
+            return a.hash < b.hash;
+        }
+        return std::memcmp(&a.position, &b.position, sizeof(a.position)) < 0;
+    }
+
+    inline bool same_position(const UPerft::record_t& a, const UPerft::record_t& b, const bool verify) {
+        return a.hash == b.hash && (!verify || std::memcmp(&a.position, &b.position, sizeof(a.position)) == 0);
+    }
+
+    /**
+     * @brief Insert-only set of records: one open-addressing table per shard, slots
+     * claimed by a CAS on their key. A shard refuses inserts beyond 3/4 load, so
+     * probing always ends; the caller then spills the set to disk.
+     */
+    class RecordSet {
+    public:
+        enum insert_t { kInserted, kDuplicate, kFull };
+
+        explicit RecordSet(const size_t memory_mb) {
+            const size_t slots = std::max<size_t>((memory_mb << 20) / sizeof(slot_t) / kShards, 1024);
+            _shard_size = std::bit_floor(slots);
+            _limit = _shard_size / 4 * 3;
+            for (auto& shard : _shards) {
+                shard.slots = std::make_unique<slot_t[]>(_shard_size);
+            }
+        }
+
+        insert_t insert(const UPerft::record_t& record, const bool verify) {
+            auto& shard = _shards[record.hash >> (64 - kShardBits)];
+            if (shard.count.load(std::memory_order_relaxed) >= _limit) {
+                return kFull;
+            }
+            const uint64_t mask = _shard_size - 1;
+            for (uint64_t idx = record.hash & mask;; idx = (idx + 1) & mask) {
+                auto& slot = shard.slots[idx];
+                uint64_t current = slot.key.load(std::memory_order_acquire);
+                if (current == 0) {
+                    if (slot.key.compare_exchange_strong(current, record.hash, std::memory_order_acq_rel)) {
+                        slot.position = record.position;
+                        slot.ready.store(1, std::memory_order_release);
+                        shard.count.fetch_add(1, std::memory_order_relaxed);
+                        return kInserted;
+                    }
+                }
+                if (current != record.hash) {
+                    continue;
+                }
+                if (!verify) {
+                    return kDuplicate;
+                }
+                // the record of a slot is written right after its key
+                while (!slot.ready.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                if (std::memcmp(&slot.position, &record.position, sizeof(record.position)) == 0) {
+                    return kDuplicate;
+                }
+            }
+        }
+
+        bool full() const {
+            return std::any_of(std::begin(_shards), std::end(_shards), [this](const shard_t& shard) {
+                return shard.count.load(std::memory_order_relaxed) >= _limit;
+            });
+        }
+
+        uint64_t size() const {
+            uint64_t total = 0;
+            for (const auto& shard : _shards) {
+                total += shard.count.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        // writes the records sorted (shards hold consecutive hash ranges) and clears the set
+        bool spill(FILE* file) {
+            std::vector<UPerft::record_t> records;
+            for (auto& shard : _shards) {
+                records.clear();
+                for (size_t i = 0; i < _shard_size; ++i) {
+                    auto& slot = shard.slots[i];
+                    const uint64_t key = slot.key.load(std::memory_order_relaxed);
+                    if (key) {
+                        records.push_back({ key, slot.position });
+                        slot.key.store(0, std::memory_order_relaxed);
+                        slot.ready.store(0, std::memory_order_relaxed);
+                    }
+                }
+                shard.count.store(0, std::memory_order_relaxed);
+                std::sort(records.begin(), records.end(), record_less);
+                if (fwrite(records.data(), sizeof(UPerft::record_t), records.size(), file) != records.size()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        struct slot_t {
+            std::atomic<uint64_t> key { 0 };
+            std::atomic<uint8_t> ready { 0 };
+            Packed::packed_position_t position;
+        };
+        struct shard_t {
+            std::unique_ptr<slot_t[]> slots;
+            std::atomic<uint64_t> count { 0 };
+        };
+
+        shard_t _shards[kShards];
+        size_t _shard_size;
+        uint64_t _limit;
+    };
+
+    struct merge_result_t {
+        uint64_t unique = 0;
+        uint64_t collisions = 0;
+    };
+
+    /**
+     * @brief K-way merge of sorted runs into a frontier file (nullptr to count
+     * only), dropping duplicates.
+     */
+    bool merge_runs(const std::vector<std::string>& runs, FILE* out, const bool verify, merge_result_t& result) {
+        std::vector<FILE*> files;
+        bool ok = true;
+        for (const auto& run : runs) {
+            FILE* file = fopen(run.c_str(), "rb");
+            if (!file) {
+                LOG_ERROR("Cannot read %s", run.c_str());
+                ok = false;
+                break;
+            }
+            setvbuf(file, nullptr, _IOFBF, 1 << 20);
+            files.push_back(file);
+        }
+        using head_t = std::pair<UPerft::record_t, size_t>;
+        const auto later = [](const head_t& a, const head_t& b) { return record_less(b.first, a.first); };
+        std::priority_queue<head_t, std::vector<head_t>, decltype(later)> heads(later);
+        for (size_t i = 0; ok && i < files.size(); ++i) {
+            UPerft::record_t record;
+            if (fread(&record, sizeof(record), 1, files[i]) == 1) {
+                heads.push({ record, i });
+            }
+        }
+        UPerft::record_t last {};
+        bool have_last = false;
+        while (ok && !heads.empty()) {
+            const auto [record, i] = heads.top();
+            heads.pop();
+            UPerft::record_t next;
+            if (fread(&next, sizeof(next), 1, files[i]) == 1) {
+                heads.push({ next, i });
+            }
+            if (have_last && same_position(last, record, verify)) {
+                continue;
+            }
+            // sorted by (hash, position): a new position with the last hash collides
+            if (have_last && last.hash == record.hash) {
+                ++result.collisions;
+            }
+            ++result.unique;
+            if (out && fwrite(&record, sizeof(record), 1, out) != 1) {
+                LOG_ERROR("Cannot write frontier");
+                ok = false;
+            }
+            last = record;
+            have_last = true;
+        }
+        for (FILE* file : files) {
+            fclose(file);
+        }
+        return ok;
+    }
+}
+
+
+/**
+ * @brief Whether an en passant capture is among the legal moves.
+ */
+bool Board::ep_capture_legal() {
+    const auto& legals = legal_moves();
+    return std::any_of(legals.begin(), legals.end(), [this](const std::pair<int, int>& mv) {
+        return mv.second == _ep_square && _chessboard[mv.first].piece() == 'p';
+    });
+}
+
+/**
+ * @brief Children of the current position as normalised records: move counters
+ * cleared, an en passant square that allows no legal capture dropped (also from
+ * the hash, which keeps it for pseudolegal captures).
+ */
+void Board::uperft_children(std::vector<UPerft::record_t>& children) {
+    children.clear();
+    const auto& legals = legal_moves();
+    for (const auto& [from_num, to_num] : legals) {
+        const bool promotion = _chessboard[from_num].piece() == 'p' && (to_num / 8 == 0 || to_num / 8 == 7);
+        for (const char promote_to : kPromotionTargets) {
+            make_move(from_num, to_num, promote_to, true);
+            UPerft::record_t record;
+            Zobrist::key_t key = _hash;
+            encode_packed(record.position);
+            record.position.fullmove_counter = 0;
+            record.position.halfmove_clock = 0;
+            if (ep_hash() == 0 || !ep_capture_legal()) {
+                record.position.ep_square = Packed::kNoEpSquare;
+                key ^= ep_hash();
+            }
+            record.hash = key ? key : 1;
+            children.push_back(record);
+            unmake_move();
+            if (!promotion) {
+                break;
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Expands the unique positions depth by depth, printing the count of
+ * every depth.
+ */
+bool UPerft::run(const config_t& config) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const fs::path dir = config.work_dir.empty() ? fs::temp_directory_path(ec) : fs::path(config.work_dir);
+    const std::string prefix = (dir / ("crudechess-uperft-" + std::to_string(getpid()))).string();
+    const auto run_path = [&prefix](const int depth, const size_t run) {
+        return prefix + "." + std::to_string(depth) + "." + std::to_string(run) + ".run";
+    };
+    const auto frontier_path = [&prefix](const int depth) { return prefix + "." + std::to_string(depth) + ".frontier"; };
+
+    Board board;
+    if (!board.set_fen(config.fen)) {
+        LOG_ERROR("Invalid FEN or illegal position: %s", config.fen.c_str());
+        return false;
+    }
+    record_t root;
+    root.hash = board.hash() ? board.hash() : 1;
+    if (!board.encode_packed(root.position)) {
+        LOG_ERROR("Cannot pack %s", config.fen.c_str());
+        return false;
+    }
+    FILE* frontier = fopen(frontier_path(0).c_str(), "wb");
+    if (!frontier || fwrite(&root, sizeof(root), 1, frontier) != 1) {
+        LOG_ERROR("Cannot write %s", frontier_path(0).c_str());
+        return false;
+    }
+    fclose(frontier);
+
+    RecordSet set(config.memory_mb);
+    printf("Depth    Unique positions    Collisions    Runs     Time\n");
+    printf("-----    ----------------    ----------    ----    ----------\n");
+    const auto s_tm = std::chrono::high_resolution_clock::now();
+    bool ok = true;
+    for (int depth = 1; ok && depth <= config.depth; ++depth) {
+        const auto d_tm = std::chrono::high_resolution_clock::now();
+        std::vector<std::string> runs;
+        const auto spill = [&] {
+            runs.push_back(run_path(depth, runs.size()));
+            FILE* file = fopen(runs.back().c_str(), "wb");
+            const bool written = file && set.spill(file);
+            if (file) {
+                fclose(file);
+            }
+            if (!written) {
+                LOG_ERROR("Cannot write %s", runs.back().c_str());
+            }
+            return written;
+        };
+
+        frontier = fopen(frontier_path(depth - 1).c_str(), "rb");
+        if (!frontier) {
+            LOG_ERROR("Cannot read %s", frontier_path(depth - 1).c_str());
+            ok = false;
+            break;
+        }
+        // the workers run for the whole depth, each with its own board, and take
+        // the next chunk of the frontier in turn; inserts share the set, a spill
+        // holds it alone
+        std::mutex frontier_mutex;
+        std::shared_mutex set_mutex;
+        std::atomic<bool> expanded { true };
+        const auto work = [&] {
+            Board child_board;
+            std::vector<record_t> chunk(kChunkPositions);
+            std::vector<record_t> children;
+            std::vector<record_t> overflow;
+            while (expanded) {
+                size_t count;
+                {
+                    std::lock_guard<std::mutex> lock(frontier_mutex);
+                    count = fread(chunk.data(), sizeof(record_t), chunk.size(), frontier);
+                }
+                if (count == 0) {
+                    break;
+                }
+                {
+                    std::shared_lock<std::shared_mutex> lock(set_mutex);
+                    for (size_t i = 0; i < count; ++i) {
+                        child_board.decode_packed(chunk[i].position);
+                        child_board.uperft_children(children);
+                        for (const auto& child : children) {
+                            if (set.insert(child, config.verify) == RecordSet::kFull) {
+                                overflow.push_back(child);
+                            }
+                        }
+                    }
+                }
+                if (overflow.empty() && !set.full()) {
+                    continue;
+                }
+                // children refused by a full shard go in after the set is spilled
+                std::unique_lock<std::shared_mutex> lock(set_mutex);
+                bool written = true;
+                for (const auto& record : overflow) {
+                    while (written && set.insert(record, config.verify) == RecordSet::kFull) {
+                        written = spill();
+                    }
+                }
+                overflow.clear();
+                if (written && set.full()) {
+                    written = spill();
+                }
+                if (!written) {
+                    expanded = false;
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < config.threads; ++t) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& th : workers) {
+            th.join();
+        }
+        ok = expanded;
+        fclose(frontier);
+        if (ok && (set.size() || runs.empty())) {
+            ok = spill();
+        }
+
+        merge_result_t result;
+        FILE* out = nullptr;
+        if (ok && depth < config.depth) {
+            out = fopen(frontier_path(depth).c_str(), "wb");
+            ok = (out != nullptr);
+        }
+        ok = ok && merge_runs(runs, out, config.verify, result);
+        if (out) {
+            ok = (fclose(out) == 0) && ok;
+        }
+        for (const auto& run : runs) {
+            fs::remove(run, ec);
+        }
+        const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - d_tm;
+        if (ok) {
+            printf("%5d    %16lu    %10s    %4lu    %8.2lf ms\n", depth, result.unique,
+                   config.verify ? std::to_string(result.collisions).c_str() : "-", runs.size(), t_tm.count());
+            fflush(stdout);
+        }
+    }
+    for (int depth = 0; depth <= config.depth; ++depth) {
+        fs::remove(frontier_path(depth), ec);
+    }
+    const std::chrono::duration<double, std::milli> t_tm = std::chrono::high_resolution_clock::now() - s_tm;
+    printf("\nTime: %.2lf ms\n", t_tm.count());
+    return ok;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "packed.hh"
+#include "zobrist.hh"
+
+// Unique-position perft
+// Counts the distinct positions reachable in exactly d plies, for every d up to
+// the requested depth, where perft counts paths. Positions are compared as packed
+// records with the move counters cleared and the en passant square dropped when no
+// capture on it is possible (as in the hash).
+//
+// Depth d + 1 is expanded from the unique positions of depth d. Children go into a
+// lock-free set, sharded by the top bits of their hash and shared by all threads.
+// When the set reaches its memory budget it is written out as a run sorted by
+// (hash, position) and cleared. The runs of a depth are merged into the next
+// frontier file, so memory stays bounded and larger depths only need disk space.
+// Without verification positions are identified by hash alone. With it, equal
+// hashes are told apart by the full record, and distinct positions sharing a hash
+// are counted as collisions.
+namespace UPerft {
+    static constexpr size_t kDefaultMemoryMb { 1024 };
+
+    struct record_t {
+        Zobrist::key_t hash;    // never 0, which marks empty set slots
+        Packed::packed_position_t position;
+    };
+
+    struct config_t {
+        std::string fen;
+        int depth = 1;
+        size_t memory_mb = kDefaultMemoryMb;
+        int threads = 1;
+        bool verify = false;
+        std::string work_dir;   // spill files, the temp directory if empty
+    };
+
+    bool run(const config_t& config);
+}
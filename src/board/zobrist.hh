@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+
+// Zobrist hashing
+// Every (piece, square) pair, every castling rights combination, every en passant
+// file and the side to move are assigned a pseudorandom 64-bit key. The hash of a
+// position is the XOR of the keys of all its features, which lets make_move and
+// unmake_move update it incrementally.
+// The pawn key is the XOR of pawn keys only - it identifies the pawn skeleton.
+namespace Zobrist {
+    using key_t = uint64_t;
+
+    static constexpr key_t kSeed { 0x637275646563686bULL }; // "crudechk"
+
+    struct keys_t {
+        key_t piece_square[12][64];
+        key_t castling[16];
+        key_t ep_file[8];
+        key_t side;
+    };
+
+    constexpr key_t splitmix64(key_t& state) {
+        key_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    constexpr keys_t generate_keys(key_t seed) {
+        keys_t keys {};
+        for (auto& piece_keys : keys.piece_square) {
+            for (auto& key : piece_keys) {
+                key = splitmix64(seed);
+            }
+        }
+        // one key per right; combinations are XORs so that losing a right is a single XOR
+        key_t right_keys[4] {};
+        for (auto& key : right_keys) {
+            key = splitmix64(seed);
+        }
+        for (int rights = 0; rights < 16; ++rights) {
+            for (int bit = 0; bit < 4; ++bit) {
+                if (rights & (1 << bit)) {
+                    keys.castling[rights] ^= right_keys[bit];
+                }
+            }
+        }
+        for (auto& key : keys.ep_file) {
+            key = splitmix64(seed);
+        }
+        keys.side = splitmix64(seed);
+        return keys;
+    }
+
+    inline constexpr keys_t kKeys = generate_keys(kSeed);
+
+    inline int piece_index(const char colour, const char piece) {
+        int idx = 0;
+        switch (piece) {
+            case 'p':   idx = 0; break;
+            case 'n':   idx = 1; break;
+            case 'b':   idx = 2; break;
+            case 'r':   idx = 3; break;
+            case 'q':   idx = 4; break;
+            case 'k':   idx = 5; break;
+        }
+        return (colour == 'b') ? idx + 6 : idx;
+    }
+
+    inline key_t piece_key(const char colour, const char piece, const int sq_num) {
+        return kKeys.piece_square[piece_index(colour, piece)][sq_num];
+    }
+
+    inline key_t castling_key(const uint8_t castling_rights) {
+        return kKeys.castling[castling_rights & 15];
+    }
+
+    inline key_t ep_key(const int ep_square) {
+        return (ep_square == -1) ? 0 : kKeys.ep_file[ep_square % 8];
+    }
+}
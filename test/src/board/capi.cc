@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "crudechess.h"
+
+
+namespace {
+    constexpr const char* kKiwipete { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1" };
+
+    class CApiTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            board = crudechess_board_create();
+            ASSERT_NE(board, nullptr);
+        }
+        void TearDown() override { crudechess_board_destroy(board); }
+
+        crudechess_board_t* board = nullptr;
+    };
+}
+
+
+TEST_F(CApiTest, SetFenAcceptsLegalPositions) {
+    EXPECT_EQ(crudechess_api_version(), CRUDECHESS_API_VERSION);
+    EXPECT_EQ(crudechess_set_fen(board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"), CRUDECHESS_OK);
+    EXPECT_EQ(crudechess_to_move(board), 'w');
+    EXPECT_EQ(crudechess_set_fen(board, "8/8/8/k5QK/8/8/8/8 b - - 0 1"), CRUDECHESS_OK);
+    EXPECT_EQ(crudechess_to_move(board), 'b');
+    EXPECT_EQ(crudechess_set_fen(board, kKiwipete), CRUDECHESS_OK);
+    EXPECT_EQ(crudechess_perft(board, 2), 2039);
+}
+
+TEST_F(CApiTest, SetFenRejectsInvalidAndIllegalPositions) {
+    EXPECT_EQ(crudechess_set_fen(board, "Most certainly not a FEN."), CRUDECHESS_EINVAL);
+    EXPECT_EQ(crudechess_set_fen(board, "8/8/8/8/8/8/8/8 w - - 0 1"), CRUDECHESS_EINVAL);          // no kings
+    EXPECT_EQ(crudechess_set_fen(board, "8/8/8/8/8/8/8/K7 w - - 0 1"), CRUDECHESS_EINVAL);         // no black king
+    EXPECT_EQ(crudechess_set_fen(board, "8/K5K1/8/8/8/8/k7/8 w - - 0 1"), CRUDECHESS_EINVAL);      // two white kings
+    EXPECT_EQ(crudechess_set_fen(board, "8/8/8/k5QK/8/8/8/8 w - - 0 1"), CRUDECHESS_EINVAL);       // side not to move in check
+    EXPECT_EQ(crudechess_set_fen(board, "P7/8/8/k6K/8/8/8/8 w - - 0 1"), CRUDECHESS_EINVAL);       // pawn on the back rank
+    EXPECT_EQ(crudechess_set_fen(board, "4k3/8/8/8/8/8/8/4K3 w K - 0 1"), CRUDECHESS_EINVAL);      // castling without a rook
+    EXPECT_EQ(crudechess_set_fen(board, "4k3/8/8/8/8/8/8/4K3 w - e3 0 1"), CRUDECHESS_EINVAL);     // en passant without a pawn
+    EXPECT_EQ(crudechess_set_fen(nullptr, kKiwipete), CRUDECHESS_EINVAL);
+    EXPECT_EQ(crudechess_set_fen(board, nullptr), CRUDECHESS_EINVAL);
+    // a rejected position leaves the starting position
+    EXPECT_EQ(crudechess_perft(board, 3), 8902);
+}
+
+TEST_F(CApiTest, MakeUnmakeAndPerft) {
+    ASSERT_EQ(crudechess_set_fen(board, kKiwipete), CRUDECHESS_OK);
+    crudechess_move_t moves[256];
+    const int count = crudechess_legal_moves(board, moves, 256);
+    ASSERT_EQ(count, 48);
+    EXPECT_EQ(crudechess_legal_moves(board, nullptr, 0), 48);
+
+    // perft 3 as the sum of perft 2 after every move
+    int64_t nodes = 0;
+    for (int i = 0; i < count; ++i) {
+        ASSERT_EQ(crudechess_make_move(board, moves[i]), CRUDECHESS_OK);
+        EXPECT_EQ(crudechess_to_move(board), 'b');
+        const int64_t move_nodes = crudechess_perft(board, 2);
+        ASSERT_GE(move_nodes, 0);
+        nodes += move_nodes;
+        ASSERT_EQ(crudechess_unmake_move(board), CRUDECHESS_OK);
+    }
+    EXPECT_EQ(nodes, 97862);
+    EXPECT_EQ(crudechess_perft(board, 3), 97862);
+    EXPECT_EQ(crudechess_unmake_move(board), CRUDECHESS_EEMPTY);
+
+    EXPECT_EQ(crudechess_make_move(board, { 0, 63, 0 }), CRUDECHESS_EILLEGAL);
+    EXPECT_EQ(crudechess_make_move(board, { 64, 0, 0 }), CRUDECHESS_EINVAL);
+    EXPECT_EQ(crudechess_make_move(board, { 12, 20, 'k' }), CRUDECHESS_EINVAL);
+    EXPECT_EQ(crudechess_perft(board, -1), CRUDECHESS_EINVAL);
+    EXPECT_EQ(crudechess_perft(nullptr, 1), CRUDECHESS_EINVAL);
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "board.hh"
+#include "positions.hh"
+
+
+namespace {
+    struct check_counts_t {
+        uint64_t moves = 0;
+        uint64_t checks = 0;
+        uint64_t en_passant = 0;
+        uint64_t castling = 0;
+        uint64_t promotions = 0;
+    };
+
+    // gives_check before every move of the tree against is_in_check after it
+    void compare_checks(Board& board, const int depth, check_counts_t& counts) {
+        char pieces[64];
+        std::fill(std::begin(pieces), std::end(pieces), 'e');
+        for (const auto& placement : board.get_pieces()) {
+            pieces[placement.sq_num] = placement.piece;
+        }
+        std::vector<Pgn::move_t> moves;
+        board.canonical_moves(moves);
+        for (const auto& move : moves) {
+            const char piece = pieces[move.from_num];
+            const bool promotion = piece == 'p' && (move.to_num / 8 == 0 || move.to_num / 8 == 7);
+            counts.en_passant += piece == 'p' && move.from_num % 8 != move.to_num % 8 && pieces[move.to_num] == 'e';
+            counts.castling += piece == 'k' && std::abs(move.to_num - move.from_num) == 2;
+            counts.promotions += promotion;
+            ++counts.moves;
+
+            const bool predicted = board.gives_check(move.from_num, move.to_num, move.promote_to);
+            const std::string san = board.move_to_san(move.from_num, move.to_num, move.promote_to);
+            board.play_move(move.from_num, move.to_num, move.promote_to);
+            const bool in_check = board.is_in_check();
+            EXPECT_EQ(predicted, in_check) << san;
+            counts.checks += in_check;
+            if (depth > 1) {
+                compare_checks(board, depth - 1, counts);
+            }
+            board.undo_move();
+        }
+    }
+}
+
+
+TEST(GivesCheckTest, MatchesMakeMovePerftMini) {
+    const auto fens = TestPositions::perft_mini();
+    ASSERT_FALSE(fens.empty());
+    Board board;
+    check_counts_t counts;
+    for (const auto& fen : fens) {
+        SCOPED_TRACE(fen);
+        board.set_fen(fen);
+        compare_checks(board, 3, counts);
+    }
+    EXPECT_GT(counts.checks, 0u);
+    EXPECT_GT(counts.en_passant, 0u);
+    EXPECT_GT(counts.castling, 0u);
+    EXPECT_GT(counts.promotions, 0u);
+}
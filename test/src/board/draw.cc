@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "board.hh"
+#include "fen.hh"
+
+
+namespace {
+    // moves given as (from, to) square numbers, none of them promotions
+    void play_moves(Board& board, const std::vector<std::pair<int, int>>& moves) {
+        for (const auto& [from_num, to_num] : moves) {
+            ASSERT_TRUE(board.play_move(from_num, to_num, 'q')) << from_num << "-" << to_num;
+        }
+    }
+
+    int game_end_of(const std::string& fen) {
+        Board board;
+        EXPECT_TRUE(board.set_fen(fen)) << fen;
+        return board.game_end();
+    }
+}
+
+
+TEST(DrawTest, ThreefoldRepetition) {
+    // Nf3 Nf6 Ng1 Ng8: the start position is back for the second time
+    const std::vector<std::pair<int, int>> knights_out_and_back { { 6, 21 }, { 62, 45 }, { 21, 6 }, { 45, 62 } };
+    Board board;
+    ASSERT_TRUE(board.set_fen(Fen::kFenInitial));
+    play_moves(board, knights_out_and_back);
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+    play_moves(board, { { 6, 21 }, { 62, 45 }, { 21, 6 } });
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+    play_moves(board, { { 45, 62 } });
+    EXPECT_EQ(board.game_end(), kGameThreefold);
+    board.undo_move();
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+
+    // a pawn move in between makes the earlier positions unreachable
+    ASSERT_TRUE(board.set_fen(Fen::kFenInitial));
+    play_moves(board, knights_out_and_back);
+    play_moves(board, { { 12, 28 }, { 52, 36 } });
+    play_moves(board, knights_out_and_back);
+    play_moves(board, knights_out_and_back);
+    EXPECT_EQ(board.game_end(), kGameThreefold);
+    board.undo_move();
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+}
+
+TEST(DrawTest, FiftyMoveBoundary) {
+    Board board;
+    ASSERT_TRUE(board.set_fen("4k3/8/8/8/8/8/8/R3K3 w - - 99 80"));
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+    play_moves(board, { { 0, 8 } });
+    EXPECT_EQ(board.game_end(), kGameFiftyMove);
+    board.undo_move();
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+
+    EXPECT_EQ(game_end_of("4k3/8/8/8/8/8/8/R3K3 w - - 100 80"), kGameFiftyMove);
+    // mate on the hundredth ply stands
+    ASSERT_TRUE(board.set_fen("6k1/5ppp/8/8/8/8/8/R3K3 w - - 99 80"));
+    play_moves(board, { { 0, 56 } });
+    EXPECT_EQ(board.game_end(), kGameCheckmate);
+    // a pawn move or capture on the hundredth ply resets the clock
+    ASSERT_TRUE(board.set_fen("4k3/8/8/8/8/8/P7/4K3 w - - 99 80"));
+    play_moves(board, { { 8, 16 } });
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+    ASSERT_TRUE(board.set_fen("4k3/8/8/8/8/8/n7/R3K3 w - - 99 80"));
+    play_moves(board, { { 0, 8 } });
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+}
+
+TEST(DrawTest, InsufficientMaterial) {
+    EXPECT_EQ(game_end_of("4k3/8/8/8/8/8/8/4K3 w - - 0 1"), kGameInsufficientMaterial);
+    EXPECT_EQ(game_end_of("4k3/8/8/8/8/8/8/2B1K3 w - - 0 1"), kGameInsufficientMaterial);
+    EXPECT_EQ(game_end_of("4k3/8/8/8/8/8/8/1N2K3 w - - 0 1"), kGameInsufficientMaterial);
+    // bishops on c1 and f8, both dark squares
+    EXPECT_EQ(game_end_of("4kb2/8/8/8/8/8/8/2B1K3 w - - 0 1"), kGameInsufficientMaterial);
+    // bishops on c1 and c8, dark and light
+    EXPECT_EQ(game_end_of("2b1k3/8/8/8/8/8/8/2B1K3 w - - 0 1"), kGameOngoing);
+    EXPECT_EQ(game_end_of("4k3/8/8/8/8/8/8/1NB1K3 w - - 0 1"), kGameOngoing);
+    EXPECT_EQ(game_end_of("4kn2/8/8/8/8/8/8/2B1K3 w - - 0 1"), kGameOngoing);
+    EXPECT_EQ(game_end_of("4k3/8/8/8/8/8/8/R3K3 w - - 0 1"), kGameOngoing);
+    EXPECT_EQ(game_end_of("4k3/8/8/8/8/8/P7/4K3 w - - 0 1"), kGameOngoing);
+}
+
+TEST(DrawTest, SearchScoresTwofoldRepetitionAsDraw) {
+    // White is a queen and a rook down with only king moves
+    const std::string fen = "6k1/r7/8/q7/8/8/8/6K1 w - - 0 1";
+    Board fresh;
+    ASSERT_TRUE(fresh.set_fen(fen));
+    const search_result_t lost = fresh.search(4, false);
+    EXPECT_LT(lost.score, -500);
+
+    // Kh1 Kh8 Kg1 Kg8: Kh1 now repeats a position once, which search takes as a draw
+    Board board;
+    ASSERT_TRUE(board.set_fen(fen));
+    play_moves(board, { { 6, 7 }, { 62, 63 }, { 7, 6 }, { 63, 62 } });
+    EXPECT_EQ(board.game_end(), kGameOngoing);
+    const search_result_t result = board.search(4, false);
+    EXPECT_EQ(result.score, 0);
+    EXPECT_EQ(result.from_num, 6);
+    EXPECT_EQ(result.to_num, 7);
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "board.hh"
+#include "fen.hh"
+#include "gamedb.hh"
+#include "positions.hh"
+
+
+namespace {
+    void append_le(std::string& out, const uint64_t value, const int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<char>(value >> (8 * i)));
+        }
+    }
+
+    // a .ccgb file of the records, laid out as described in gamedb.hh
+    void write_db(const std::string& path, const std::vector<std::string>& records) {
+        std::string header(GameDb::kFileMagic, 4);
+        append_le(header, GameDb::kFileVersion, 4);
+        append_le(header, records.size(), 8);
+        std::string body;
+        std::string index;
+        for (const auto& record : records) {
+            append_le(index, GameDb::kHeaderSize + body.size(), 8);
+            body += record;
+        }
+        append_le(header, GameDb::kHeaderSize + body.size(), 8);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << header << body << index;
+    }
+}
+
+
+TEST(GameDbTest, EncodeReplayRoundTrip) {
+    Board board;
+    std::vector<Pgn::game_t> games;
+    games.push_back(TestPositions::random_game(board, Fen::kFenInitial, 120, 7));
+    const auto fens = TestPositions::perft_mini();
+    for (size_t i = 0; i < fens.size(); ++i) {
+        games.push_back(TestPositions::random_game(board, fens[i], 120, i + 1));
+    }
+    std::vector<std::string> records;
+    for (const auto& game : games) {
+        records.emplace_back();
+        ASSERT_TRUE(GameDb::encode(game, board, records.back())) << game.start_fen;
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "crudechess_test_gamedb.ccgb").string();
+    write_db(path, records);
+    GameDb::Reader reader;
+    ASSERT_TRUE(reader.open(path));
+    ASSERT_EQ(reader.size(), games.size());
+    std::vector<Pgn::move_t> moves;
+    for (size_t i = 0; i < games.size(); ++i) {
+        SCOPED_TRACE(games[i].start_fen);
+        GameDb::record_t record;
+        ASSERT_TRUE(reader.read(i, record));
+        EXPECT_STREQ(GameDb::result_str(record.result), games[i].result.c_str());
+        EXPECT_EQ(record.start_fen.empty(), games[i].start_fen == Fen::kFenInitial);
+        ASSERT_TRUE(GameDb::replay(record, board, &moves));
+        ASSERT_EQ(moves.size(), games[i].moves.size());
+        for (size_t ply = 0; ply < moves.size(); ++ply) {
+            EXPECT_TRUE(TestPositions::same_move(moves[ply], games[i].moves[ply])) << "ply " << ply;
+        }
+    }
+    reader.close();
+    std::remove(path.c_str());
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "board.hh"
+#include "nnue.hh"
+#include "packed.hh"
+#include "positions.hh"
+
+
+namespace {
+    // random weights small enough that no accumulator overflows, with most of
+    // the accumulators inside the clipping range
+    NNUE::network_t random_network(const int hidden, const uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> ft_weight(-8, 8);
+        std::uniform_int_distribution<int> out_weight(-64, 64);
+        NNUE::network_t net;
+        net.hidden = hidden;
+        net.scale = 16;
+        for (int i = 0; i < hidden; ++i) {
+            net.ft_bias.push_back(64 + ft_weight(rng));
+        }
+        net.ft_weights.resize(static_cast<size_t>(NNUE::kFeatures) * hidden);
+        for (auto& weight : net.ft_weights) {
+            weight = ft_weight(rng);
+        }
+        net.out_bias = out_weight(rng);
+        for (int i = 0; i < 2 * hidden; ++i) {
+            net.out_weights.push_back(out_weight(rng));
+        }
+        return net;
+    }
+
+    // the network output from the pieces alone, with plain loops
+    int reference_eval(const NNUE::network_t& net, const Board& board) {
+        const auto pieces = board.get_pieces();
+        int king_sq[2] = { 0, 0 };
+        for (const auto& placement : pieces) {
+            if (placement.piece == 'k') {
+                king_sq[placement.colour == 'b'] = placement.sq_num;
+            }
+        }
+        std::vector<int32_t> acc[2];
+        for (int perspective = 0; perspective < 2; ++perspective) {
+            acc[perspective].assign(net.ft_bias.begin(), net.ft_bias.end());
+            for (const auto& placement : pieces) {
+                if (placement.piece == 'k') {
+                    continue;
+                }
+                const int feature = NNUE::feature_index(perspective ? 'b' : 'w', king_sq[perspective],
+                                                        placement.colour, placement.piece, placement.sq_num);
+                for (int i = 0; i < net.hidden; ++i) {
+                    acc[perspective][i] += net.ft_weights[static_cast<size_t>(feature) * net.hidden + i];
+                }
+            }
+        }
+        const int us = (board.to_move() == 'w') ? 0 : 1;
+        int32_t sum = net.out_bias;
+        for (int half = 0; half < 2; ++half) {
+            const auto& values = acc[half ? 1 - us : us];
+            for (int i = 0; i < net.hidden; ++i) {
+                const int clipped = values[i] < 0 ? 0 : (values[i] > 127 ? 127 : values[i]);
+                sum += clipped * net.out_weights[half * net.hidden + i];
+            }
+        }
+        return sum / net.scale;
+    }
+
+    // incrementally updated evaluation against a refresh of the same position on
+    // a second board and against the reference, at every node of the tree
+    void compare_evals(Board& board, Board& refreshed, const NNUE::network_t& net, const int depth, uint64_t& nodes) {
+        Packed::packed_position_t pos;
+        ASSERT_TRUE(board.encode_packed(pos));
+        ASSERT_TRUE(refreshed.decode_packed(pos));
+        const int incremental = board.evaluate();
+        EXPECT_EQ(incremental, refreshed.evaluate());
+        EXPECT_EQ(incremental, reference_eval(net, board));
+        ++nodes;
+        if (depth == 0) {
+            return;
+        }
+        std::vector<Pgn::move_t> moves;
+        board.canonical_moves(moves);
+        for (const auto& move : moves) {
+            board.play_move(move.from_num, move.to_num, move.promote_to);
+            compare_evals(board, refreshed, net, depth - 1, nodes);
+            board.undo_move();
+        }
+    }
+}
+
+
+TEST(NnueTest, IncrementalMatchesRefreshPerftMini) {
+#if defined(CRUDECHESS_NNUE_SIMD)
+    ASSERT_STREQ(NNUE::simd_name(), CRUDECHESS_NNUE_SIMD);
+#endif
+#if defined(__x86_64__)
+    if (std::string(NNUE::simd_name()) == "AVX2" && !__builtin_cpu_supports("avx2")) {
+        GTEST_SKIP() << "no AVX2 on this CPU";
+    }
+#endif
+    const NNUE::network_t net = random_network(32, 5);
+    const std::string path = (std::filesystem::temp_directory_path() / "crudechess_test_nnue.ccnn").string();
+    ASSERT_TRUE(NNUE::save(path, net));
+    ASSERT_TRUE(NNUE::load(path));
+    std::remove(path.c_str());
+    ASSERT_EQ(NNUE::network().hidden, net.hidden);
+
+    const auto fens = TestPositions::perft_mini();
+    ASSERT_FALSE(fens.empty());
+    Board board, refreshed;
+    uint64_t nodes = 0;
+    for (const auto& fen : fens) {
+        SCOPED_TRACE(fen);
+        board.set_fen(fen);
+        compare_evals(board, refreshed, net, 2, nodes);
+    }
+    EXPECT_GT(nodes, 0u);
+    NNUE::unload();
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "board.hh"
+#include "packed.hh"
+#include "positions.hh"
+
+
+namespace {
+    // every position of the tree packed, unpacked on a second board and packed again
+    void round_trip_packed(Board& board, Board& decoded, const int depth, uint64_t& positions) {
+        Packed::packed_position_t pos, repacked;
+        ASSERT_TRUE(board.encode_packed(pos));
+        ASSERT_TRUE(decoded.decode_packed(pos));
+        ASSERT_TRUE(decoded.encode_packed(repacked));
+        EXPECT_EQ(std::memcmp(&pos, &repacked, sizeof(pos)), 0);
+        EXPECT_EQ(decoded.hash(), board.hash());
+        EXPECT_EQ(decoded.pawn_hash(), board.pawn_hash());
+        EXPECT_EQ(decoded.to_move(), board.to_move());
+        ++positions;
+
+        std::vector<Pgn::move_t> moves, decoded_moves;
+        board.canonical_moves(moves);
+        decoded.canonical_moves(decoded_moves);
+        ASSERT_EQ(moves.size(), decoded_moves.size());
+        if (depth == 0) {
+            return;
+        }
+        for (const auto& move : moves) {
+            board.play_move(move.from_num, move.to_num, move.promote_to);
+            round_trip_packed(board, decoded, depth - 1, positions);
+            board.undo_move();
+        }
+    }
+
+    Packed::packed_position_t make_record(const std::vector<piece_placement_t>& pieces, const uint8_t flags, const uint8_t ep_square) {
+        Packed::packed_position_t pos;
+        std::memset(&pos, 0, sizeof(pos));
+        for (const auto& placement : pieces) {
+            pos.occupancy |= 1ULL << placement.sq_num;
+        }
+        // piece codes in square order: 1-6 for p n b r q k, +8 for black
+        int count = 0;
+        for (int sq_num = 0; sq_num < 64; ++sq_num) {
+            for (const auto& placement : pieces) {
+                if (placement.sq_num == sq_num) {
+                    const int code = std::string("pnbrqk").find(placement.piece) + 1 + (placement.colour == 'b' ? 8 : 0);
+                    pos.pieces[count / 2] |= code << (4 * (count % 2));
+                    ++count;
+                }
+            }
+        }
+        pos.flags = flags;
+        pos.ep_square = ep_square;
+        pos.fullmove_counter = 1;
+        return pos;
+    }
+}
+
+
+TEST(PackedTest, RoundTripPerftMini) {
+    const auto fens = TestPositions::perft_mini();
+    ASSERT_FALSE(fens.empty());
+    Board board, decoded;
+    uint64_t positions = 0;
+    for (const auto& fen : fens) {
+        SCOPED_TRACE(fen);
+        board.set_fen(fen);
+        round_trip_packed(board, decoded, 2, positions);
+    }
+    EXPECT_GT(positions, 0u);
+}
+
+TEST(PackedTest, DecodeRejectsIllegalBoards) {
+    Board board;
+    const piece_placement_t white_king { 'w', 'k', 4 };
+    const piece_placement_t black_king { 'b', 'k', 60 };
+    const uint8_t white_short_castle = 8 << 1;
+    EXPECT_TRUE(board.decode_packed(make_record({ white_king, black_king }, 0, Packed::kNoEpSquare)));
+    EXPECT_TRUE(board.decode_packed(make_record({ white_king, { 'w', 'r', 7 }, black_king }, white_short_castle, Packed::kNoEpSquare)));
+
+    EXPECT_FALSE(board.decode_packed(make_record({ white_king, { 'w', 'k', 0 }, black_king }, 0, Packed::kNoEpSquare)));
+    EXPECT_FALSE(board.decode_packed(make_record({ white_king, black_king, { 'w', 'p', 63 } }, 0, Packed::kNoEpSquare)));
+    EXPECT_FALSE(board.decode_packed(make_record({ white_king, black_king, { 'b', 'p', 3 } }, 0, Packed::kNoEpSquare)));
+    EXPECT_FALSE(board.decode_packed(make_record({ white_king, black_king }, white_short_castle, Packed::kNoEpSquare)));
+    EXPECT_FALSE(board.decode_packed(make_record({ white_king, black_king }, 0, 20)));
+    EXPECT_FALSE(board.decode_packed(make_record({ white_king }, 0, Packed::kNoEpSquare)));
+}
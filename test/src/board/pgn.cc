@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "board.hh"
+#include "pgn.hh"
+#include "positions.hh"
+
+
+namespace {
+    // SAN of every move of the tree parsed back to the same move
+    void round_trip_san(Board& board, const int depth, uint64_t& moves_seen) {
+        std::vector<Pgn::move_t> moves;
+        board.canonical_moves(moves);
+        for (const auto& move : moves) {
+            const std::string san = board.move_to_san(move.from_num, move.to_num, move.promote_to);
+            Pgn::move_t parsed;
+            ASSERT_TRUE(board.san_to_move(san, parsed)) << san;
+            EXPECT_TRUE(TestPositions::same_move(move, parsed)) << san;
+            ++moves_seen;
+            board.play_move(move.from_num, move.to_num, move.promote_to);
+            const char suffix = san.back();
+            EXPECT_EQ(board.is_in_check(), suffix == '+' || suffix == '#') << san;
+            if (depth > 1) {
+                round_trip_san(board, depth - 1, moves_seen);
+            }
+            board.undo_move();
+        }
+    }
+}
+
+
+TEST(SanTest, RoundTripPerftMini) {
+    const auto fens = TestPositions::perft_mini();
+    ASSERT_FALSE(fens.empty());
+    Board board;
+    uint64_t moves_seen = 0;
+    for (const auto& fen : fens) {
+        SCOPED_TRACE(fen);
+        board.set_fen(fen);
+        round_trip_san(board, 2, moves_seen);
+    }
+    EXPECT_GT(moves_seen, 0u);
+}
+
+TEST(SanTest, WrittenGameParsesBack) {
+    Board board;
+    const auto fens = TestPositions::perft_mini();
+    for (size_t i = 0; i < fens.size(); ++i) {
+        SCOPED_TRACE(fens[i]);
+        const Pgn::game_t game = TestPositions::random_game(board, fens[i], 80, i + 1);
+
+        board.set_fen(fens[i]);
+        std::string text = "[Event \"?\"]\n[FEN \"" + fens[i] + "\"]\n\n";
+        for (size_t ply = 0; ply < game.moves.size(); ++ply) {
+            const auto& move = game.moves[ply];
+            if (ply % 2 == 0) {
+                text += std::to_string(ply / 2 + 1) + ". ";
+            }
+            text += board.move_to_san(move.from_num, move.to_num, move.promote_to) + " ";
+            board.play_move(move.from_num, move.to_num, move.promote_to);
+        }
+        text += game.result + "\n";
+
+        Pgn::game_t parsed;
+        std::string error;
+        ASSERT_TRUE(Pgn::parse_game(text, board, parsed, error)) << error << "\n" << text;
+        EXPECT_EQ(parsed.result, game.result);
+        ASSERT_EQ(parsed.moves.size(), game.moves.size());
+        for (size_t ply = 0; ply < game.moves.size(); ++ply) {
+            EXPECT_TRUE(TestPositions::same_move(parsed.moves[ply], game.moves[ply])) << "ply " << ply;
+        }
+    }
+}
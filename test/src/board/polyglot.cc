@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "board.hh"
+#include "fen.hh"
+#include "polyglot.hh"
+
+
+namespace {
+    void append_be(std::string& out, const uint64_t value, const int bytes) {
+        for (int i = bytes - 1; i >= 0; --i) {
+            out.push_back(static_cast<char>(value >> (8 * i)));
+        }
+    }
+
+    // Polyglot move: to file, to rank, from file, from rank, 3 bits each
+    uint16_t book_move(const int from_num, const int to_num) {
+        return (to_num % 8) | (to_num / 8) << 3 | (from_num % 8) << 6 | (from_num / 8) << 9;
+    }
+}
+
+
+TEST(PolyglotTest, StartPositionKey) {
+    Board board;
+    board.set_fen(Fen::kFenInitial);
+    EXPECT_EQ(board.polyglot_key(), 0x463b96181691fc9cULL);
+    EXPECT_TRUE(Polyglot::random_verified());
+}
+
+TEST(PolyglotTest, ReferenceKeys) {
+    Board board;
+    board.set_fen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1");
+    EXPECT_EQ(board.polyglot_key(), 0x823c9b50fd114196ULL);
+    board.set_fen("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3");
+    EXPECT_EQ(board.polyglot_key(), 0x22a48b5a8e47ff78ULL);
+    board.set_fen("rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4");
+    EXPECT_EQ(board.polyglot_key(), 0x00fdd303c946bdd9ULL);
+    board.set_fen("rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4");
+    EXPECT_EQ(board.polyglot_key(), 0x5c3f9b829b279560ULL);
+}
+
+TEST(PolyglotTest, BookMoveFromStartPosition) {
+    Board board;
+    board.set_fen(Fen::kFenInitial);
+    const uint64_t key = board.polyglot_key();
+    std::string book;
+    for (const auto& [entry_key, move, weight] : { std::make_tuple(key - 1, book_move(6, 21), 5),
+                                                   std::make_tuple(key, book_move(12, 28), 10),
+                                                   std::make_tuple(key, book_move(11, 27), 0),
+                                                   std::make_tuple(key + 1, book_move(1, 18), 5) }) {
+        append_be(book, entry_key, 8);
+        append_be(book, move, 2);
+        append_be(book, weight, 2);
+        append_be(book, 0, 4);
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "crudechess_test_book.bin").string();
+    std::ofstream(path, std::ios::binary) << book;
+
+    ASSERT_TRUE(Polyglot::open_book(path));
+    EXPECT_EQ(Polyglot::book_entries(), 4u);
+    EXPECT_EQ(Polyglot::probe(key).size(), 2u);
+    EXPECT_TRUE(Polyglot::probe(key + 2).empty());
+    // the only weighted entry of the position: e2e4
+    search_result_t result;
+    ASSERT_TRUE(board.book_move(result));
+    EXPECT_EQ(result.from_num, 12);
+    EXPECT_EQ(result.to_num, 28);
+    Polyglot::close_book();
+    std::remove(path.c_str());
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "board.hh"
+#include "pgn.hh"
+
+
+// Positions shared by the board tests: the FENs of perft/data/perft_mini.csv,
+// which cover castling, en passant and promotions on both sides
+namespace TestPositions {
+    inline std::vector<std::string> perft_mini() {
+        std::ifstream file(CRUDECHESS_PERFT_MINI);
+        std::vector<std::string> fens;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line[0] != '#') {
+                fens.push_back(line.substr(0, line.find(',')));
+            }
+        }
+        return fens;
+    }
+
+    // a game of random legal moves from `fen', until it ends or has `plies' moves
+    inline Pgn::game_t random_game(Board& board, const std::string& fen, const int plies, const uint32_t seed) {
+        std::mt19937 rng(seed);
+        Pgn::game_t game;
+        game.start_fen = fen;
+        game.result = "*";
+        board.set_fen(fen);
+        std::vector<Pgn::move_t> moves;
+        while (static_cast<int>(game.moves.size()) < plies && board.game_end() == kGameOngoing) {
+            board.canonical_moves(moves);
+            const auto move = moves[rng() % moves.size()];
+            board.play_move(move.from_num, move.to_num, move.promote_to);
+            game.moves.push_back(move);
+        }
+        if (board.game_end() == kGameCheckmate) {
+            game.result = (board.to_move() == 'w') ? "0-1" : "1-0";
+        } else if (board.game_end() != kGameOngoing) {
+            game.result = "1/2-1/2";
+        }
+        return game;
+    }
+
+    inline bool same_move(const Pgn::move_t& a, const Pgn::move_t& b) {
+        return a.from_num == b.from_num && a.to_num == b.to_num && a.promote_to == b.promote_to;
+    }
+}